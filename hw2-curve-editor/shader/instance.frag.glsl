@@ -0,0 +1,14 @@
+#version 330 core
+in vec3 nor;
+in vec3 lightDir;
+in vec4 col;
+
+layout(location = 0) out vec4 fCol;
+
+void main()
+{
+    float diffuseTerm = dot(normalize(nor), normalize(lightDir));
+    diffuseTerm = clamp(diffuseTerm, 0, 1);
+
+    fCol = vec4(col.rgb * diffuseTerm, col.a);
+}
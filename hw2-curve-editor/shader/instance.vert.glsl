@@ -0,0 +1,29 @@
+#version 330 core
+layout (location = 0) in vec3 vPos;
+layout (location = 1) in vec3 vNor;
+layout (location = 2) in vec4 iPosScale; // world position, uniform scale
+layout (location = 3) in vec4 iColor;    // rgb, alpha
+layout (location = 4) in vec4 iRotation; // unit quaternion
+
+uniform mat4 uProjView;
+uniform vec3 uLightPos;
+
+out vec3 nor;
+out vec3 lightDir;
+out vec4 col;
+
+vec3 rotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main()
+{
+    // rotation and uniform scale, so the normal only needs the rotation
+    vec3 modelPos = iPosScale.xyz + iPosScale.w * rotate(iRotation, vPos);
+    lightDir = uLightPos - modelPos;
+    nor = rotate(iRotation, vNor);
+    col = iColor;
+
+    gl_Position = uProjView * vec4(modelPos, 1.0);
+}
@@ -26,6 +26,7 @@ AActor::AActor()
 
 	// code to update additional Actor data goes here
 	resetGuide();
+	m_pLOD = NULL;
 
 }
 
@@ -44,6 +45,8 @@ AActor& AActor::operator = (const AActor& actor)
 	m_pSkeleton = actor.m_pSkeleton;
 
 	// code to update additional Actor data goes here
+	m_pLOD = actor.m_pLOD;
+	m_LODState = actor.m_LODState;
 
 
 	return *this;
@@ -76,6 +79,20 @@ void AActor::update()
 
 }
 
+void AActor::updateLOD(double time, const vec3& viewerPos, AAnimationLOD& lod, bool updateRootXZTranslation)
+{
+	AJoint* root = m_pSkeleton->getRootNode();
+	if (!root) return; // Nothing loaded
+	m_pLOD = &lod;
+
+	// the root position of the last frame is close enough to pick the level
+	vec3 position = m_Guide.getLocal2Global().RotTrans(root->getGlobalTranslation());
+	double distance = (position - viewerPos).Length();
+
+	const APose& pose = lod.samplePose(m_LODState, *m_BVHController, time, distance);
+	m_BVHController->applyPose(pose, updateRootXZTranslation);
+}
+
 ASkeleton* AActor::getSkeleton()
 {
 	return m_pSkeleton;
@@ -120,6 +137,7 @@ void AActor::updateGuideJoint(vec3 guideTargetPos)
 void AActor::solveFootIK(float leftHeight, float rightHeight, bool rotateLeft, bool rotateRight, vec3 leftNormal, vec3 rightNormal)
 {
 	if (!m_pSkeleton->getRootNode()) { return; }
+	if (m_pLOD && !m_pLOD->useFootIK(m_LODState)) { return; } // distant characters keep the clip pose
 	AJoint* leftFoot = m_pSkeleton->getJointByID(m_IKController->mLfootID);
 	AJoint* rightFoot = m_pSkeleton->getJointByID(m_IKController->mRfootID);
 
@@ -146,3 +164,13 @@ void AActor::solveFootIK(float leftHeight, float rightHeight, bool rotateLeft, b
 	}
 	m_pSkeleton->update();
 }
+
+void AActor::solveFootIK(const AHeightField& terrain, bool rotateLeft, bool rotateRight)
+{
+	if (!m_pSkeleton->getRootNode()) { return; }
+	if (m_pLOD && !m_pLOD->useFootIK(m_LODState)) { return; } // distant characters keep the clip pose
+
+	// the guide joint takes joint positions to world space, where the terrain is
+	if (m_IKController->computeFootIK(m_Guide.getLocal2Global(), terrain, rotateLeft, rotateRight, m_pSkeleton))
+		m_pSkeleton->update();
+}
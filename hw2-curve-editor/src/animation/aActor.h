@@ -10,11 +10,13 @@
 #include "aBVHController.h"
 #include "aIKController.h"
 #include "aBehaviorController.h"
+#include "aAnimationLOD.h"
 
 
 //class BVHController;
 //class IKController;
 class BehaviorController;
+class AHeightField;
 
 class AActor
 {
@@ -28,6 +30,9 @@ public:
 	void clear();
 	void update();
 
+	// Plays the BVH clip at time with the level of detail picked from the distance to viewerPos
+	void updateLOD(double time, const vec3& viewerPos, AAnimationLOD& lod, bool updateRootXZTranslation = true);
+	AAnimationLOD::State& getLODState() { return m_LODState; }
 
 	ASkeleton* getSkeleton();
 	void setSkeleton(ASkeleton* pExternalSkeleton);
@@ -51,6 +56,8 @@ public:
 	void solveFootIK(float leftHeight, float rightHeight,
 		bool rotateLeft, bool rotateRight, 
 		vec3 leftNormal, vec3 rightNormal);
+	// Places the feet on the terrain (in world space): root offset, two-bone leg IK and foot tilt, see IKController::computeFootIK
+	void solveFootIK(const AHeightField& terrain, bool rotateLeft, bool rotateRight);
 
 protected:
 	// the actor owns the skeleton and controllers
@@ -60,6 +67,9 @@ protected:
 	IKController *m_IKController;
 	BehaviorController* m_BehaviorController;
 	AJoint m_Guide; // Considered as the parent joint of the hip/root joint
+
+	AAnimationLOD* m_pLOD; // set by updateLOD, NULL when the actor is always fully updated
+	AAnimationLOD::State m_LODState;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,182 @@
+#include "aAnimationLOD.h"
+#include "aBVHController.h"
+#include <chrono>
+#include <algorithm>
+
+#pragma warning(disable : 4018)
+
+
+
+/****************************************************************
+*
+*    	    LOD state functions
+*
+****************************************************************/
+
+AAnimationLOD::State::State() :
+	level(LOD_NEAR), slot(0), valid(false), lastTime(0.0), time0(0.0), time1(0.0)
+{
+}
+
+
+
+/****************************************************************
+*
+*    	    Animation LOD functions
+*
+****************************************************************/
+
+AAnimationLOD::AAnimationLOD() : mEnabled(true), mFrame(0)
+{
+	Settings nearSettings = { 500.0, 1, true };
+	Settings midSettings = { 1500.0, 2, true };
+	Settings farSettings = { 1.0e30, 4, false };
+	mSettings[LOD_NEAR] = nearSettings;
+	mSettings[LOD_MID] = midSettings;
+	mSettings[LOD_FAR] = farSettings;
+
+	for (int i = 0; i < NUM_LODS; i++)
+	{
+		ResetCounters(mCounters[i]);
+		ResetCounters(mLastCounters[i]);
+	}
+}
+
+AAnimationLOD::Settings& AAnimationLOD::getSettings(Level level)
+{
+	assert(level >= 0 && level < NUM_LODS);
+	return mSettings[level];
+}
+
+const AAnimationLOD::Settings& AAnimationLOD::getSettings(Level level) const
+{
+	assert(level >= 0 && level < NUM_LODS);
+	return mSettings[level];
+}
+
+const AAnimationLOD::Counters& AAnimationLOD::getCounters(Level level) const
+{
+	assert(level >= 0 && level < NUM_LODS);
+	return mLastCounters[level];
+}
+
+void AAnimationLOD::ResetCounters(Counters& counters)
+{
+	counters.numActors = 0;
+	counters.numSamples = 0;
+	counters.numInterpolated = 0;
+	counters.numFootIKSolves = 0;
+	counters.numFootIKSkipped = 0;
+	counters.updateTimeMs = 0.0;
+}
+
+void AAnimationLOD::beginFrame()
+{
+	for (int i = 0; i < NUM_LODS; i++)
+	{
+		mLastCounters[i] = mCounters[i];
+		ResetCounters(mCounters[i]);
+	}
+	mFrame++;
+}
+
+AAnimationLOD::Level AAnimationLOD::selectLevel(double distance) const
+{
+	if (!mEnabled) return LOD_NEAR;
+	for (int i = 0; i < NUM_LODS - 1; i++)
+	{
+		if (distance < mSettings[i].maxDistance) return (Level)i;
+	}
+	return LOD_FAR;
+}
+
+bool AAnimationLOD::isUpdateFrame(const State& state) const
+{
+	int interval = std::max(1, mSettings[state.level].updateInterval);
+	// offsetting by slot spreads the characters of a level evenly over the interval
+	return (mFrame + state.slot) % interval == 0;
+}
+
+const APose& AAnimationLOD::samplePose(State& state, const BVHController& clip, double time, double distance)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	Level level = selectLevel(distance);
+	bool levelChanged = level != state.level;
+	state.level = level;
+	Counters& counters = mCounters[level];
+	counters.numActors++;
+
+	int numJoints = clip.getSkeleton()->getNumJoints();
+	int interval = std::max(1, mSettings[level].updateInterval);
+	double frameTime = time - state.lastTime;
+	if (frameTime <= 0.0) frameTime = 1.0 / 60.0;
+
+	// resample when the interval is over, and whenever the cached samples cannot be interpolated
+	// (first frame, skeleton change, time jumped back e.g. when the clip looped, or time ran past the last sample)
+	bool resample = interval == 1 || !state.valid || state.pose.getNumJoints() != numJoints ||
+		time < state.time0 || time > state.time1 || isUpdateFrame(state);
+
+	if (resample)
+	{
+		if (state.pose.getNumJoints() != numJoints)
+		{
+			state.pose.resize(numJoints);
+			state.pose0.resize(numJoints);
+			state.pose1.resize(numJoints);
+			state.valid = false;
+		}
+
+		if (interval == 1)
+		{
+			clip.samplePose(time, state.pose);
+			state.valid = false;
+		}
+		else
+		{
+			// Start from the interpolated pose at time, which is where the previous samples have reached
+			// by now, so resampling never pops or repeats a frame; then sample one interval ahead so the
+			// following frames only need to interpolate
+			if (!state.valid || levelChanged || time < state.time0 || time > state.time1)
+			{
+				clip.samplePose(time, state.pose0);
+				counters.numSamples++;
+			}
+			else
+			{
+				float u = (float)((time - state.time0) / (state.time1 - state.time0));
+				APose::Blend(state.pose0, state.pose1, u, NULL, state.pose);
+				state.pose0 = state.pose;
+			}
+			state.time0 = time;
+			state.time1 = time + interval * frameTime;
+			clip.samplePose(state.time1, state.pose1);
+			state.pose = state.pose0;
+			state.valid = true;
+		}
+		counters.numSamples++;
+	}
+	else
+	{
+		float u = (float)((time - state.time0) / (state.time1 - state.time0));
+		APose::Blend(state.pose0, state.pose1, u, NULL, state.pose);
+		counters.numInterpolated++;
+	}
+	state.lastTime = time;
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	counters.updateTimeMs += elapsed.count();
+	return state.pose;
+}
+
+bool AAnimationLOD::useFootIK(const State& state)
+{
+	Counters& counters = mCounters[state.level];
+	if (mSettings[state.level].solveFootIK)
+	{
+		counters.numFootIKSolves++;
+		return true;
+	}
+	counters.numFootIKSkipped++;
+	return false;
+}
@@ -0,0 +1,84 @@
+#ifndef AANIMATIONLOD_H_
+#define AANIMATIONLOD_H_
+
+#pragma once
+
+#include "aPose.h"
+
+class BVHController;
+
+// Distance-based level of detail for character animation.
+// NEAR characters sample their clip every frame. MID and FAR characters sample it every few frames, staggered
+// across characters, and interpolate in between. FAR characters also skip foot IK.
+class AAnimationLOD
+{
+public:
+	enum Level { LOD_NEAR, LOD_MID, LOD_FAR, NUM_LODS };
+
+	struct Settings
+	{
+		double maxDistance;    // characters closer than this (and farther than the previous level) use this level
+		int updateInterval;    // frames between clip samples, 1 = every frame
+		bool solveFootIK;
+	};
+
+	struct Counters
+	{
+		int numActors;         // characters assigned to the level
+		int numSamples;        // clip samples taken
+		int numInterpolated;   // frames served by interpolating between cached samples
+		int numFootIKSolves;
+		int numFootIKSkipped;
+		double updateTimeMs;   // time spent producing poses for the level
+	};
+
+	// per-character state, owned by the character
+	struct State
+	{
+		State();
+
+		Level level;
+		int slot;              // stagger offset, e.g. the character index
+		bool valid;
+		double lastTime;
+		double time0, time1;   // clip times of the interpolation end points
+		APose pose0, pose1;
+		APose pose;            // pose for the current frame
+	};
+
+	AAnimationLOD();
+
+	void setEnabled(bool enabled) { mEnabled = enabled; }
+	bool isEnabled() const { return mEnabled; }
+
+	Settings& getSettings(Level level);
+	const Settings& getSettings(Level level) const;
+
+	// counters of the last completed frame
+	const Counters& getCounters(Level level) const;
+	int getFrame() const { return mFrame; }
+
+	// call once per rendered frame before updating characters
+	void beginFrame();
+
+	Level selectLevel(double distance) const;
+
+	// Assigns the character a level from its distance to the viewer and returns the pose to use this frame
+	const APose& samplePose(State& state, const BVHController& clip, double time, double distance);
+
+	// Records whether foot IK ran for a character and returns true if the level allows it
+	bool useFootIK(const State& state);
+
+protected:
+	bool isUpdateFrame(const State& state) const;
+	static void ResetCounters(Counters& counters);
+
+protected:
+	bool mEnabled;
+	int mFrame;
+	Settings mSettings[NUM_LODS];
+	Counters mCounters[NUM_LODS];
+	Counters mLastCounters[NUM_LODS];
+};
+
+#endif
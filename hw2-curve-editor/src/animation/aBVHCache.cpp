@@ -0,0 +1,181 @@
+#include "aBVHCache.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+
+#pragma warning(disable : 4018)
+
+static inline unsigned long long AlignOffset(unsigned long long offset)
+{
+	return (offset + 15) & ~15ULL;
+}
+
+ABVHCache::ABVHCache() : mHeader(NULL)
+{
+}
+
+ABVHCache::~ABVHCache()
+{
+}
+
+std::string ABVHCache::GetCachePath(const std::string& filename)
+{
+	return filename + ".cache";
+}
+
+bool ABVHCache::GetSourceStamp(const std::string& filename, unsigned long long& size, long long& time)
+{
+	struct stat fileStat;
+	if (stat(filename.c_str(), &fileStat) != 0) return false;
+	size = (unsigned long long)fileStat.st_size;
+	time = (long long)fileStat.st_mtime;
+	return true;
+}
+
+bool ABVHCache::open(const std::string& cacheFile, const std::string& sourceFile)
+{
+	close();
+
+	unsigned long long sourceSize;
+	long long sourceTime;
+	if (!GetSourceStamp(sourceFile, sourceSize, sourceTime)) return false;
+	if (!mFile.open(cacheFile) || mFile.size() < sizeof(ABVHCacheHeader))
+	{
+		close();
+		return false;
+	}
+
+	const ABVHCacheHeader* header = reinterpret_cast<const ABVHCacheHeader*>(mFile.data());
+	bool valid = strncmp(header->magic, "BVHC", 4) == 0 && header->version == Version &&
+		header->sourceSize == sourceSize && header->sourceTime == sourceTime;
+
+	// make sure every section the header points at lies inside the file; the sections are in order and the
+	// keys end the file, so once keysOffset is inside it none of the sums below can wrap around
+	unsigned long long fileSize = mFile.size();
+	valid = valid && header->numJoints > 0 && header->jointsOffset <= header->stringsOffset &&
+		header->stringsOffset <= header->rootOffset && header->rootOffset <= header->keysOffset &&
+		header->keysOffset <= fileSize &&
+		(fileSize - header->keysOffset) / (4ULL * sizeof(float) * header->numJoints) >= header->numFrames &&
+		header->jointsOffset + header->numJoints * (unsigned long long)sizeof(ABVHCacheJoint) <= header->stringsOffset &&
+		header->rootOffset + 3ULL * sizeof(float) * header->numFrames <= header->keysOffset;
+
+	// and every name and rotation order inside the string table, so a corrupt cache is reparsed from the BVH
+	// instead of read out of bounds
+	const ABVHCacheJoint* joints = reinterpret_cast<const ABVHCacheJoint*>(mFile.data() + header->jointsOffset);
+	unsigned long long stringsSize = header->rootOffset - header->stringsOffset;
+	for (unsigned int i = 0; valid && i < header->numJoints; i++)
+	{
+		valid = (unsigned long long)joints[i].nameOffset + joints[i].nameLength <= stringsSize &&
+			(unsigned long long)joints[i].orderOffset + joints[i].orderLength <= stringsSize;
+	}
+	if (!valid)
+	{
+		close();
+		return false;
+	}
+	mHeader = header;
+	return true;
+}
+
+void ABVHCache::close()
+{
+	mHeader = NULL;
+	mFile.close();
+}
+
+const ABVHCacheJoint& ABVHCache::getJoint(int jointID) const
+{
+	assert(mHeader && jointID >= 0 && jointID < mHeader->numJoints);
+	return reinterpret_cast<const ABVHCacheJoint*>(mFile.data() + mHeader->jointsOffset)[jointID];
+}
+
+std::string ABVHCache::getString(unsigned int offset, unsigned int length) const
+{
+	assert(mHeader && mHeader->stringsOffset + offset + length <= mHeader->rootOffset);
+	const char* strings = mFile.data() + mHeader->stringsOffset;
+	return std::string(strings + offset, length);
+}
+
+const float* ABVHCache::getRootTranslations() const
+{
+	assert(mHeader);
+	return reinterpret_cast<const float*>(mFile.data() + mHeader->rootOffset);
+}
+
+const float* ABVHCache::getKeys() const
+{
+	assert(mHeader);
+	return reinterpret_cast<const float*>(mFile.data() + mHeader->keysOffset);
+}
+
+bool ABVHCache::Write(const std::string& cacheFile, const std::string& sourceFile,
+	const std::vector<ABVHJoint>& joints, double dt, unsigned int numFrames,
+	const std::vector<float>& root, const std::vector<float>& keys)
+{
+	assert(root.size() == 3 * (size_t)numFrames);
+	assert(keys.size() == 4 * (size_t)numFrames * joints.size());
+
+	ABVHCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "BVHC", 4);
+	header.version = Version;
+	if (!GetSourceStamp(sourceFile, header.sourceSize, header.sourceTime)) return false;
+	header.numJoints = joints.size();
+	header.numFrames = numFrames;
+	header.dt = dt;
+
+	std::vector<ABVHCacheJoint> records(joints.size());
+	std::string strings;
+	for (unsigned int i = 0; i < joints.size(); i++)
+	{
+		ABVHCacheJoint& record = records[i];
+		memset(&record, 0, sizeof(record));
+		record.parent = joints[i].parent;
+		record.numChannels = joints[i].numChannels;
+		for (int k = 0; k < 3; k++) record.offset[k] = (float)joints[i].offset[k];
+		record.nameOffset = strings.size();
+		record.nameLength = joints[i].name.size();
+		strings += joints[i].name;
+		record.orderOffset = strings.size();
+		record.orderLength = joints[i].channels.size();
+		strings += joints[i].channels;
+	}
+
+	header.jointsOffset = AlignOffset(sizeof(header));
+	header.stringsOffset = AlignOffset(header.jointsOffset + records.size() * sizeof(ABVHCacheJoint));
+	header.rootOffset = AlignOffset(header.stringsOffset + strings.size());
+	header.keysOffset = AlignOffset(header.rootOffset + root.size() * sizeof(float));
+
+	// write to a temporary file first so a reader never maps a half-written cache
+	std::string tempFile = cacheFile + ".tmp";
+	FILE* file = fopen(tempFile.c_str(), "wb");
+	if (!file) return false;
+
+	static const char padding[16] = { 0 };
+	unsigned long long position = 0;
+	bool ok = true;
+	struct Section { unsigned long long offset; const void* data; size_t size; };
+	Section sections[] = {
+		{ 0, &header, sizeof(header) },
+		{ header.jointsOffset, records.data(), records.size() * sizeof(ABVHCacheJoint) },
+		{ header.stringsOffset, strings.data(), strings.size() },
+		{ header.rootOffset, root.data(), root.size() * sizeof(float) },
+		{ header.keysOffset, keys.data(), keys.size() * sizeof(float) } };
+	for (unsigned int i = 0; i < sizeof(sections) / sizeof(sections[0]) && ok; i++)
+	{
+		ok = fwrite(padding, 1, (size_t)(sections[i].offset - position), file) == sections[i].offset - position;
+		if (sections[i].size > 0) ok = ok && fwrite(sections[i].data, 1, sections[i].size, file) == sections[i].size;
+		position = sections[i].offset + sections[i].size;
+	}
+	ok = fclose(file) == 0 && ok;
+
+	remove(cacheFile.c_str());
+	if (!ok || rename(tempFile.c_str(), cacheFile.c_str()) != 0)
+	{
+		remove(tempFile.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,77 @@
+#ifndef ABVHCACHE_H_
+#define ABVHCACHE_H_
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "aMappedFile.h"
+#include "aBVHParser.h"
+
+// Binary cache of a loaded BVH clip, written next to the text file as "<clip>.bvh.cache".
+// Layout (native endianness, every section 16-byte aligned so the mapped file is read in place):
+//   ABVHCacheHeader | ABVHCacheJoint[numJoints] | string table
+//   | root translations (x, y, z per frame) | rotation keys (x, y, z, w per joint, one row per frame)
+struct ABVHCacheHeader
+{
+	char magic[4];                 // "BVHC"
+	unsigned int version;
+	unsigned long long sourceSize; // size and modification time of the BVH file the cache was built from
+	long long sourceTime;
+	unsigned int numJoints;
+	unsigned int numFrames;
+	unsigned int reserved[2];
+	double dt;
+	unsigned long long jointsOffset;
+	unsigned long long stringsOffset;
+	unsigned long long rootOffset;
+	unsigned long long keysOffset;
+};
+
+struct ABVHCacheJoint
+{
+	int parent;
+	int numChannels;
+	float offset[3];
+	unsigned int nameOffset, nameLength;         // into the string table
+	unsigned int orderOffset, orderLength;
+	unsigned int reserved[3];
+};
+
+class ABVHCache
+{
+public:
+	static const unsigned int Version = 2;
+
+	ABVHCache();
+	virtual ~ABVHCache();
+
+	static std::string GetCachePath(const std::string& filename);
+
+	// Maps a cache and checks it against the BVH file it was built from.
+	// Returns false when the cache is missing, has another version or is stale
+	bool open(const std::string& cacheFile, const std::string& sourceFile);
+	void close();
+
+	const ABVHCacheHeader& getHeader() const { return *mHeader; }
+	const ABVHCacheJoint& getJoint(int jointID) const;
+	std::string getString(unsigned int offset, unsigned int length) const;
+
+	const float* getRootTranslations() const;
+	const float* getKeys() const; // frame-major, joint j of frame f at 4 * (f * numJoints + j)
+
+	// joints: hierarchy in joint ID order with the rotation order in ABVHJoint::channels
+	// root: 3 floats per frame, keys: 4 floats per joint per frame in the getKeys() layout
+	static bool Write(const std::string& cacheFile, const std::string& sourceFile,
+		const std::vector<ABVHJoint>& joints, double dt, unsigned int numFrames,
+		const std::vector<float>& root, const std::vector<float>& keys);
+
+protected:
+	static bool GetSourceStamp(const std::string& filename, unsigned long long& size, long long& time);
+
+protected:
+	AMappedFile mFile;
+	const ABVHCacheHeader* mHeader;
+};
+
+#endif
@@ -1,7 +1,10 @@
 #include "aBVHController.h"
+#include "aBVHCache.h"
+#include "aMotionLibrary.h"
 #include "aVector.h"
 #include "aRotation.h"
 #include <iostream>
+#include <algorithm>
 
 #include "aActor.h"
 
@@ -14,19 +17,26 @@ BVHController::BVHController()
 	mSkeleton = NULL;
 	mFps = 120.0;
 	mDt = 0.008333;
+	mUseCache = true;
+	mNumFrames = 0;
+	mStream = NULL;
 }
 
 BVHController::~BVHController()
 {
     //clear();
+	delete mStream;
 }
 
 void BVHController::clear()
 {
     mFilename = "";
+	delete mStream;
+	mStream = NULL;
 	mSkeleton->clear();
     mRootMotion.clear();
-    mMotion.clear();
+	mNumFrames = 0;
+	mRotationKeys.clear();
 }
 
 ASkeleton* BVHController::getSkeleton()
@@ -52,15 +62,87 @@ void BVHController::setActor(AActor* actor)
 
 void BVHController::update(double time, bool updateRootXZTranslation)
 {
-	// TODO: Given the current value of time, 
-	// 1. set the local transforms at each Skeleton joint using the cached spline data in member variables mRootMotion and mMotion 
-	// 2. update the joint transforms of the full skeleton in order to compute the global transforms at each joint
-	// Hint: the root can both rotate and translate (i.e. has 6 DOFs) while all the other joints just rotate 
+	if (!mSkeleton || !mSkeleton->getRootNode()) return; // Nothing loaded
 
+	samplePose(time, mPose);
+	applyPose(mPose, updateRootXZTranslation);
+}
+
+void BVHController::samplePose(double time, APose& pose) const
+{
+	int numJoints = mSkeleton->getNumJoints();
+	if (pose.getNumJoints() != numJoints) pose.resize(numJoints);
+	if (mStream)
+	{
+		sampleStreamPose(time, pose);
+		return;
+	}
+
+	if (mNumFrames == 0) return;
+
+	int frame, nextFrame;
+	double u;
+	getSampleFrames(time, mNumFrames, frame, nextFrame, u);
+	const float* keys0 = &mRotationKeys[4 * (size_t)frame * numJoints];
+	const float* keys1 = &mRotationKeys[4 * (size_t)nextFrame * numJoints];
+	for (int i = 0; i < numJoints; i++, keys0 += 4, keys1 += 4)
+	{
+		quat q0(keys0[3], keys0[0], keys0[1], keys0[2]);
+		quat q1(keys1[3], keys1[0], keys1[1], keys1[2]);
+		pose.setJointRotation(i, quat::Slerp(q0, q1, u));
+	}
+	pose.setRootTranslation(mRootMotion.getValue(time));
+}
+
+void BVHController::getSampleFrames(double time, int numFrames, int& frame, int& nextFrame, double& u) const
+{
+	double frameTime = std::max(0.0, time) / mDt;
+	frame = (int)frameTime;
+	u = frameTime - frame;
+	frame %= numFrames;
+	nextFrame = (frame + 1) % numFrames;
+}
+
+void BVHController::applyPose(const APose& pose, bool updateRootXZTranslation)
+{
+	AJoint* root = mSkeleton->getRootNode();
+	if (!root) return;
+	assert(pose.getNumJoints() == mSkeleton->getNumJoints());
+
+	for (int i = 0; i < pose.getNumJoints(); i++)
+	{
+		mSkeleton->getJointByID(i)->setLocalRotation(pose.getJointRotation(i).ToRotation());
+	}
+
+	// the root has 6 DOFs; when XZ is not applied the guide joint is expected to place the character
+	vec3 rootTranslation = pose.getRootTranslation();
+	if (!updateRootXZTranslation)
+	{
+		rootTranslation[0] = 0.0;
+		rootTranslation[2] = 0.0;
+	}
+	root->setLocalTranslation(rootTranslation);
+
+	mSkeleton->update();
 }
 
 bool BVHController::load(const std::string& filename)
 {
+	if (mUseCache && loadCache(filename))
+	{
+		mFilename = filename;
+		return true;
+	}
+
+	// Memory-mapped single-pass parser; the stream parser below is only used when it fails
+	ABVHData data;
+	if (ABVHParser::Load(filename, data) && loadData(data))
+	{
+		mFilename = filename;
+		if (mUseCache) saveCache(filename);
+		return true;
+	}
+
     std::ifstream inFile(filename.c_str());
     if (!inFile.is_open())
     {
@@ -76,9 +158,182 @@ bool BVHController::load(const std::string& filename)
         mFilename = filename;
     }
     inFile.close();
+    if (status && mUseCache) saveCache(filename);
     return status;
 }
 
+bool BVHController::loadCache(const std::string& filename)
+{
+	ABVHCache cache;
+	if (!cache.open(ABVHCache::GetCachePath(filename), filename)) return false;
+	const ABVHCacheHeader& header = cache.getHeader();
+
+	clear();
+	ASkeleton* skeleton = mActor->getSkeleton();
+	for (unsigned int i = 0; i < header.numJoints; i++)
+	{
+		const ABVHCacheJoint& record = cache.getJoint(i);
+		if ((i == 0) != (record.parent < 0) || record.parent >= (int)i)
+		{
+			clear();
+			return false;
+		}
+
+		AJoint* jointnode = new AJoint(cache.getString(record.nameOffset, record.nameLength));
+		skeleton->addJoint(jointnode, i == 0);
+		if (i > 0) AJoint::Attach(skeleton->getJointByID(record.parent), jointnode);
+		jointnode->setLocalTranslation(vec3(record.offset[0], record.offset[1], record.offset[2]));
+		jointnode->setNumChannels(record.numChannels);
+		if (record.orderLength > 0) jointnode->setRotationOrder(cache.getString(record.orderOffset, record.orderLength));
+	}
+	skeleton->update();
+
+	mDt = header.dt;
+	mFps = 1.0 / mDt;
+	mNumFrames = header.numFrames;
+	setRootMotion(cache.getRootTranslations(), mNumFrames);
+
+
+	// the cache keys have the same layout as mRotationKeys
+	const float* keys = cache.getKeys();
+	mRotationKeys.assign(keys, keys + 4 * (size_t)header.numFrames * header.numJoints);
+	return true;
+}
+
+bool BVHController::saveCache(const std::string& filename)
+{
+	ASkeleton* skeleton = mActor->getSkeleton();
+	unsigned int numJoints = skeleton->getNumJoints();
+	unsigned int numFrames = mNumFrames;
+	if (numJoints == 0 || mRootMotion.getNumKeys() != numFrames) return false;
+
+	std::vector<ABVHJoint> joints(numJoints);
+	for (unsigned int i = 0; i < numJoints; i++)
+	{
+		AJoint* joint = skeleton->getJointByID(i);
+		joints[i].name = joint->getName();
+		joints[i].parent = joint->getParent() ? joint->getParent()->getID() : -1;
+		joints[i].offset = joint->getLocalTranslation();
+		joints[i].numChannels = joint->getNumChannels();
+		joints[i].firstChannel = 0;
+		joints[i].channels = joint->getRotationOrder();
+	}
+
+	std::vector<float> root(3 * numFrames);
+	for (unsigned int f = 0; f < numFrames; f++)
+	{
+		vec3 translation = mRootMotion.getKey(f);
+		for (int k = 0; k < 3; k++) root[3 * f + k] = (float)translation[k];
+	}
+
+	return ABVHCache::Write(ABVHCache::GetCachePath(filename), filename, joints, mDt, numFrames, root, mRotationKeys);
+}
+
+void BVHController::buildSkeleton(const std::vector<ABVHJoint>& joints)
+{
+	ASkeleton* skeleton = mActor->getSkeleton();
+	for (unsigned int i = 0; i < joints.size(); i++)
+	{
+		const ABVHJoint& desc = joints[i];
+		AJoint* jointnode = new AJoint(desc.name);
+		skeleton->addJoint(jointnode, desc.parent < 0);
+		if (desc.parent >= 0) AJoint::Attach(skeleton->getJointByID(desc.parent), jointnode);
+		jointnode->setLocalTranslation(desc.offset);
+		jointnode->setNumChannels(desc.numChannels);
+		if (desc.numChannels > 0) jointnode->setRotationOrder(desc.channels);
+	}
+	skeleton->update();
+}
+
+bool BVHController::loadData(const ABVHData& data)
+{
+	clear();
+	if (data.joints.empty()) return false;
+
+	buildSkeleton(data.joints);
+	std::vector<float> root;
+	ConvertMotion(data, root, mRotationKeys);
+	mDt = data.dt;
+	mFps = 1.0 / mDt;
+	mNumFrames = data.numFrames;
+	setRootMotion(root.data(), mNumFrames);
+	return true;
+}
+
+bool BVHController::loadClip(const AMotionClip& clip)
+{
+	clear();
+	if (!clip.skeleton || clip.skeleton->joints.empty()) return false;
+
+	buildSkeleton(clip.skeleton->joints);
+	mDt = clip.dt;
+	mFps = 1.0 / mDt;
+	mNumFrames = clip.numFrames;
+	mRotationKeys = clip.rotationKeys;
+	setRootMotion(clip.rootTranslations.data(), mNumFrames);
+	mFilename = clip.filename;
+	return true;
+}
+
+void BVHController::ConvertMotion(const ABVHData& data, std::vector<float>& rootTranslations, std::vector<float>& rotationKeys)
+{
+	// Convert every joint from its contiguous channel arrays in one pass per joint
+	static const float zeros[1] = { 0.0f };
+	int numJoints = data.joints.size();
+	rootTranslations.assign(3 * (size_t)data.numFrames, 0.0f);
+	rotationKeys.resize(4 * (size_t)data.numFrames * numJoints);
+	for (int i = 0; i < numJoints; i++)
+	{
+		const ABVHJoint& desc = data.joints[i];
+		const float* tx = zeros, *ty = zeros, *tz = zeros, *r1 = zeros, *r2 = zeros, *r3 = zeros;
+		int step = 0;
+		if (desc.numChannels == 6 || desc.numChannels == 3)
+		{
+			int c = desc.firstChannel;
+			if (desc.numChannels == 6)
+			{
+				tx = data.getChannel(c++);
+				ty = data.getChannel(c++);
+				tz = data.getChannel(c++);
+			}
+			r1 = data.getChannel(c++);
+			r2 = data.getChannel(c++);
+			r3 = data.getChannel(c++);
+			step = 1;
+		}
+
+		// same channel name parsing as the skeleton joints
+		AJoint joint;
+		joint.setRotationOrder(desc.channels);
+		const std::string& order = joint.getRotationOrder();
+
+		bool isRoot = desc.parent < 0;
+		float* key = &rotationKeys[4 * (size_t)i];
+		for (int f = 0, k = 0; f < data.numFrames; f++, k += step, key += 4 * numJoints)
+		{
+			if (isRoot)
+			{
+				rootTranslations[3 * f] = tx[k]; rootTranslations[3 * f + 1] = ty[k]; rootTranslations[3 * f + 2] = tz[k];
+			}
+			quat q = BVHRotation(r1[k], r2[k], r3[k], order);
+			key[0] = (float)q.X(); key[1] = (float)q.Y(); key[2] = (float)q.Z(); key[3] = (float)q.W();
+		}
+	}
+}
+
+void BVHController::setRootMotion(const float* root, int numFrames)
+{
+	mRootMotion.clear();
+	mRootMotion.setFramerate(mFps);
+	mRootMotion.setInterpolationType(ASplineVec3::LINEAR);
+	for (int f = 0; f < numFrames; f++, root += 3)
+	{
+		mRootMotion.appendKey(mDt * f, vec3(root[0], root[1], root[2]), false);
+	}
+	mRootMotion.computeControlPoints();
+	mRootMotion.cacheCurve();
+}
+
 bool BVHController::loadSkeleton(std::ifstream& inFile)
 {
     clear();
@@ -199,14 +454,8 @@ bool BVHController::loadMotion(std::ifstream& inFile)
     mFps = 1.0 / mDt;
 
 	ASkeleton* skeleton = mActor->getSkeleton();
-    // Init rotation curves
-	for (unsigned int i = 0; i < skeleton->getNumJoints(); i++)
-    {
-        ASplineQuat q;
-        q.setFramerate(mFps);
-        q.setInterpolationType(ASplineQuat::LINEAR);
-        mMotion[i] = q;
-    }
+    mNumFrames = 0;
+    mRotationKeys.reserve(4 * (size_t)frameCount * skeleton->getNumJoints());
     mRootMotion.setFramerate(mFps);
     mRootMotion.setInterpolationType(ASplineVec3::LINEAR);
 
@@ -218,18 +467,15 @@ bool BVHController::loadMotion(std::ifstream& inFile)
 
     mRootMotion.computeControlPoints();
     mRootMotion.cacheCurve();
-	for (unsigned int i = 0; i < skeleton->getNumJoints(); i++)
-    {
-        mMotion[i].cacheCurve();
-    }
     return true;
 }
 
 void BVHController::loadFrame(std::ifstream& inFile)
 {
     float tx, ty, tz, r1, r2, r3;
-    double t = mDt * mRootMotion.getNumKeys();
+    double t = mDt * mNumFrames;
 	ASkeleton* skeleton = mActor->getSkeleton();
+	mRotationKeys.resize(4 * (size_t)(mNumFrames + 1) * skeleton->getNumJoints());
 	for (unsigned int i = 0; i < skeleton->getNumJoints(); i++)
     {
         tx = ty = tz = 0.0f;
@@ -255,11 +501,84 @@ void BVHController::loadFrame(std::ifstream& inFile)
         }
 
         quat q = ComputeBVHRot(r1, r2, r3, pJoint->getRotationOrder());
-        mMotion[i].appendKey(t, q, false);
+        setJointRotationKey(mNumFrames, i, q);
     }
+    mNumFrames++;
 }
 
-quat BVHController::ComputeBVHRot(float r1, float r2, float r3, const std::string& rotOrder) // For BVH
+bool BVHController::loadStream(const std::string& filename, int windowFrames)
+{
+	clear();
+	ABVHStream* stream = new ABVHStream();
+	if (!stream->open(filename, windowFrames))
+	{
+		std::cout << "WARNING: Could not stream " << filename.c_str() << std::endl;
+		delete stream;
+		return false;
+	}
+
+	const ABVHData& header = stream->getHeader();
+	buildSkeleton(header.joints);
+	mDt = header.dt;
+	mFps = 1.0 / mDt;
+	mStream = stream;
+	mFilename = filename;
+	return true;
+}
+
+void BVHController::seek(double time)
+{
+	if (mStream) mStream->seek((int)(std::max(0.0, time) / mDt));
+}
+
+void BVHController::sampleStreamPose(double time, APose& pose) const
+{
+	int numFrames = mStream->getNumFrames();
+	if (numFrames == 0) return;
+
+	int frame, nextFrame;
+	double u;
+	getSampleFrames(time, numFrames, frame, nextFrame, u);
+
+	// a buffer per call, so streamed clips can be sampled from several threads like the others
+	const ABVHData& header = mStream->getHeader();
+	std::vector<float> frames(2 * header.numChannels);
+	float* channels0 = &frames[0];
+	float* channels1 = &frames[header.numChannels];
+	if (!mStream->getFrame(frame, channels0)) return; // hold the last pose until the reader catches up
+	if (!mStream->getFrame(nextFrame, channels1))
+	{
+		channels1 = channels0;
+		u = 0.0;
+	}
+
+	for (unsigned int i = 0; i < header.joints.size(); i++)
+	{
+		const ABVHJoint& desc = header.joints[i];
+		if (desc.numChannels != 6 && desc.numChannels != 3) continue;
+
+		int c = desc.firstChannel + desc.numChannels - 3;
+		const std::string& order = mSkeleton->getJointByID(i)->getRotationOrder();
+		quat q0 = ComputeBVHRot(channels0[c], channels0[c + 1], channels0[c + 2], order);
+		quat q1 = ComputeBVHRot(channels1[c], channels1[c + 1], channels1[c + 2], order);
+		pose.setJointRotation(i, quat::Slerp(q0, q1, u));
+
+		if (i == 0 && desc.numChannels == 6)
+		{
+			c = desc.firstChannel;
+			vec3 t0(channels0[c], channels0[c + 1], channels0[c + 2]);
+			vec3 t1(channels1[c], channels1[c + 1], channels1[c + 2]);
+			pose.setRootTranslation(t0 + (t1 - t0) * u);
+		}
+	}
+}
+
+quat BVHController::ComputeBVHRot(float r1, float r2, float r3, const std::string& rotOrder) const // For BVH
+{
+	return BVHRotation(r1, r2, r3, rotOrder);
+}
+
+quat BVHController::BVHRotation(float r1, float r2, float r3, const std::string& rotOrder)
 {
     mat3 m;
     float ry, rx, rz;
@@ -299,21 +618,32 @@ quat BVHController::ComputeBVHRot(float r1, float r2, float r3, const std::strin
 
 float BVHController::getDuration()
 {
+	if (mStream) return std::max(0, mStream->getNumFrames() - 1) * mDt;
 	return mRootMotion.getDuration();
 }
 
 int BVHController::getKeySize()
 {
-	return mRootMotion.getNumKeys();
+	if (mStream) return mStream->getNumFrames();
+	return mNumFrames;
 }
 
 float BVHController::getKeyTime(int keyID)
 {
-	return mRootMotion.getKeyTime(keyID);
+	return keyID * mDt; // every joint shares the frame time axis
+}
+
+quat BVHController::getJointRotationKey(int keyID, int jointID) const
+{
+	assert(!mStream && jointID < mSkeleton->getNumJoints() && keyID < mNumFrames);
+	const float* key = &mRotationKeys[4 * ((size_t)keyID * mSkeleton->getNumJoints() + jointID)];
+	return quat(key[3], key[0], key[1], key[2]);
 }
 
 void BVHController::setJointRotationKey(int keyID, int jointID, quat newquat)
 {
-	assert(jointID < getSkeleton()->getNumJoints() && keyID < getKeySize());
-	mMotion[jointID].editKey(keyID, newquat);
+	if (mStream) return; // streamed clips are read only
+	assert(jointID < mSkeleton->getNumJoints() && 4 * ((size_t)keyID + 1) * mSkeleton->getNumJoints() <= mRotationKeys.size());
+	float* key = &mRotationKeys[4 * ((size_t)keyID * mSkeleton->getNumJoints() + jointID)];
+	key[0] = (float)newquat.X(); key[1] = (float)newquat.Y(); key[2] = (float)newquat.Z(); key[3] = (float)newquat.W();
 }
@@ -13,9 +13,13 @@
 
 #include "aSplineVec3.h"
 #include "aSplineQuat.h"
+#include "aPose.h"
+#include "aBVHParser.h"
+#include "aBVHStream.h"
 
 
 class AActor;  // forward declaration since BVHController class references AActor and AActor class references BVHController
+struct AMotionClip;
 
 class BVHController
 {
@@ -24,6 +28,26 @@ public:
     virtual ~BVHController();
     virtual void update(double time, bool updateRootXZTranslation = true);
     virtual bool load(const std::string& filename);
+	// Builds the skeleton and motion curves from an already parsed clip
+	bool loadData(const ABVHData& data);
+	// Loads filename from its binary cache; fails when the cache is missing or older than filename
+	bool loadCache(const std::string& filename);
+	// Writes the loaded clip to the binary cache of filename
+	bool saveCache(const std::string& filename);
+	// Plays a clip of an AMotionLibrary; the skeleton is rebuilt from the hierarchy the clip shares
+	bool loadClip(const AMotionClip& clip);
+	// Converts parsed frames to root translations (x, y, z per frame) and rotation keys in the mRotationKeys layout.
+	// Touches no controller state, so clips can be converted on worker threads
+	static void ConvertMotion(const ABVHData& data, std::vector<float>& rootTranslations, std::vector<float>& rotationKeys);
+	// load() reads and writes the binary cache unless disabled
+	void setUseCache(bool useCache) { mUseCache = useCache; }
+
+	// Plays filename without loading it whole: only windowFrames frames around the playhead are decoded,
+	// by a background thread. The clip is read only and update() keeps the last pose while frames are pending
+	bool loadStream(const std::string& filename, int windowFrames = 1024);
+	bool isStreaming() const { return mStream != NULL; }
+	// Lets the stream start reading around time ahead of playback, e.g. when scrubbing
+	void seek(double time);
 
 	ASkeleton* getSkeleton(); // skeleton contains the joint transform hierarchy
 	const ASkeleton* getSkeleton() const;
@@ -33,10 +57,23 @@ public:
 	float getDuration();
 	int getKeySize();
 	float getKeyTime(int keyID);
+	quat getJointRotationKey(int keyID, int jointID) const;
 	void setJointRotationKey(int keyID, int jointID, quat newquat);
 
+	// Samples every joint rotation and the root translation at time into a flat pose without touching the skeleton
+	// Safe to call from several threads; a streamed clip decodes around the time of the latest call
+	void samplePose(double time, APose& pose) const;
+	// Writes a pose to the skeleton local transforms and updates the global transforms
+	void applyPose(const APose& pose, bool updateRootXZTranslation = true);
+
 protected:
-    virtual quat ComputeBVHRot(float r1, float r2, float r3, const std::string& rotOrder);
+    virtual quat ComputeBVHRot(float r1, float r2, float r3, const std::string& rotOrder) const;
+    static quat BVHRotation(float r1, float r2, float r3, const std::string& rotOrder);
+    void setRootMotion(const float* root, int numFrames); // 3 floats per frame
+    void buildSkeleton(const std::vector<ABVHJoint>& joints);
+    // frame at time and the next one, looping over numFrames, with the blend factor u between them
+    void getSampleFrames(double time, int numFrames, int& frame, int& nextFrame, double& u) const;
+    void sampleStreamPose(double time, APose& pose) const;
     virtual bool loadSkeleton(std::ifstream &inFile);
     virtual bool loadJoint(std::ifstream &inFile, AJoint *pParent, std::string prefix);
     virtual bool loadMotion(std::ifstream &inFile);
@@ -49,8 +86,14 @@ protected:
 	ASkeleton* mSkeleton;
     double mFps;
     double mDt;
+    bool mUseCache;
     ASplineVec3 mRootMotion;
-    std::map<int, ASplineQuat> mMotion;
+    // all joint rotations on the shared time axis f * mDt, frame-major so a pose is one contiguous row:
+    // joint j of frame f is the quaternion (x, y, z, w) at mRotationKeys[4 * (f * numJoints + j)]
+    int mNumFrames;
+    std::vector<float> mRotationKeys;
+    APose mPose;
+    ABVHStream* mStream;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,289 @@
+#include "aBVHParser.h"
+#include "aMappedFile.h"
+#include <cstring>
+#include <cmath>
+
+#pragma warning(disable : 4018)
+
+
+
+/****************************************************************
+*
+*    	    Tokenizer helpers
+*
+****************************************************************/
+
+static inline bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static const char* SkipSpace(const char* p, const char* end)
+{
+	while (p < end && IsSpace(*p)) p++;
+	return p;
+}
+
+// Reads the next whitespace separated token and returns true if it equals expected
+static bool ExpectToken(const char*& p, const char* end, const char* expected)
+{
+	p = SkipSpace(p, end);
+	const char* begin = p;
+	while (p < end && !IsSpace(*p)) p++;
+	size_t length = strlen(expected);
+	return (size_t)(p - begin) == length && strncmp(begin, expected, length) == 0;
+}
+
+static std::string NextToken(const char*& p, const char* end)
+{
+	p = SkipSpace(p, end);
+	const char* begin = p;
+	while (p < end && !IsSpace(*p)) p++;
+	return std::string(begin, p);
+}
+
+// Reads the remainder of the current line without leading and trailing whitespace
+static std::string RestOfLine(const char*& p, const char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t')) p++;
+	const char* begin = p;
+	while (p < end && *p != '\n') p++;
+	const char* last = p;
+	while (last > begin && IsSpace(last[-1])) last--;
+	return std::string(begin, last);
+}
+
+static const double gPow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+static inline double Pow10(int exponent)
+{
+	return exponent <= 22 ? gPow10[exponent] : pow(10.0, exponent);
+}
+
+
+
+/****************************************************************
+*
+*    	    BVH data functions
+*
+****************************************************************/
+
+ABVHData::ABVHData() : numChannels(0), numFrames(0), dt(0.0), motionOffset(0)
+{
+}
+
+void ABVHData::clear()
+{
+	joints.clear();
+	values.clear();
+	numChannels = 0;
+	numFrames = 0;
+	dt = 0.0;
+	motionOffset = 0;
+}
+
+
+
+/****************************************************************
+*
+*    	    BVH parser functions
+*
+****************************************************************/
+
+static const char* ParseNumber(const char* p, const char* end, double& value)
+{
+	p = SkipSpace(p, end);
+	if (p == end) return NULL;
+
+	bool negative = false;
+	if (*p == '-' || *p == '+')
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	// accumulate up to 18 significant digits in an integer, then scale once by a power of ten
+	const unsigned long long maxMantissa = 100000000000000000ULL;
+	unsigned long long mantissa = 0;
+	int exponent = 0;
+	bool hasDigits = false;
+	for (; p < end && IsDigit(*p); p++)
+	{
+		if (mantissa < maxMantissa) mantissa = mantissa * 10 + (*p - '0');
+		else exponent++;
+		hasDigits = true;
+	}
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && IsDigit(*p); p++)
+		{
+			if (mantissa < maxMantissa)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				exponent--;
+			}
+			hasDigits = true;
+		}
+	}
+	if (!hasDigits) return NULL;
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negativeExponent = *p == '-';
+			p++;
+		}
+		if (p == end || !IsDigit(*p)) return NULL;
+		int e = 0;
+		for (; p < end && IsDigit(*p); p++)
+		{
+			if (e < 10000) e = e * 10 + (*p - '0');
+		}
+		exponent += negativeExponent ? -e : e;
+	}
+	if (p < end && !IsSpace(*p)) return NULL;
+
+	double result = (double)mantissa;
+	if (exponent < 0) result /= Pow10(-exponent);
+	else if (exponent > 0) result *= Pow10(exponent);
+	value = negative ? -result : result;
+	return p;
+}
+
+const char* ABVHParser::ParseFloat(const char* p, const char* end, float& value)
+{
+	double number;
+	p = ParseNumber(p, end, number);
+	if (p) value = (float)number;
+	return p;
+}
+
+const char* ABVHParser::ParseFrames(const char* p, const char* end, int numChannels, int numFrames, float* out)
+{
+	int numValues = numChannels * numFrames;
+	for (int i = 0; i < numValues; i++)
+	{
+		p = ParseFloat(p, end, out[i]);
+		if (!p) return NULL;
+	}
+	return p;
+}
+
+static bool ParseJoint(const char*& p, const char* end, int parent, bool isEndSite, ABVHData& data)
+{
+	ABVHJoint joint;
+	joint.name = RestOfLine(p, end);
+	if (isEndSite && joint.name.find("Site") != std::string::npos)
+	{
+		joint.name = data.joints[parent].name + "Site";
+	}
+	joint.parent = parent;
+	joint.numChannels = 0;
+	joint.firstChannel = data.numChannels;
+
+	if (!ExpectToken(p, end, "{") || !ExpectToken(p, end, "OFFSET")) return false;
+	float offset[3];
+	for (int i = 0; i < 3; i++)
+	{
+		p = ABVHParser::ParseFloat(p, end, offset[i]);
+		if (!p) return false;
+	}
+	joint.offset = vec3(offset[0], offset[1], offset[2]);
+
+	if (!isEndSite)
+	{
+		double count;
+		if (!ExpectToken(p, end, "CHANNELS")) return false;
+		p = ParseNumber(p, end, count);
+		if (!p) return false;
+		joint.numChannels = (int)count;
+		joint.channels = RestOfLine(p, end);
+		data.numChannels += joint.numChannels;
+	}
+
+	int id = data.joints.size();
+	data.joints.push_back(joint);
+
+	while (true)
+	{
+		std::string token = NextToken(p, end);
+		if (token == "}") return true;
+		else if (token == "JOINT" && !isEndSite)
+		{
+			if (!ParseJoint(p, end, id, false, data)) return false;
+		}
+		else if (token == "End" && !isEndSite)
+		{
+			if (!ParseJoint(p, end, id, true, data)) return false;
+		}
+		else return false;
+	}
+}
+
+bool ABVHParser::Parse(const char* text, size_t size, ABVHData& data, bool loadFrames)
+{
+	data.clear();
+	const char* p = text;
+	const char* end = text + size;
+
+	if (!ExpectToken(p, end, "HIERARCHY")) return false;
+	std::string token = NextToken(p, end);
+	if (token != "ROOT" && token != "JOINT") return false;
+	if (!ParseJoint(p, end, -1, false, data)) return false;
+
+	double value;
+	if (!ExpectToken(p, end, "MOTION") || !ExpectToken(p, end, "Frames:")) return false;
+	p = ParseNumber(p, end, value);
+	if (!p || value < 0) return false;
+	data.numFrames = (int)value;
+	if (!ExpectToken(p, end, "Frame") || !ExpectToken(p, end, "Time:")) return false;
+	p = ParseNumber(p, end, value);
+	if (!p || value <= 0) return false;
+	data.dt = value;
+	data.motionOffset = p - text;
+	if (!loadFrames) return true;
+
+	// parse a frame at a time and scatter it into the per-channel arrays
+	data.values.resize((size_t)data.numChannels * data.numFrames);
+	std::vector<float> frame(data.numChannels);
+	int numFrames = 0;
+	for (; numFrames < data.numFrames; numFrames++)
+	{
+		const char* next = ParseFrames(p, end, data.numChannels, 1, frame.data());
+		if (!next) break;
+		p = next;
+		for (int c = 0; c < data.numChannels; c++)
+		{
+			data.values[(size_t)c * data.numFrames + numFrames] = frame[c];
+		}
+	}
+
+	if (numFrames < data.numFrames)
+	{
+		// truncated file: keep the complete frames
+		for (int c = 0; c < data.numChannels; c++)
+		{
+			memmove(&data.values[(size_t)c * numFrames], &data.values[(size_t)c * data.numFrames], numFrames * sizeof(float));
+		}
+		data.numFrames = numFrames;
+		data.values.resize((size_t)data.numChannels * numFrames);
+	}
+	return true;
+}
+
+bool ABVHParser::Load(const std::string& filename, ABVHData& data, bool loadFrames)
+{
+	AMappedFile file;
+	if (!file.open(filename)) return false;
+	return Parse(file.data(), file.size(), data, loadFrames);
+}
@@ -0,0 +1,53 @@
+#ifndef ABVHPARSER_H_
+#define ABVHPARSER_H_
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "aVector.h"
+
+// Joint as described in the HIERARCHY section of a BVH file, in file (= joint ID) order
+struct ABVHJoint
+{
+	std::string name;
+	int parent;              // -1 for the root
+	vec3 offset;
+	int numChannels;         // 6 for the root, 3 for joints, 0 for end sites
+	int firstChannel;        // index of the first channel of the joint within a frame
+	std::string channels;    // channel names, e.g. "Zrotation Xrotation Yrotation"
+};
+
+// Whole BVH clip in flat arrays. Values are stored per channel: channel c of frame f is at c * numFrames + f
+struct ABVHData
+{
+	ABVHData();
+	void clear();
+
+	const float* getChannel(int channel) const { return values.data() + (size_t)channel * numFrames; }
+
+	std::vector<ABVHJoint> joints;
+	int numChannels;         // channels per frame
+	int numFrames;
+	double dt;
+	size_t motionOffset;     // byte offset of the first frame in the file
+	std::vector<float> values;
+};
+
+// Single-pass BVH parser working on a memory-mapped file instead of std::ifstream extraction
+class ABVHParser
+{
+public:
+	// Maps and parses filename. With loadFrames false only the hierarchy and frame count are read
+	static bool Load(const std::string& filename, ABVHData& data, bool loadFrames = true);
+	static bool Parse(const char* text, size_t size, ABVHData& data, bool loadFrames = true);
+
+	// Parses numFrames frames of numChannels values starting at text into out, frame by frame.
+	// Returns the position after the last value or NULL if the text ends early or is malformed
+	static const char* ParseFrames(const char* text, const char* end, int numChannels, int numFrames, float* out);
+
+	// Locale-independent float parsing. Skips leading whitespace, returns the position after the number or NULL
+	static const char* ParseFloat(const char* text, const char* end, float& value);
+};
+
+#endif
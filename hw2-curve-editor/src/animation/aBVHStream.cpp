@@ -0,0 +1,233 @@
+#include "aBVHStream.h"
+#include <algorithm>
+#include <cstring>
+
+#pragma warning(disable : 4018)
+
+static inline bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Skips numValues whitespace separated values without converting them
+static const char* SkipValues(const char* p, const char* end, int numValues)
+{
+	for (int i = 0; i < numValues; i++)
+	{
+		while (p < end && IsSpace(*p)) p++;
+		if (p == end) return NULL;
+		while (p < end && !IsSpace(*p)) p++;
+	}
+	return p;
+}
+
+ABVHStream::ABVHStream() :
+	mWindowFrames(0), mHeadFrames(0), mStart(0), mEnd(0), mPlayhead(0), mNumFrames(0), mQuit(false),
+	mReadPos(NULL), mReadFrame(0)
+{
+}
+
+ABVHStream::~ABVHStream()
+{
+	close();
+}
+
+bool ABVHStream::open(const std::string& filename, int windowFrames)
+{
+	close();
+	if (!mFile.open(filename)) return false;
+	if (!ABVHParser::Parse(mFile.data(), mFile.size(), mHeader, false) || mHeader.numChannels == 0)
+	{
+		close();
+		return false;
+	}
+
+	int numChannels = mHeader.numChannels;
+	mWindowFrames = std::max(windowFrames, 2 * BatchFrames);
+	mNumFrames = mHeader.numFrames;
+	mReadPos = mFile.data() + mHeader.motionOffset;
+	mReadFrame = 0;
+	mIndex.push_back(mReadPos);
+
+	// the head is decoded up front on this thread, before the reader starts
+	mHeadFrames = std::min(mNumFrames, mWindowFrames / 4);
+	mHead.resize((size_t)mHeadFrames * numChannels);
+	int decoded = decodeFrames(0, mHeadFrames, mHead.data());
+	if (decoded < mHeadFrames)
+	{
+		mNumFrames = mHeadFrames = decoded;
+	}
+
+	mRing.resize((size_t)mWindowFrames * numChannels);
+	mStart = mEnd = mHeadFrames;
+	mPlayhead = 0;
+	mQuit = false;
+	mReader = std::thread(&ABVHStream::readerLoop, this);
+	return true;
+}
+
+void ABVHStream::close()
+{
+	if (mReader.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQuit = true;
+		}
+		mWake.notify_one();
+		mReader.join();
+	}
+
+	mFile.close();
+	mHeader.clear();
+	mHead.clear();
+	mRing.clear();
+	mIndex.clear();
+	mWindowFrames = mHeadFrames = 0;
+	mStart = mEnd = mPlayhead = mNumFrames = 0;
+	mQuit = false;
+	mReadPos = NULL;
+	mReadFrame = 0;
+}
+
+int ABVHStream::getNumFrames()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mNumFrames;
+}
+
+void ABVHStream::getWindow(int& start, int& end)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	start = mStart;
+	end = mEnd;
+}
+
+bool ABVHStream::getFrame(int frame, float* out)
+{
+	size_t numChannels = mHeader.numChannels;
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (frame < 0 || frame >= mNumFrames) return false;
+
+	mPlayhead = frame;
+	bool available = true;
+	if (frame < mHeadFrames)
+	{
+		memcpy(out, &mHead[frame * numChannels], numChannels * sizeof(float));
+	}
+	else if (frame >= mStart && frame < mEnd)
+	{
+		memcpy(out, &mRing[(frame % mWindowFrames) * numChannels], numChannels * sizeof(float));
+	}
+	else available = false;
+
+	if (needsWork()) mWake.notify_one();
+	return available;
+}
+
+void ABVHStream::seek(int frame)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mPlayhead = frame;
+	if (needsWork()) mWake.notify_one();
+}
+
+int ABVHStream::getWindowTarget() const
+{
+	// frames before mHeadFrames are always resident, so the window never goes below it
+	return std::max(mHeadFrames, mPlayhead - mWindowFrames / 4);
+}
+
+bool ABVHStream::needsWork() const
+{
+	int playhead = std::max(mPlayhead, mHeadFrames);
+	if (playhead >= mNumFrames) return false;
+	if (playhead < mStart || getWindowTarget() > mEnd) return true;
+	return mEnd < std::min(mNumFrames, playhead + mWindowFrames * 3 / 4);
+}
+
+void ABVHStream::readerLoop()
+{
+	size_t numChannels = mHeader.numChannels;
+	std::vector<float> batch(BatchFrames * numChannels);
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true)
+	{
+		mWake.wait(lock, [this] { return mQuit || needsWork(); });
+		if (mQuit) break;
+
+		int playhead = std::max(mPlayhead, mHeadFrames);
+		if (playhead < mStart || getWindowTarget() > mEnd)
+		{
+			// seek outside the window: restart it a little behind the playhead
+			mStart = mEnd = getWindowTarget();
+		}
+		int first = mEnd;
+		int count = std::min<int>(BatchFrames, std::min(mNumFrames, playhead + mWindowFrames * 3 / 4) - first);
+		if (count <= 0) continue;
+
+		// parse without holding the lock; only this thread moves mStart and mEnd
+		lock.unlock();
+		int decoded = decodeFrames(first, count, batch.data());
+		lock.lock();
+
+		if (decoded < count) mNumFrames = first + decoded; // truncated file
+		for (int i = 0; i < decoded; i++)
+		{
+			memcpy(&mRing[((first + i) % mWindowFrames) * numChannels], &batch[i * numChannels], numChannels * sizeof(float));
+		}
+		mEnd = first + decoded;
+		mStart = std::max(mStart, mEnd - mWindowFrames);
+	}
+}
+
+const char* ABVHStream::findFrame(int frame)
+{
+	if (frame == mReadFrame) return mReadPos;
+
+	// start from the closest known position before frame and skip forward, extending the index on the way
+	int k = std::min<int>(frame / IndexStep, mIndex.size() - 1);
+	int f = k * IndexStep;
+	const char* p = mIndex[k];
+	if (mReadFrame > f && mReadFrame < frame)
+	{
+		f = mReadFrame;
+		p = mReadPos;
+	}
+
+	const char* end = mFile.data() + mFile.size();
+	for (; f < frame && p; f++)
+	{
+		p = SkipValues(p, end, mHeader.numChannels);
+		if (p && (f + 1) % IndexStep == 0 && (f + 1) / IndexStep == mIndex.size()) mIndex.push_back(p);
+	}
+	if (p)
+	{
+		mReadPos = p;
+		mReadFrame = frame;
+	}
+	return p;
+}
+
+int ABVHStream::decodeFrames(int frame, int count, float* out)
+{
+	const char* p = findFrame(frame);
+	if (!p) return 0;
+
+	const char* end = mFile.data() + mFile.size();
+	int numChannels = mHeader.numChannels;
+	int decoded = 0;
+	for (; decoded < count; decoded++)
+	{
+		const char* next = ABVHParser::ParseFrames(p, end, numChannels, 1, out + (size_t)decoded * numChannels);
+		if (!next) break;
+		p = next;
+
+		int f = frame + decoded + 1;
+		if (f % IndexStep == 0 && f / IndexStep == mIndex.size()) mIndex.push_back(p);
+	}
+	mReadPos = p;
+	mReadFrame = frame + decoded;
+	return decoded;
+}
@@ -0,0 +1,77 @@
+#ifndef ABVHSTREAM_H_
+#define ABVHSTREAM_H_
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "aMappedFile.h"
+#include "aBVHParser.h"
+
+// Streams the frames of a BVH file that is too long to decode up front.
+// Only a window of frames around the playhead is kept decoded; a background thread parses ahead of the
+// playhead and restarts the window after a seek. The first frames stay resident so looping never stalls.
+class ABVHStream
+{
+public:
+	ABVHStream();
+	virtual ~ABVHStream();
+
+	// Maps filename, reads the hierarchy and the first frames, then starts the reader thread
+	bool open(const std::string& filename, int windowFrames = 1024);
+	void close();
+	bool isOpen() const { return mFile.isOpen(); }
+
+	// hierarchy, channel layout and frame time; the frame values are not loaded
+	const ABVHData& getHeader() const { return mHeader; }
+	int getNumFrames();
+
+	// Copies the channels of frame into out (numChannels floats) if the frame is decoded and moves the
+	// playhead there. Never waits for the reader: returns false if the frame is not available yet
+	bool getFrame(int frame, float* out);
+
+	// Moves the playhead so the reader starts decoding around frame
+	void seek(int frame);
+
+	// decoded frames [start, end) of the sliding window
+	void getWindow(int& start, int& end);
+
+protected:
+	static const int IndexStep = 64;   // frames between entries of the text position index
+	static const int BatchFrames = 32; // frames decoded per lock of the window
+
+	int getWindowTarget() const; // first frame the window should hold for the current playhead
+	bool needsWork() const;
+	void readerLoop();
+	// text position of frame, from the index and the read cursor (reader thread only)
+	const char* findFrame(int frame);
+	// parses count frames starting at frame into out and returns how many were read (reader thread only)
+	int decodeFrames(int frame, int count, float* out);
+
+protected:
+	AMappedFile mFile;
+	ABVHData mHeader;
+	int mWindowFrames;
+	int mHeadFrames;
+	std::vector<float> mHead;       // frames [0, mHeadFrames), read only after open
+
+	// shared with the reader, guarded by mMutex
+	std::vector<float> mRing;       // frame f lives in slot f % mWindowFrames
+	int mStart, mEnd;
+	int mPlayhead;
+	int mNumFrames;                 // lowered if the file turns out to be truncated
+	bool mQuit;
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::thread mReader;
+
+	// reader thread only
+	std::vector<const char*> mIndex; // text position of frame k * IndexStep
+	const char* mReadPos;            // text position of frame mReadFrame
+	int mReadFrame;
+};
+
+#endif
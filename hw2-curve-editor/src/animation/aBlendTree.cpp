@@ -0,0 +1,253 @@
+#include "aBlendTree.h"
+#include <algorithm>
+
+#pragma warning(disable : 4018)
+
+ABlendTree::ABlendTree() : mRoot(-1), mNumJoints(0), mNumActiveNodes(0), mDirty(true), mLastTime(0.0)
+{
+}
+
+ABlendTree::~ABlendTree()
+{
+}
+
+void ABlendTree::clear()
+{
+	mNodes.clear();
+	mRoot = -1;
+	mNumJoints = 0;
+	mNumActiveNodes = 0;
+	mDirty = true;
+}
+
+int ABlendTree::addNode(NodeType type)
+{
+	Node node;
+	node.type = type;
+	node.childA = -1;
+	node.childB = -1;
+	node.clip = NULL;
+	node.speed = 1.0;
+	node.offset = 0.0;
+	node.weight = 0.0f;
+	node.fadeStartWeight = 0.0f;
+	node.fadeTargetWeight = 0.0f;
+	node.fadeStartTime = 0.0;
+	node.fadeDuration = 0.0;
+	node.hasMask = false;
+	node.referenceTime = 0.0;
+	node.referenceValid = false;
+	mNodes.push_back(node);
+	mDirty = true;
+
+	// the first node added becomes the root until setRoot is called
+	if (mRoot < 0) mRoot = 0;
+	return mNodes.size() - 1;
+}
+
+int ABlendTree::addClip(const BVHController* clip, double speed, double offset)
+{
+	assert(clip);
+	int id = addNode(CLIP);
+	mNodes[id].clip = clip;
+	mNodes[id].speed = speed;
+	mNodes[id].offset = offset;
+	return id;
+}
+
+int ABlendTree::addBlend(int nodeA, int nodeB, float weight)
+{
+	assert(nodeA >= 0 && nodeA < mNodes.size() && nodeB >= 0 && nodeB < mNodes.size());
+	int id = addNode(BLEND);
+	mNodes[id].childA = nodeA;
+	mNodes[id].childB = nodeB;
+	setWeight(id, weight);
+	return id;
+}
+
+int ABlendTree::addAdditive(int baseNode, int additiveNode, float weight, double referenceTime)
+{
+	assert(baseNode >= 0 && baseNode < mNodes.size() && additiveNode >= 0 && additiveNode < mNodes.size());
+	int id = addNode(ADDITIVE);
+	mNodes[id].childA = baseNode;
+	mNodes[id].childB = additiveNode;
+	mNodes[id].referenceTime = referenceTime;
+	setWeight(id, weight);
+	return id;
+}
+
+void ABlendTree::setRoot(int nodeID)
+{
+	assert(nodeID >= 0 && nodeID < mNodes.size());
+	mRoot = nodeID;
+	mDirty = true;
+}
+
+ABlendTree::NodeType ABlendTree::getNodeType(int nodeID) const
+{
+	assert(nodeID >= 0 && nodeID < mNodes.size());
+	return mNodes[nodeID].type;
+}
+
+void ABlendTree::setWeight(int nodeID, float weight)
+{
+	assert(nodeID >= 0 && nodeID < mNodes.size());
+	Node& node = mNodes[nodeID];
+	node.weight = weight;
+	node.fadeStartWeight = weight;
+	node.fadeTargetWeight = weight;
+	node.fadeDuration = 0.0;
+	mDirty = true;
+}
+
+float ABlendTree::getWeight(int nodeID, double time) const
+{
+	assert(nodeID >= 0 && nodeID < mNodes.size());
+	const Node& node = mNodes[nodeID];
+	if (node.fadeDuration <= 0.0) return node.weight;
+
+	double u = (time - node.fadeStartTime) / node.fadeDuration;
+	u = std::min<double>(1.0, std::max<double>(0.0, u));
+	return (float)(node.fadeStartWeight + u * (node.fadeTargetWeight - node.fadeStartWeight));
+}
+
+void ABlendTree::crossfade(int nodeID, float targetWeight, double duration, double startTime)
+{
+	assert(nodeID >= 0 && nodeID < mNodes.size());
+	Node& node = mNodes[nodeID];
+	node.fadeStartWeight = getWeight(nodeID, startTime);
+	node.fadeTargetWeight = targetWeight;
+	node.fadeStartTime = startTime;
+	node.fadeDuration = duration;
+	node.weight = duration > 0.0 ? node.fadeStartWeight : targetWeight;
+	mDirty = true;
+}
+
+void ABlendTree::setMask(int nodeID, const AJointMask& mask)
+{
+	assert(nodeID >= 0 && nodeID < mNodes.size());
+	mNodes[nodeID].mask = mask;
+	mNodes[nodeID].hasMask = true;
+	mDirty = true;
+}
+
+void ABlendTree::clearMask(int nodeID)
+{
+	assert(nodeID >= 0 && nodeID < mNodes.size());
+	mNodes[nodeID].hasMask = false;
+	mDirty = true;
+}
+
+void ABlendTree::setClipSpeed(int nodeID, double speed, double offset)
+{
+	assert(nodeID >= 0 && nodeID < mNodes.size() && mNodes[nodeID].type == CLIP);
+	mNodes[nodeID].speed = speed;
+	mNodes[nodeID].offset = offset;
+	invalidateReferences();
+	mDirty = true;
+}
+
+void ABlendTree::invalidateReferences()
+{
+	for (unsigned int i = 0; i < mNodes.size(); i++)
+	{
+		mNodes[i].referenceValid = false;
+	}
+}
+
+int ABlendTree::getNumJoints() const
+{
+	for (unsigned int i = 0; i < mNodes.size(); i++)
+	{
+		if (mNodes[i].type == CLIP)
+		{
+			return mNodes[i].clip->getSkeleton()->getNumJoints();
+		}
+	}
+	return 0;
+}
+
+const APose& ABlendTree::evaluate(double time)
+{
+	if (!mDirty && time == mLastTime) return mPose;
+
+	int numJoints = getNumJoints();
+	if (numJoints != mNumJoints)
+	{
+		// (re)allocate every buffer once so evaluation itself never allocates
+		mNumJoints = numJoints;
+		mPose.resize(numJoints);
+		for (unsigned int i = 0; i < mNodes.size(); i++)
+		{
+			mNodes[i].scratch.resize(numJoints);
+			mNodes[i].referenceValid = false;
+		}
+	}
+
+	mNumActiveNodes = 0;
+	if (mRoot >= 0 && mNumJoints > 0)
+	{
+		evaluateNode(mRoot, time, mPose);
+	}
+
+	mLastTime = time;
+	mDirty = false;
+	for (unsigned int i = 0; i < mNodes.size(); i++)
+	{
+		// keep evaluating every frame while a crossfade is still running
+		const Node& node = mNodes[i];
+		if (node.fadeDuration > 0.0 && time < node.fadeStartTime + node.fadeDuration) mDirty = true;
+	}
+	return mPose;
+}
+
+void ABlendTree::evaluateNode(int nodeID, double time, APose& out)
+{
+	Node& node = mNodes[nodeID];
+	mNumActiveNodes++;
+
+	switch (node.type)
+	{
+	case CLIP:
+		node.clip->samplePose(time * node.speed + node.offset, out);
+		break;
+
+	case BLEND:
+	{
+		float w = getWeight(nodeID, time);
+		const AJointMask* mask = node.hasMask ? &node.mask : NULL;
+		if (w <= 0.0f)
+		{
+			evaluateNode(node.childA, time, out);
+		}
+		else if (w >= 1.0f && !mask)
+		{
+			evaluateNode(node.childB, time, out);
+		}
+		else
+		{
+			evaluateNode(node.childA, time, out);
+			evaluateNode(node.childB, time, node.scratch);
+			APose::Blend(out, node.scratch, std::min(w, 1.0f), mask, out);
+		}
+		break;
+	}
+
+	case ADDITIVE:
+	{
+		float w = getWeight(nodeID, time);
+		evaluateNode(node.childA, time, out);
+		if (w <= 0.0f) break;
+
+		if (!node.referenceValid)
+		{
+			if (node.reference.getNumJoints() != mNumJoints) node.reference.resize(mNumJoints);
+			evaluateNode(node.childB, node.referenceTime, node.reference);
+			node.referenceValid = true;
+		}
+		evaluateNode(node.childB, time, node.scratch);
+		APose::Additive(out, node.scratch, node.reference, w, node.hasMask ? &node.mask : NULL, out);
+		break;
+	}
+	}
+}
@@ -0,0 +1,94 @@
+#ifndef ABLENDTREE_H_
+#define ABLENDTREE_H_
+
+#pragma once
+
+#include <vector>
+#include "aPose.h"
+#include "aBVHController.h"
+
+// Blend tree over several BVH clips (crossfades, additive layers and per-joint masks).
+// Nodes live in a flat array and are referenced by index. All clips must share the same skeleton layout.
+// evaluate() runs once per frame per character and only visits nodes that contribute to the result.
+class ABlendTree
+{
+public:
+	enum NodeType { CLIP, BLEND, ADDITIVE };
+
+	ABlendTree();
+	virtual ~ABlendTree();
+
+	void clear();
+
+	// clip time = time * speed + offset
+	int addClip(const BVHController* clip, double speed = 1.0, double offset = 0.0);
+	// weight 0 gives nodeA, weight 1 gives nodeB
+	int addBlend(int nodeA, int nodeB, float weight = 0.0f);
+	// the additive node is applied relative to its own pose at referenceTime
+	int addAdditive(int baseNode, int additiveNode, float weight = 1.0f, double referenceTime = 0.0);
+
+	void setRoot(int nodeID);
+	int getRoot() const { return mRoot; }
+	int getNumNodes() const { return mNodes.size(); }
+	NodeType getNodeType(int nodeID) const;
+
+	void setWeight(int nodeID, float weight);
+	float getWeight(int nodeID, double time) const;
+	// ramps the node weight from its current value to targetWeight over duration seconds, starting at startTime
+	void crossfade(int nodeID, float targetWeight, double duration, double startTime);
+
+	void setMask(int nodeID, const AJointMask& mask);
+	void clearMask(int nodeID);
+
+	void setClipSpeed(int nodeID, double speed, double offset = 0.0);
+
+	const APose& evaluate(double time);
+	const APose& getPose() const { return mPose; }
+	int getNumActiveNodes() const { return mNumActiveNodes; } // nodes visited by the last evaluate
+
+protected:
+	struct Node
+	{
+		NodeType type;
+		int childA;
+		int childB;
+
+		// CLIP
+		const BVHController* clip;
+		double speed;
+		double offset;
+
+		// BLEND / ADDITIVE weight, optionally ramped by crossfade()
+		float weight;
+		float fadeStartWeight;
+		float fadeTargetWeight;
+		double fadeStartTime;
+		double fadeDuration;
+
+		bool hasMask;
+		AJointMask mask;
+
+		// ADDITIVE reference pose, sampled lazily from childB
+		double referenceTime;
+		bool referenceValid;
+		APose reference;
+
+		APose scratch;
+	};
+
+	int addNode(NodeType type);
+	void evaluateNode(int nodeID, double time, APose& out);
+	void invalidateReferences();
+	int getNumJoints() const;
+
+protected:
+	std::vector<Node> mNodes;
+	int mRoot;
+	int mNumJoints;
+	int mNumActiveNodes;
+	bool mDirty;
+	double mLastTime;
+	APose mPose;
+};
+
+#endif
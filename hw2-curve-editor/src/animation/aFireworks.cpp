@@ -3,6 +3,7 @@
 //////////////////////////////////////////////////////////////////////
 
 #include "aFireworks.h"
+#include "aForceField.h"
 #include <stdlib.h>
 #include <math.h>
 #include <iostream>
@@ -16,39 +17,46 @@
 #define GRAVITY 9.8f
 #endif
 
+// External force parameters
+static const float DragCoefficient = 2.0f;       // force per unit velocity
+static const float AttractorStrength = 1.0e5f;   // acceleration * squared distance
+static const float RepellerStrength = 1.0e5f;
+static const float RandomAcceleration = 20.0f;   // max per axis
+
+// Random streams of a step: the explosions of every rocket and the random force of each particle array
+enum { ExplosionStream, SparkForceStream, RocketForceStream };
+
+static unsigned long long StreamId(unsigned int step, int index, int stream)
+{
+	return ((unsigned long long)step << 32) ^ ((unsigned long long)index << 2) ^ (unsigned long long)stream;
+}
+
 //////////////////////////////////////////////////////////////////////
 // Construction/Destruction
 //////////////////////////////////////////////////////////////////////
 
-AFireworks::AFireworks()
+AFireworks::AFireworks() : m_sparkInteraction(5.0f, 200.0f, 2.0f), m_sparkGrid(5.0f)
 {
     m_deltaT = 0.033f;
+	m_integratorType = EULER;
+	m_threadPool = NULL;
+	m_stepCount = 0;
 	m_rocketMass = 50.0;
 	m_sparkMass = 20.0;
+	m_COR = 0.25f;
+	m_friction = 0.1f;
+	m_Vexplode = 50.0f;
 
 	m_attractorPos = vec3(0.0, 500.0, 0.0);
 	m_repellerPos = vec3(0.0, 500.0, 0.0);
 	m_windForce = vec3(250.0, 0.0, 0.0);
 
+	rockets.setCapacity(MAXROCKETS);
+	sparks.setCapacity(MAXSPARKPARTICLES);
 }
 
 AFireworks::~AFireworks()
 {
-
-	for (unsigned int i = 0; i < sparks.size(); i++)
-	{
-		ASpark* pSpark = sparks[i];
-		delete pSpark;
-	}
-	for (unsigned int i = 0; i < rockets.size(); i++)
-	{
-		ARocket* pRocket = rockets[i];
-		delete pRocket;
-	}
-
-	rockets.clear();
-	sparks.clear();
-
 }
 
 int AFireworks::getNumParticles()
@@ -62,22 +70,19 @@ int AFireworks::getNumParticles()
  *			vec3 vel. launch velocity of the rocket.
  *			vec3 color. color[0], color[1] and color[2] are the RGB color of this rocket.
  *
- *  In this function, you want to generate a ARocket object and add it to the rockets vector
+ *  In this function, you want to add a flying rocket to the rockets array
  */
 void AFireworks::fireRocket(vec3 pos, vec3 vel, vec3 color)
 {
-	ARocket *newRocket = new ARocket(color);
-
-	// Need to compute and set values for initial state of rocket  (including time to live)
-	float stateVals[12] = { 0.0 };
-
-	//TODO: Add your code here
-
-	newRocket->setState(stateVals);
-	newRocket->setAttractor(m_attractorPos);
-	newRocket->setRepeller(m_repellerPos);
-	newRocket->setWind(m_windForce);
-	rockets.push_back(newRocket);
+	int index = rockets.add();
+	if (index < 0) return;
+	rockets.setPosition(index, pos);
+	rockets.setVelocity(index, vel);
+	rockets.set(AParticleArray::MASS, index, m_rocketMass);
+	rockets.setLifeSpan(index, ROCKET_LIFESPAN);
+	rockets.setStartColor(index, color);
+	rockets.setEndColor(index, color);
+	rockets.getTags()[index] = -1;
 }
 
 
@@ -87,8 +92,8 @@ void AFireworks::fireRocket(vec3 pos, vec3 vel, vec3 color)
  *		   vec3 vel. velocity where a ring of sparks are generated.
  *		   vec3 color. color[0], color[1] and color[2] are the RGB color of the rocket. It will also be the color of the sparks it generate.                       
  *  In this function, you want to generate a number of sparks that are uniformily distributed on a ring at [posx, posy, posz]
- *  then append them to the sparks vector using a push_back function call.
- *  The initial state vector for each spark should accommodate the constraints below:
+ *  then append them to the sparks array.
+ *  The initial state of each spark should accommodate the constraints below:
  *   They should be evenly distribute on a ring on the local XOY plane of the rocket.
  *  
  *  At the time of the explosion:
@@ -101,22 +106,73 @@ void AFireworks::fireRocket(vec3 pos, vec3 vel, vec3 color)
  */
 void AFireworks::explode(vec3 pos, vec3 vel, vec3 color)
 {
-	float stateVals[12] = { 0.0 };
-	int sparkNumber = MAXSPARKS;
-	float velocity = MAXVELOCITY;
+	explode(pos, vel, color, m_random);
+}
+
+void AFireworks::explode(vec3 pos, vec3 vel, vec3 color, ARandom& random)
+{
+	int sparkNumber = random.nextInt(10, 60);
+	float velocity = random.nextFloat(20.0f, 40.0f);
+
+	for (int i = 0; i < sparkNumber && !sparks.isFull(); i++)
+	{
+		float angle = 360.0f * RAD * i / sparkNumber;
+		int index = sparks.add();
+		sparks.setPosition(index, pos);
+		sparks.setVelocity(index, vel + vec3(velocity * cos(angle), velocity * sin(angle), 0.0));
+		sparks.set(AParticleArray::MASS, index, m_sparkMass);
+		sparks.setLifeSpan(index, SPARK_LIFESPAN);
+		sparks.setStartColor(index, color);
+		sparks.setEndColor(index, color);
+	}
+}
+
+void AFireworks::computeForces(AParticleArray& particles, int extForceMode, const ARandom& random, int begin, int end)
+{
+	// gravity force
+	particles.clearForces(begin, end);
+	particles.addGravity(vec3(0.0, -GRAVITY, 0.0), begin, end);
+
+	// the switchable forces are fields too, built on the stack for the call
+	if (extForceMode & WIND_ACTIVE)
+	{
+		AWindField(m_windForce).apply(particles, begin, end);
+	}
+	if (extForceMode & DRAG_ACTIVE)
+	{
+		ADragField(DragCoefficient).apply(particles, begin, end);
+	}
+	if (extForceMode & ATTRACTOR_ACTIVE)
+	{
+		APointField(m_attractorPos, AttractorStrength).apply(particles, begin, end);
+	}
+	if (extForceMode & REPELLER_ACTIVE)
+	{
+		APointField(m_repellerPos, -RepellerStrength).apply(particles, begin, end);
+	}
+	if (extForceMode & FORCEFIELDS_ACTIVE)
+	{
+		m_forceFields.apply(particles, begin, end);
+	}
+	if ((extForceMode & INTERACTIONS_ACTIVE) && &particles == &sparks)
+	{
+		m_sparkInteraction.apply(particles, begin, end);
+	}
 
-	// TODO: Add your code here to randomize the number of sparks and their initial velocity
-	// The mass of the rocket is 50.0, it Explodes for 5 deltaT
-	for (int i = 0; i < sparkNumber; i++)
+	// random force, drawn at counters given by the particle index so every force evaluation of a step sees the
+	// same force
+	if (extForceMode & RANDOM_ACTIVE)
 	{
-		ASpark* newSpark = new ASpark(color);
-		// TODO: Add your code here
-
-		newSpark->setState(stateVals);
-		newSpark->setAttractor(m_attractorPos);
-		newSpark->setRepeller(m_repellerPos);
-		newSpark->setWind(m_windForce);
-		sparks.push_back(newSpark);
+		const float* mass = particles.getChannel(AParticleArray::MASS);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float* force = particles.getChannel((AParticleArray::Channel)(AParticleArray::FX + axis));
+			unsigned long long counter = (unsigned long long)axis * particles.getCapacity();
+			for (int i = begin; i < end; i++)
+			{
+				force[i] += mass[i] * random.getFloat(counter + i, -RandomAcceleration, RandomAcceleration);
+			}
+		}
 	}
 }
 
@@ -124,44 +180,98 @@ void AFireworks::explode(vec3 pos, vec3 vel, vec3 color)
 // One simulation step 
 void AFireworks::update(float deltaT, int extForceMode)
 {
-	//Step 1. Iterate through every ASpark in sparks. If the spark is dead(life is 0), erase it from sparks.
-	//        Code is given. It is also an example of erasing an element from a vector.
-	ASpark* pSpark;
-	int index = 0;
+	//Step 1. Remove the dead sparks from sparks.
 	m_deltaT = deltaT;
+	unsigned int step = m_stepCount++;
+	sparks.removeDead();
 
-	for (unsigned int i = 0; i < sparks.size(); i++)
+
+	//Step 2. Remove the dead rockets from rockets.
+	//        Every rocket in explosion mode generates a ring of sparks.
+	rockets.removeDead();
+	const int* countdown = rockets.getTags();
+	for (int i = 0; i < rockets.size(); i++)
 	{
-		pSpark = sparks[index];
-		if (!pSpark->m_alive)
+		if (countdown[i] > 0)
 		{
-			sparks.erase(sparks.begin() + index);
-			delete pSpark;
+			ARandom random = m_random.getStream(StreamId(step, i, ExplosionStream));
+			explode(rockets.getPosition(i), rockets.getVelocity(i), rockets.getStartColor(i), random);
 		}
-		else index++;
 	}
 
+	//Step 3. Integration steps for all sparks and rockets.
+	//        Sparks are independent, so they are stepped in batches spread over the thread pool.
+	int sparkForceMode = extForceMode & EXT_SPARKFORCES_ACTIVE ? extForceMode : 0;
+	int rocketForceMode = extForceMode & EXT_ROCKETFORCES_ACTIVE ? extForceMode : 0;
+	if (sparkForceMode & INTERACTIONS_ACTIVE)
+	{
+		// the neighbours and their forces come from the state before the step, so batches can run in any order
+		m_sparkGrid.setCellSize(m_sparkInteraction.mRadius);
+		m_sparkGrid.build(sparks, m_threadPool);
+		m_sparkInteraction.update(m_sparkGrid, sparks, m_threadPool);
+	}
+	ARandom sparkRandom = m_random.getStream(StreamId(step, 0, SparkForceStream));
+	sparks.forEachBatch(m_threadPool, [this, &sparkRandom, sparkForceMode](int, int begin, int end)
+	{
+		sparks.savePositions(begin, end);
+		stepParticles(sparks, sparkForceMode, sparkRandom, begin, end);
+		sparks.age(m_deltaT, begin, end);
+		m_obstacles.collide(sparks, m_COR, m_friction, begin, end);
 
-	//Step 2. Iterate through every ARocket in rockets. If the rocket is dead, erase it from rockets.
-	//        If the rockets is in explosion mode generate a ring of sparks.
-	
-	ARocket* pRocket;	
-	index = 0;
-
-	// TODO: Add you code here
-
-	//Step 3. Euler steps for valid sparks and rockets.
-	//        Code is given.
+		// sparks bounce off the ground
+		float* py = sparks.getChannel(AParticleArray::PY);
+		float* vy = sparks.getChannel(AParticleArray::VY);
+		for (int i = begin; i < end; i++)
+		{
+			if (py[i] < 0.0f && vy[i] < 0.0f) vy[i] = -m_COR * vy[i];
+		}
+	});
 
-	for (unsigned int i = 0; i < sparks.size(); i++)
+	// rockets are not aged: they die after their last explosion
+	int* explosionCount = rockets.getTags();
+	for (int i = 0; i < rockets.size(); i++)
 	{
-		ASpark* pSpark = sparks[i];
-		pSpark->update(m_deltaT, extForceMode);
+		if (explosionCount[i] > 0) explosionCount[i]--;
 	}
-	
-	for (unsigned int i = 0; i < rockets.size(); i++)
+	rockets.savePositions();
+	stepParticles(rockets, rocketForceMode, m_random.getStream(StreamId(step, 0, RocketForceStream)), 0, rockets.size());
+	m_obstacles.collide(rockets, 1.0f, 0.0f);
+
+	float* py = rockets.getChannel(AParticleArray::PY);
+	float* vy = rockets.getChannel(AParticleArray::VY);
+	for (int i = 0; i < rockets.size(); i++)
 	{
-		ARocket* pRocket = rockets[i];
-		pRocket->update(m_deltaT, extForceMode);
+		// resolve collisions with ground
+		if (py[i] <= 0 && vy[i] < 0)
+		{
+			vy[i] = -vy[i];
+		}
+
+		if (vy[i] < m_Vexplode && explosionCount[i] < 0)
+		{
+			explosionCount[i] = TOTALEXPLOSIONS;
+		}
+		else if (explosionCount[i] == 0)
+		{
+			rockets.kill(i);
+		}
 	}
-}
\ No newline at end of file
+}
+
+void AFireworks::stepParticles(AParticleArray& particles, int extForceMode, const ARandom& random, int begin, int end)
+{
+	// the force function only captures a pointer to this state, which std::function stores without allocating
+	struct State
+	{
+		AFireworks* fireworks;
+		int extForceMode;
+		const ARandom* random;
+	} state = { this, extForceMode, &random };
+	State* pState = &state;
+
+	computeForces(particles, extForceMode, random, begin, end);
+	particles.integrate(m_deltaT, m_integratorType, [pState](AParticleArray& p, int first, int last)
+	{
+		pState->fireworks->computeForces(p, pState->extForceMode, *pState->random, first, last);
+	}, begin, end);
+}
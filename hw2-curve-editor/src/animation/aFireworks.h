@@ -8,6 +8,11 @@
 #include <vector>
 #include "aRocket.h"
 #include "aSpark.h"
+#include "aParticleArray.h"
+#include "aForceField.h"
+#include "aObstacle.h"
+#include "aSpatialHash.h"
+#include "aRandom.h"
 
 using namespace std;
 
@@ -17,6 +22,10 @@ using namespace std;
 #define SPARK_LIFESPAN 10
 #define ROCKET_LIFESPAN 3
 
+// Pool sizes; rockets fired and sparks released past them are dropped
+#define MAXROCKETS 256
+#define MAXSPARKPARTICLES 65536
+
 
 class AFireworks  
 {
@@ -33,28 +42,72 @@ public:
 	//One step of the simulation
 	void update(float deltaT, int extForceMode);
 
-	//When a rocket reaches its top height, it explodes and calls this function to generate sparks
+	//When a rocket reaches its top height, it explodes and calls this function to generate sparks.
+	//The number and speed of the sparks are drawn from random, m_random by default
 	void explode(vec3 pos, vec3 vel, vec3 color);
+	void explode(vec3 pos, vec3 vel, vec3 color, ARandom& random);
 	
 	//When the space key is pressed, the update functions calls this function to generate a rocket
 	void fireRocket(vec3 pos, vec3 vel, vec3 color);
 	
 //Member variables:
-	//Vector containing pointers to ARocket. Rockets in this vector are either flying or generating sparks (FLYING, EXPLOSION, DEAD)
-	vector<ARocket*> rockets;
+	//Rockets, either flying or generating sparks. The color is in the start color channels and the tag is the
+	//explosion countdown: -1 while FLYING, > 0 during EXPLOSION, 0 once DEAD (the rocket is then killed)
+	AParticleArray rockets;
 	
-	//Vector containing pointers to ASpark.
-	vector<ASpark*> sparks;
+	//Sparks, colored by their start color channels
+	AParticleArray sparks;
 
-	//Delta time for a Euler step.
+	//Delta time for a simulation step.
 	float m_deltaT;
 
+	//INTEGRATORTYPE used to step sparks and rockets
+	int m_integratorType;
+
+	//Optional pool the spark batches are spread over, NULL to step them on the calling thread.
+	//The results are the same with any number of threads
+	AThreadPool* m_threadPool;
+
+	//Fields applied to the particles when FORCEFIELDS_ACTIVE is set, on top of the switchable forces
+	AForceFieldSet m_forceFields;
+
+	//Pressure and viscosity between neighbouring sparks when INTERACTIONS_ACTIVE is set, found with m_sparkGrid
+	AInteractionField m_sparkInteraction;
+	ASpatialHash m_sparkGrid;
+
+	//Solids the sparks and rockets bounce off, besides the ground
+	AObstacleSet m_obstacles;
+
+	//Random numbers of the show. Every step splits it into a stream per exploding rocket and one for the random
+	//force of each particle array, so a seed replays the same show with any number of threads
+	ARandom m_random;
+
 	vec3 m_attractorPos;  // location of attractor in world
 	vec3 m_repellerPos;   // location of repeller in world
 	vec3 m_windForce;
 
 	float m_rocketMass;
 	float m_sparkMass;
+
+	//Coefficient of restitution of sparks on the ground
+	float m_COR;
+
+	//Fraction of the tangential velocity sparks lose when they hit an obstacle
+	float m_friction;
+
+	//Min vertical velocity for a rocket to explode
+	float m_Vexplode;
+
+protected:
+	//Sets the force on the particles [begin, end) to gravity plus the external forces selected by extForceMode.
+	//The random force of a particle depends only on random and its index, so it is constant over a step
+	void computeForces(AParticleArray& particles, int extForceMode, const ARandom& random, int begin, int end);
+
+	//Integrates the particles [begin, end) over m_deltaT, with the random force drawn from random
+	void stepParticles(AParticleArray& particles, int extForceMode, const ARandom& random, int begin, int end);
+
+	//Simulation steps so far, part of the random stream ids
+	unsigned int m_stepCount;
 };
 
 #endif // !defined(FIREWORKS_H)
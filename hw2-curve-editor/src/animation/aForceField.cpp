@@ -0,0 +1,381 @@
+#include "aForceField.h"
+#include "aSpatialHash.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+#pragma warning(disable : 4018)
+
+// (1 - d2 / r2)^2 inside the radius, 0 outside: smooth at the radius so adaptive steps do not see a kink
+static float Falloff(float distance2, float invRadius2)
+{
+	float u = std::max(1.0f - distance2 * invRadius2, 0.0f);
+	return u * u;
+}
+
+// 1 inside the box, 0 outside
+static float Inside(const float boxMin[3], const float boxMax[3], float x, float y, float z)
+{
+	return x >= boxMin[0] && x <= boxMax[0] && y >= boxMin[1] && y <= boxMax[1] && z >= boxMin[2] && z <= boxMax[2] ? 1.0f : 0.0f;
+}
+
+AForceField::AForceField() : mEnabled(true), mBounded(false)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mMin[axis] = -FLT_MAX;
+		mMax[axis] = FLT_MAX;
+	}
+}
+
+AForceField::~AForceField()
+{
+}
+
+void AForceField::setBounds(const vec3& boxMin, const vec3& boxMax)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mMin[axis] = (float)boxMin[axis];
+		mMax[axis] = (float)boxMax[axis];
+	}
+	mBounded = true;
+}
+
+bool AForceField::overlaps(const float boxMin[3], const float boxMax[3]) const
+{
+	if (!mBounded) return true;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (boxMin[axis] > mMax[axis] || boxMax[axis] < mMin[axis]) return false;
+	}
+	return true;
+}
+
+/****************************************************************
+*
+*    	    APointField
+*
+****************************************************************/
+
+APointField::APointField(const vec3& center, float strength, float radius, float softening) :
+	mStrength(strength), mSoftening(softening), mRadius(radius)
+{
+	setCenter(center);
+}
+
+APointField::~APointField()
+{
+}
+
+void APointField::setCenter(const vec3& center)
+{
+	mCenter = center;
+	if (mRadius > 0.0f) setBounds(center - vec3(mRadius, mRadius, mRadius), center + vec3(mRadius, mRadius, mRadius));
+}
+
+void APointField::apply(AParticleArray& particles, int begin, int end) const
+{
+	const float* px = particles.getChannel(AParticleArray::PX);
+	const float* py = particles.getChannel(AParticleArray::PY);
+	const float* pz = particles.getChannel(AParticleArray::PZ);
+	float* fx = particles.getChannel(AParticleArray::FX);
+	float* fy = particles.getChannel(AParticleArray::FY);
+	float* fz = particles.getChannel(AParticleArray::FZ);
+	const float* mass = particles.getChannel(AParticleArray::MASS);
+
+	float cx = (float)mCenter[0], cy = (float)mCenter[1], cz = (float)mCenter[2];
+	float softening2 = mSoftening * mSoftening;
+	float invRadius2 = mRadius > 0.0f ? 1.0f / (mRadius * mRadius) : 0.0f;
+	for (int i = begin; i < end; i++)
+	{
+		float dx = cx - px[i], dy = cy - py[i], dz = cz - pz[i];
+		float distance2 = dx * dx + dy * dy + dz * dz;
+		float soft2 = distance2 + softening2;
+		float scale = mStrength * mass[i] * Falloff(distance2, invRadius2) / (soft2 * sqrtf(soft2));
+		fx[i] += scale * dx;
+		fy[i] += scale * dy;
+		fz[i] += scale * dz;
+	}
+}
+
+/****************************************************************
+*
+*    	    AVortexField
+*
+****************************************************************/
+
+AVortexField::AVortexField(const vec3& center, const vec3& axis, float strength, float radius) :
+	mStrength(strength), mCenter(center), mAxis(axis), mRadius(radius)
+{
+	assert(radius > 0.0f);
+	mAxis.Normalize();
+	setBounds(center - vec3(radius, radius, radius), center + vec3(radius, radius, radius));
+}
+
+AVortexField::~AVortexField()
+{
+}
+
+void AVortexField::apply(AParticleArray& particles, int begin, int end) const
+{
+	const float* px = particles.getChannel(AParticleArray::PX);
+	const float* py = particles.getChannel(AParticleArray::PY);
+	const float* pz = particles.getChannel(AParticleArray::PZ);
+	float* fx = particles.getChannel(AParticleArray::FX);
+	float* fy = particles.getChannel(AParticleArray::FY);
+	float* fz = particles.getChannel(AParticleArray::FZ);
+	const float* mass = particles.getChannel(AParticleArray::MASS);
+
+	float cx = (float)mCenter[0], cy = (float)mCenter[1], cz = (float)mCenter[2];
+	float ax = (float)mAxis[0], ay = (float)mAxis[1], az = (float)mAxis[2];
+	float invRadius2 = 1.0f / (mRadius * mRadius);
+	float strength = mStrength / mRadius;
+	for (int i = begin; i < end; i++)
+	{
+		float dx = px[i] - cx, dy = py[i] - cy, dz = pz[i] - cz;
+		float scale = strength * mass[i] * Falloff(dx * dx + dy * dy + dz * dz, invRadius2);
+		fx[i] += scale * (ay * dz - az * dy);
+		fy[i] += scale * (az * dx - ax * dz);
+		fz[i] += scale * (ax * dy - ay * dx);
+	}
+}
+
+/****************************************************************
+*
+*    	    AWindField
+*
+****************************************************************/
+
+AWindField::AWindField(const vec3& force) : mForce(force)
+{
+}
+
+AWindField::AWindField(const vec3& force, const vec3& boxMin, const vec3& boxMax) : mForce(force)
+{
+	setBounds(boxMin, boxMax);
+}
+
+AWindField::~AWindField()
+{
+}
+
+void AWindField::apply(AParticleArray& particles, int begin, int end) const
+{
+	if (!mBounded)
+	{
+		particles.addForce(mForce, begin, end);
+		return;
+	}
+	const float* px = particles.getChannel(AParticleArray::PX);
+	const float* py = particles.getChannel(AParticleArray::PY);
+	const float* pz = particles.getChannel(AParticleArray::PZ);
+	float* fx = particles.getChannel(AParticleArray::FX);
+	float* fy = particles.getChannel(AParticleArray::FY);
+	float* fz = particles.getChannel(AParticleArray::FZ);
+
+	float wx = (float)mForce[0], wy = (float)mForce[1], wz = (float)mForce[2];
+	for (int i = begin; i < end; i++)
+	{
+		float inside = Inside(mMin, mMax, px[i], py[i], pz[i]);
+		fx[i] += inside * wx;
+		fy[i] += inside * wy;
+		fz[i] += inside * wz;
+	}
+}
+
+/****************************************************************
+*
+*    	    ADragField
+*
+****************************************************************/
+
+ADragField::ADragField(float coefficient) : mCoefficient(coefficient)
+{
+}
+
+ADragField::~ADragField()
+{
+}
+
+void ADragField::apply(AParticleArray& particles, int begin, int end) const
+{
+	const float* px = particles.getChannel(AParticleArray::PX);
+	const float* py = particles.getChannel(AParticleArray::PY);
+	const float* pz = particles.getChannel(AParticleArray::PZ);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float* force = particles.getChannel((AParticleArray::Channel)(AParticleArray::FX + axis));
+		const float* velocity = particles.getChannel((AParticleArray::Channel)(AParticleArray::VX + axis));
+		if (!mBounded)
+		{
+			for (int i = begin; i < end; i++) force[i] -= mCoefficient * velocity[i];
+		}
+		else
+		{
+			for (int i = begin; i < end; i++) force[i] -= Inside(mMin, mMax, px[i], py[i], pz[i]) * mCoefficient * velocity[i];
+		}
+	}
+}
+
+/****************************************************************
+*
+*    	    ACurlNoiseField
+*
+****************************************************************/
+
+ACurlNoiseField::ACurlNoiseField(float amplitude, float frequency, int octaves, const vec3& offset) :
+	mAmplitude(amplitude), mFrequency(frequency), mOctaves(octaves), mOffset(offset)
+{
+}
+
+ACurlNoiseField::~ACurlNoiseField()
+{
+}
+
+void ACurlNoiseField::apply(AParticleArray& particles, int begin, int end) const
+{
+	const float* px = particles.getChannel(AParticleArray::PX);
+	const float* py = particles.getChannel(AParticleArray::PY);
+	const float* pz = particles.getChannel(AParticleArray::PZ);
+	float* fx = particles.getChannel(AParticleArray::FX);
+	float* fy = particles.getChannel(AParticleArray::FY);
+	float* fz = particles.getChannel(AParticleArray::FZ);
+	const float* mass = particles.getChannel(AParticleArray::MASS);
+
+	// potential (sin Y cos Z, sin Z cos X, sin X cos Y) at the scaled position, whose curl is
+	// -(sin X sin Y + cos X cos Z, sin Y sin Z + cos X cos Y, sin Z sin X + cos Y cos Z)
+	float frequency = mFrequency;
+	float amplitude = mAmplitude;
+	float ox = (float)mOffset[0], oy = (float)mOffset[1], oz = (float)mOffset[2];
+	for (int octave = 0; octave < mOctaves; octave++)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			float x = frequency * px[i] + ox, y = frequency * py[i] + oy, z = frequency * pz[i] + oz;
+			float sx = sinf(x), cx = cosf(x);
+			float sy = sinf(y), cy = cosf(y);
+			float sz = sinf(z), cz = cosf(z);
+			float scale = -amplitude * mass[i];
+			fx[i] += scale * (sx * sy + cx * cz);
+			fy[i] += scale * (sy * sz + cx * cy);
+			fz[i] += scale * (sz * sx + cy * cz);
+		}
+		// the next octave is shifted by an irrational amount so the octaves do not line up
+		frequency *= 2.0f;
+		amplitude *= 0.5f;
+		ox += 1.618034f;
+		oy += 2.718282f;
+		oz += 1.414214f;
+	}
+}
+
+/****************************************************************
+*
+*    	    AInteractionField
+*
+****************************************************************/
+
+AInteractionField::AInteractionField(float radius, float stiffness, float viscosity) :
+	mRadius(radius), mStiffness(stiffness), mViscosity(viscosity)
+{
+}
+
+AInteractionField::~AInteractionField()
+{
+}
+
+void AInteractionField::update(const ASpatialHash& grid, const AParticleArray& particles, AThreadPool* pool)
+{
+	assert(grid.getNumParticles() == particles.size() && grid.getCellSize() >= mRadius);
+	for (int axis = 0; axis < 3; axis++) mForces[axis].resize(particles.getCapacity());
+	const float* vx = particles.getChannel(AParticleArray::VX);
+	const float* vy = particles.getChannel(AParticleArray::VY);
+	const float* vz = particles.getChannel(AParticleArray::VZ);
+	const float* mass = particles.getChannel(AParticleArray::MASS);
+	float invRadius = 1.0f / mRadius;
+
+	// batches of sorted slots rather than particle indices, so neighbouring particles are handled together
+	particles.forEachBatch(pool, [&](int, int begin, int end)
+	{
+		for (int slot = begin; slot < end; slot++)
+		{
+			int i = grid.getSortedIndex(slot);
+			float fx = 0.0f, fy = 0.0f, fz = 0.0f;
+			float vix = vx[i], viy = vy[i], viz = vz[i];
+			grid.forEachNeighbor(i, mRadius, [&](int j, float dx, float dy, float dz, float distance2)
+			{
+				float r = sqrtf(distance2);
+				float q = 1.0f - r * invRadius;
+				float push = r > 1.0e-6f ? -mStiffness * q * q / r : 0.0f;
+				float drag = mViscosity * q;
+				fx += push * dx + drag * (vx[j] - vix);
+				fy += push * dy + drag * (vy[j] - viy);
+				fz += push * dz + drag * (vz[j] - viz);
+			});
+			mForces[0][i] = mass[i] * fx;
+			mForces[1][i] = mass[i] * fy;
+			mForces[2][i] = mass[i] * fz;
+		}
+	});
+}
+
+void AInteractionField::apply(AParticleArray& particles, int begin, int end) const
+{
+	assert(end <= mForces[0].size());
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float* force = particles.getChannel((AParticleArray::Channel)(AParticleArray::FX + axis));
+		const float* interaction = mForces[axis].data();
+		for (int i = begin; i < end; i++) force[i] += interaction[i];
+	}
+}
+
+/****************************************************************
+*
+*    	    AForceFieldSet
+*
+****************************************************************/
+
+AForceFieldSet::AForceFieldSet()
+{
+}
+
+AForceFieldSet::~AForceFieldSet()
+{
+}
+
+AForceField* AForceFieldSet::add(AForceField* field)
+{
+	mFields.push_back(std::unique_ptr<AForceField>(field));
+	return field;
+}
+
+void AForceFieldSet::remove(AForceField* field)
+{
+	for (int i = 0; i < mFields.size(); i++)
+	{
+		if (mFields[i].get() == field)
+		{
+			mFields.erase(mFields.begin() + i);
+			return;
+		}
+	}
+}
+
+void AForceFieldSet::apply(AParticleArray& particles, int begin, int end) const
+{
+	if (mFields.empty()) return;
+	for (int first = begin; first < end; first += TileSize)
+	{
+		int last = std::min(first + TileSize, end);
+		float boxMin[3], boxMax[3];
+		particles.getBounds(boxMin, boxMax, first, last);
+		for (int f = 0; f < mFields.size(); f++)
+		{
+			const AForceField* field = mFields[f].get();
+			if (field->mEnabled && field->overlaps(boxMin, boxMax)) field->apply(particles, first, last);
+		}
+	}
+}
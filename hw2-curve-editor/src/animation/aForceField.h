@@ -0,0 +1,162 @@
+#ifndef AFORCEFIELD_H_
+#define AFORCEFIELD_H_
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include "aVector.h"
+#include "aParticleArray.h"
+
+class ASpatialHash;
+class AThreadPool;
+
+// A force field adds its force to the force channels of a range of particles in one pass. Every field has a
+// box it acts in, unbounded unless set, which AForceFieldSet tests against the box of each tile of particles
+// so a field is only evaluated where it can have an effect
+class AForceField
+{
+public:
+	AForceField();
+	virtual ~AForceField();
+
+	// Adds the force of the field on the particles [begin, end) to their force channels
+	virtual void apply(AParticleArray& particles, int begin, int end) const = 0;
+
+	bool isBounded() const { return mBounded; }
+	void setBounds(const vec3& boxMin, const vec3& boxMax);
+	void clearBounds() { mBounded = false; }
+	bool overlaps(const float boxMin[3], const float boxMax[3]) const;
+
+	bool mEnabled;
+
+protected:
+	bool mBounded;
+	float mMin[3], mMax[3];
+};
+
+// Inverse square attractor, a repeller with a negative strength. strength is the acceleration at unit
+// distance; the distance is softened by softening near the center. With a radius, the force fades out
+// smoothly to 0 at the radius and the field is bounded by it
+class APointField : public AForceField
+{
+public:
+	APointField(const vec3& center, float strength, float radius = 0.0f, float softening = 1.0f);
+	virtual ~APointField();
+	virtual void apply(AParticleArray& particles, int begin, int end) const;
+
+	void setCenter(const vec3& center);
+	const vec3& getCenter() const { return mCenter; }
+
+	float mStrength;
+	float mSoftening;
+
+protected:
+	vec3 mCenter;
+	float mRadius;
+};
+
+// Swirls the particles around the axis through center: an acceleration of strength * (axis x offset) / radius,
+// faded out smoothly to 0 at the radius
+class AVortexField : public AForceField
+{
+public:
+	AVortexField(const vec3& center, const vec3& axis, float strength, float radius);
+	virtual ~AVortexField();
+	virtual void apply(AParticleArray& particles, int begin, int end) const;
+
+	float mStrength;
+
+protected:
+	vec3 mCenter;
+	vec3 mAxis;     // unit
+	float mRadius;
+};
+
+// Constant force, independent of the mass, inside its box; everywhere when unbounded
+class AWindField : public AForceField
+{
+public:
+	AWindField(const vec3& force);
+	AWindField(const vec3& force, const vec3& boxMin, const vec3& boxMax);
+	virtual ~AWindField();
+	virtual void apply(AParticleArray& particles, int begin, int end) const;
+
+	vec3 mForce;
+};
+
+// Linear drag, force = -coefficient * velocity, inside its box; everywhere when unbounded
+class ADragField : public AForceField
+{
+public:
+	ADragField(float coefficient);
+	virtual ~ADragField();
+	virtual void apply(AParticleArray& particles, int begin, int end) const;
+
+	float mCoefficient;
+};
+
+// Divergence free turbulence: the acceleration is the curl of a potential made of sine waves, octaves of them
+// at doubling frequencies and halving amplitudes, so it stirs the particles without sources or sinks. Unbounded
+// unless a box is set
+class ACurlNoiseField : public AForceField
+{
+public:
+	ACurlNoiseField(float amplitude, float frequency, int octaves = 2, const vec3& offset = vec3(0, 0, 0));
+	virtual ~ACurlNoiseField();
+	virtual void apply(AParticleArray& particles, int begin, int end) const;
+
+	float mAmplitude;   // acceleration
+	float mFrequency;   // of the first octave, in radians per unit
+	int mOctaves;
+	vec3 mOffset;       // shifts the pattern, e.g. a different one per field
+};
+
+// SPH-like short range interaction between the particles of one array: a pressure pushing apart particles closer
+// than radius, an acceleration of stiffness * (1 - r / radius)^2 along their separation, and a viscosity pulling
+// their velocities together, viscosity * (1 - r / radius) * (vj - vi). The forces are computed by update() from
+// the state the neighbour grid was built with and held over the step; apply() adds them
+class AInteractionField : public AForceField
+{
+public:
+	AInteractionField(float radius, float stiffness, float viscosity);
+	virtual ~AInteractionField();
+	virtual void apply(AParticleArray& particles, int begin, int end) const;
+
+	// grid must have been built on particles with a cell size of at least the radius
+	void update(const ASpatialHash& grid, const AParticleArray& particles, AThreadPool* pool = NULL);
+
+	float mRadius;
+	float mStiffness;
+	float mViscosity;
+
+protected:
+	std::vector<float> mForces[3];
+};
+
+// Set of fields applied together. Particles are processed in tiles of TileSize; a field is only evaluated on
+// the tiles whose box overlaps its own, so bounded fields cost little away from their particles
+class AForceFieldSet
+{
+public:
+	static const int TileSize = 64;
+
+	AForceFieldSet();
+	virtual ~AForceFieldSet();
+
+	// Takes ownership of field and returns it
+	AForceField* add(AForceField* field);
+	void remove(AForceField* field);
+	void clear() { mFields.clear(); }
+	int size() const { return (int)mFields.size(); }
+	AForceField* get(int index) const { return mFields[index].get(); }
+
+	// Adds the force of every enabled field to the particles [begin, end). Safe to call on disjoint ranges
+	// from different threads
+	void apply(AParticleArray& particles, int begin, int end) const;
+
+protected:
+	std::vector<std::unique_ptr<AForceField>> mFields;
+};
+
+#endif
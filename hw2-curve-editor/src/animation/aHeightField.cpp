@@ -0,0 +1,80 @@
+#include "aHeightField.h"
+#include <algorithm>
+#include <cmath>
+
+#pragma warning(disable : 4018)
+
+AHeightField::AHeightField() : mNumX(0), mNumZ(0), mOriginX(0.0f), mOriginZ(0.0f), mCellSize(1.0f)
+{
+}
+
+AHeightField::~AHeightField()
+{
+}
+
+bool AHeightField::set(int numX, int numZ, float originX, float originZ, float cellSize, const float* heights)
+{
+	mHeights.clear();
+	if (numX < 2 || numZ < 2 || cellSize <= 0.0f || !heights) return false;
+
+	mNumX = numX;
+	mNumZ = numZ;
+	mOriginX = originX;
+	mOriginZ = originZ;
+	mCellSize = cellSize;
+	mHeights.assign(heights, heights + numX * numZ);
+	return true;
+}
+
+void AHeightField::setHeights(const float* heights)
+{
+	if (isValid()) std::copy(heights, heights + mHeights.size(), mHeights.begin());
+}
+
+void AHeightField::locate(float x, float z, int& ix, int& iz, float& u, float& v) const
+{
+	float gx = std::min(std::max((x - mOriginX) / mCellSize, 0.0f), (float)(mNumX - 1));
+	float gz = std::min(std::max((z - mOriginZ) / mCellSize, 0.0f), (float)(mNumZ - 1));
+	ix = std::min((int)gx, mNumX - 2);
+	iz = std::min((int)gz, mNumZ - 2);
+	u = gx - ix;
+	v = gz - iz;
+}
+
+float AHeightField::getHeight(float x, float z) const
+{
+	if (!isValid()) return 0.0f;
+
+	int ix, iz;
+	float u, v;
+	locate(x, z, ix, iz, u, v);
+	const float* row = &mHeights[iz * mNumX + ix];
+	float h0 = row[0] + (row[1] - row[0]) * u;
+	float h1 = row[mNumX] + (row[mNumX + 1] - row[mNumX]) * u;
+	return h0 + (h1 - h0) * v;
+}
+
+float AHeightField::sample(float x, float z, vec3& normal) const
+{
+	if (!isValid())
+	{
+		normal = vec3(0, 1, 0);
+		return 0.0f;
+	}
+
+	int ix, iz;
+	float u, v;
+	locate(x, z, ix, iz, u, v);
+	const float* row = &mHeights[iz * mNumX + ix];
+	float h00 = row[0], h10 = row[1], h01 = row[mNumX], h11 = row[mNumX + 1];
+
+	// gradient of the bilinear patch; the surface y = h(x, z) has the normal (-dh/dx, 1, -dh/dz)
+	float dhdx = ((h10 - h00) * (1.0f - v) + (h11 - h01) * v) / mCellSize;
+	float dhdz = ((h01 - h00) * (1.0f - u) + (h11 - h10) * u) / mCellSize;
+	normal = vec3(-dhdx, 1.0f, -dhdz);
+	normal.Normalize();
+
+	float h0 = h00 + (h10 - h00) * u;
+	float h1 = h01 + (h11 - h01) * u;
+	return h0 + (h1 - h0) * v;
+}
@@ -0,0 +1,44 @@
+#ifndef AHEIGHTFIELD_H_
+#define AHEIGHTFIELD_H_
+
+#pragma once
+
+#include <vector>
+#include "aVector.h"
+
+// Regular grid of terrain heights on the XZ plane, sampled with bilinear interpolation.
+// Used to place feet on the ground without the engine raycasting for every foot of every character
+class AHeightField
+{
+public:
+	AHeightField();
+	virtual ~AHeightField();
+
+	// heights has numX * numZ values, row by row along +X: height(x, z) = heights[z * numX + x] at
+	// (originX + x * cellSize, originZ + z * cellSize)
+	bool set(int numX, int numZ, float originX, float originZ, float cellSize, const float* heights);
+	// Replaces the heights keeping the grid, e.g. for deforming terrain
+	void setHeights(const float* heights);
+	bool isValid() const { return !mHeights.empty(); }
+
+	int getNumX() const { return mNumX; }
+	int getNumZ() const { return mNumZ; }
+	float getCellSize() const { return mCellSize; }
+
+	// Positions outside the grid take the height of the closest edge
+	float getHeight(float x, float z) const;
+	// Height and upward unit normal of the interpolated surface at (x, z)
+	float sample(float x, float z, vec3& normal) const;
+
+protected:
+	// grid cell containing (x, z) and the position inside it in [0, 1]
+	void locate(float x, float z, int& ix, int& iz, float& u, float& v) const;
+
+protected:
+	int mNumX, mNumZ;
+	float mOriginX, mOriginZ;
+	float mCellSize;
+	std::vector<float> mHeights;
+};
+
+#endif
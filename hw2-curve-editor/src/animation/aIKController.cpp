@@ -1,10 +1,97 @@
 #include "aIKController.h"
 #include "aActor.h"
+#include "aHeightField.h"
+#include <algorithm>
+#include <chrono>
 
 #pragma warning (disable : 4018)
 
 int IKController::gIKmaxIterations = 5;
 double IKController::gIKEpsilon = 0.1;
+double IKController::gIKTimeBudgetMs = 0.5;
+int IKController::gIKmaxDLSIterations = 50;
+double IKController::gIKDamping = 0.05;
+int IKController::gIKmaxFABRIKIterations = 250;
+double IKController::gIKFABRIKTimeBudgetMs = 5.0;
+
+// Global rotations and positions of the first size joints of a chain given the global transform of the parent
+// of joint size - 1; the chain is stored end joint first
+static void ComputeChainFK(int size, const mat3& parentRotation, const vec3& parentPosition,
+	const mat3* localRotations, const vec3* localTranslations, mat3* rotations, vec3* positions)
+{
+	mat3 rotation = parentRotation;
+	vec3 position = parentPosition;
+	for (int i = size - 1; i >= 0; i--)
+	{
+		position = position + rotation * localTranslations[i];
+		rotation = rotation * localRotations[i];
+		rotations[i] = rotation;
+		positions[i] = position;
+	}
+}
+
+// Global position of the end joint of a chain from the local transforms of its joints, for solvers that only
+// write local rotations and leave the global transforms of the chain stale
+static vec3 ChainEndPosition(AIKchain& IKchain)
+{
+	AJoint* pParent = IKchain.getJoint(IKchain.getSize() - 1)->getParent();
+	mat3 rotation = pParent ? pParent->getGlobalRotation() : IdentityMat3;
+	vec3 position = pParent ? pParent->getGlobalTranslation() : vec3(0, 0, 0);
+	for (int i = IKchain.getSize() - 1; i >= 0; i--)
+	{
+		AJoint* pJoint = IKchain.getJoint(i);
+		position = position + rotation * pJoint->getLocalTranslation();
+		rotation = rotation * pJoint->getLocalRotation();
+	}
+	return position;
+}
+
+// Global rotation and position of a joint from the local transforms of the joint and its ancestors
+static void JointFK(AJoint* pJoint, mat3& rotation, vec3& position)
+{
+	if (!pJoint)
+	{
+		rotation = IdentityMat3;
+		position = vec3(0, 0, 0);
+		return;
+	}
+	JointFK(pJoint->getParent(), rotation, position);
+	position = position + rotation * pJoint->getLocalTranslation();
+	rotation = rotation * pJoint->getLocalRotation();
+}
+
+// Turns the world direction from onto the world direction to by rotating a joint whose parent has the global
+// rotation parentRotation
+static void RotateJointOnto(mat3& localRotation, const mat3& parentRotation, const vec3& from, const vec3& to)
+{
+	vec3 axis = from ^ to;
+	double sine = axis.Length();
+	if (sine < 1e-12) return;
+	localRotation = mat3::Rotation3D(parentRotation.Transpose() * axis, atan2(sine, from * to)) * localRotation;
+}
+
+// Shortest-arc rotation taking direction from onto direction to; identity for degenerate input
+static quat RotationBetween(const vec3& from, const vec3& to)
+{
+	vec3 axis = from ^ to;
+	quat q(sqrt((from * from) * (to * to)) + from * to, axis[0], axis[1], axis[2]);
+	if (q.Length() < 1e-12) return quat(1, 0, 0, 0);
+	return q.Normalize();
+}
+
+// Limits the angle between direction dir and the unit direction ref to maxAngle
+static vec3 ClampToCone(const vec3& dir, const vec3& ref, double maxAngle)
+{
+	double length = dir.Length();
+	if (length < 1e-12) return ref;
+	vec3 unit = dir / length;
+	double cosAngle = unit * ref;
+	if (cosAngle >= cos(maxAngle)) return unit;
+	vec3 side = unit - ref * cosAngle;
+	double sideLength = side.Length();
+	if (sideLength < 1e-12) return ref;
+	return ref * cos(maxAngle) + side * (sin(maxAngle) / sideLength);
+}
 
 // AIKchain class functions
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -63,6 +150,27 @@ void AIKchain::setWeights(std::vector<double> weights)
 	mWeights = weights; 
 }
 
+std::vector<double>& AIKchain::getConeLimits()
+{
+	return mConeLimits;
+}
+
+void AIKchain::setConeLimit(int index, double angleRad)
+{
+	if (mConeLimits.size() < mChain.size()) mConeLimits.resize(mChain.size(), -1.0);
+	mConeLimits[index] = angleRad;
+}
+
+void AIKchain::setConeLimits(std::vector<double> limits)
+{
+	mConeLimits = limits;
+}
+
+std::vector<mat3>& AIKchain::getLastSolution()
+{
+	return mLastSolution;
+}
+
 // AIKController class functions
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -72,6 +180,9 @@ IKController::IKController()
 	m_pSkeleton = NULL;
 	mvalidLimbIKchains = false;
 	mvalidCCDIKchains = false;
+	mLimbIKchainsVersion = 0;
+	mCCDIKchainsVersion = 0;
+	mInBatch = false;
 
 	// Limb IK
 	m_pEndJoint = NULL;
@@ -88,6 +199,8 @@ IKController::IKController()
 	//CCD IK
 	mWeight0 = 0.1;  // default joint rotation weight value
 
+	mInstrumented = false;
+	resetStats();
 }
 
 IKController::~IKController()
@@ -133,7 +246,43 @@ AIKchain IKController::createIKchain(int endJointID, int desiredChainSize, ASkel
 	// add the corresponding skeleton joint pointers to the AIKChain "chain" data member starting with the end joint
 	// desiredChainSize = -1 should create an IK chain of maximum length (where the last chain joint is the joint before the root joint)
 	// also add weight values to the associated AIKChain "weights" data member which can be used in a CCD IK implemention
-	return AIKchain();
+	AIKchain IKchain;
+	std::vector<AJoint*> chain;
+	std::vector<double> weights;
+	AJoint* pJoint = pSkeleton->getJointByID(endJointID);
+	while (pJoint && pJoint->getParent() && (desiredChainSize < 0 || chain.size() < desiredChainSize))
+	{
+		chain.push_back(pJoint);
+		weights.push_back(mWeight0);
+		pJoint = pJoint->getParent();
+	}
+	IKchain.setChain(chain);
+	IKchain.setWeights(weights);
+	return IKchain;
+}
+
+bool IKController::IKchainKey::operator<(const IKchainKey& key) const
+{
+	if (skeleton != key.skeleton) return skeleton < key.skeleton;
+	if (endJointID != key.endJointID) return endJointID < key.endJointID;
+	return chainSize < key.chainSize;
+}
+
+AIKchain& IKController::getIKchain(int endJointID, int desiredChainSize, ASkeleton* pSkeleton)
+{
+	IKchainKey key = { pSkeleton, endJointID, desiredChainSize };
+	std::map<IKchainKey, CachedIKchain>::iterator it = mIKchainCache.find(key);
+	if (it == mIKchainCache.end())
+	{
+		it = mIKchainCache.insert(std::make_pair(key, CachedIKchain())).first;
+	}
+	else if (it->second.hierarchyVersion == pSkeleton->getHierarchyVersion())
+	{
+		return it->second.chain;
+	}
+	it->second.hierarchyVersion = pSkeleton->getHierarchyVersion();
+	it->second.chain = createIKchain(endJointID, desiredChainSize, pSkeleton);
+	return it->second.chain;
 }
 
 
@@ -143,9 +292,9 @@ bool IKController::IKSolver_Limb(int endJointID, const ATarget& target)
 	// Implements the analytic/geometric IK method assuming a three joint limb  
 
 	// copy transforms from base skeleton
-	mIKSkeleton.copyTransforms(m_pSkeleton);
+	if (!mInBatch) mIKSkeleton.copyTransforms(m_pSkeleton);
 
-	if (!mvalidLimbIKchains)
+	if (!mvalidLimbIKchains || mLimbIKchainsVersion != mIKSkeleton.getHierarchyVersion())
 	{
 		mvalidLimbIKchains = createLimbIKchains();
 		if (!mvalidLimbIKchains) { return false; }
@@ -157,39 +306,41 @@ bool IKController::IKSolver_Limb(int endJointID, const ATarget& target)
 	if (endJointID == mLhandID)
 	{
 		mLhandTarget = target;
-		computeLimbIK(mLhandTarget, mLhandIKchain, -axisY, &mIKSkeleton);
+		runLimbIK(mLhandTarget, mLhandIKchain, -axisY);
 	}
 	else if (endJointID == mRhandID)
 	{
 		mRhandTarget = target;
-		computeLimbIK(mRhandTarget, mRhandIKchain, axisY, &mIKSkeleton);
+		runLimbIK(mRhandTarget, mRhandIKchain, axisY);
 	}
 	else if (endJointID == mLfootID)
 	{
 		mLfootTarget = target;
-		computeLimbIK(mLfootTarget, mLfootIKchain, axisX, &mIKSkeleton);
+		runLimbIK(mLfootTarget, mLfootIKchain, axisX);
 	}
 	else if (endJointID == mRfootID)
 	{
 		mRfootTarget = target;
-		computeLimbIK(mRfootTarget, mRfootIKchain, axisX, &mIKSkeleton);
+		runLimbIK(mRfootTarget, mRfootIKchain, axisX);
 	}
 	else if (endJointID == mRootID)
 	{
 		desiredRootPosition = target.getGlobalTranslation();
 		mIKSkeleton.getJointByID(mRootID)->setLocalTranslation(desiredRootPosition);
 		mIKSkeleton.update();
-		computeLimbIK(mLhandTarget, mLhandIKchain, -axisY, &mIKSkeleton);
-		computeLimbIK(mRhandTarget, mRhandIKchain, axisY, &mIKSkeleton);
-		computeLimbIK(mLfootTarget, mLfootIKchain, axisX, &mIKSkeleton);
-		computeLimbIK(mRfootTarget, mRfootIKchain, axisX, &mIKSkeleton);
+		runLimbIK(mLhandTarget, mLhandIKchain, -axisY);
+		runLimbIK(mRhandTarget, mRhandIKchain, axisY);
+		runLimbIK(mLfootTarget, mLfootIKchain, axisX);
+		runLimbIK(mRfootTarget, mRfootIKchain, axisX);
 	}
 	else
 	{
-		mIKchain = createIKchain(endJointID, 3, &mIKSkeleton);
-		computeLimbIK(target, mIKchain, axisY, &mIKSkeleton);
+		runLimbIK(target, getIKchain(endJointID, 3, &mIKSkeleton), axisY);
 	}
 
+	// solveBatch updates and copies back once all of its targets are solved
+	if (mInBatch) return true;
+
 	// update IK Skeleton transforms
 	mIKSkeleton.update();
 
@@ -207,10 +358,12 @@ int IKController::createLimbIKchains()
 	int desiredChainSize = 3;
 
 	// create IK chains for Lhand, Rhand, Lfoot and Rfoot 
-	mLhandIKchain = createIKchain(mLhandID, desiredChainSize, &mIKSkeleton);
-	mRhandIKchain = createIKchain(mRhandID, desiredChainSize, &mIKSkeleton);
-	mLfootIKchain = createIKchain(mLfootID, desiredChainSize, &mIKSkeleton);
-	mRfootIKchain = createIKchain(mRfootID, desiredChainSize, &mIKSkeleton);
+	mLhandIKchain = getIKchain(mLhandID, desiredChainSize, &mIKSkeleton);
+	mRhandIKchain = getIKchain(mRhandID, desiredChainSize, &mIKSkeleton);
+	mLfootIKchain = getIKchain(mLfootID, desiredChainSize, &mIKSkeleton);
+	mRfootIKchain = getIKchain(mRfootID, desiredChainSize, &mIKSkeleton);
+	mLimbIKchainsVersion = mIKSkeleton.getHierarchyVersion();
+	mvalidCCDIKchains = false;  // the CCD chains share these members
 	
 	if (mLhandIKchain.getSize() == 3 && mRhandIKchain.getSize() == 3 && mLfootIKchain.getSize() == 3 && mRfootIKchain.getSize() == 3)
 	{
@@ -244,14 +397,14 @@ bool IKController::IKSolver_CCD(int endJointID, const ATarget& target)
 
 	bool validChains = false;
 
-	if (!mvalidCCDIKchains)
+	if (!mvalidCCDIKchains || mCCDIKchainsVersion != mIKSkeleton.getHierarchyVersion())
 	{
 		mvalidCCDIKchains = createCCDIKchains();
 		assert(mvalidCCDIKchains);
 	}
 
 	// copy transforms from base skeleton
-	mIKSkeleton.copyTransforms(m_pSkeleton);
+	if (!mInBatch) mIKSkeleton.copyTransforms(m_pSkeleton);
 
 	vec3 desiredRootPosition;
 
@@ -259,39 +412,41 @@ bool IKController::IKSolver_CCD(int endJointID, const ATarget& target)
 	if (endJointID == mLhandID)
 	{
 		mLhandTarget = target;
-		computeCCDIK(mLhandTarget, mLhandIKchain, &mIKSkeleton);
+		runCCDIK(mLhandTarget, mLhandIKchain);
 	}
 	else if (endJointID == mRhandID)
 	{
 		mRhandTarget = target;
-		computeCCDIK(mRhandTarget, mRhandIKchain, &mIKSkeleton);
+		runCCDIK(mRhandTarget, mRhandIKchain);
 	}
 	else if (endJointID == mLfootID)
 	{
 		mLfootTarget = target;
-		computeCCDIK(mLfootTarget, mLfootIKchain, &mIKSkeleton);
+		runCCDIK(mLfootTarget, mLfootIKchain);
 	}
 	else if (endJointID == mRfootID)
 	{
 		mRfootTarget = target;
-		computeCCDIK(mRfootTarget, mRfootIKchain, &mIKSkeleton);
+		runCCDIK(mRfootTarget, mRfootIKchain);
 	}
 	else if (endJointID == mRootID)
 	{
 		desiredRootPosition = target.getGlobalTranslation();
 		mIKSkeleton.getJointByID(mRootID)->setLocalTranslation(desiredRootPosition);
 		mIKSkeleton.update();
-		computeCCDIK(mLhandTarget, mLhandIKchain, &mIKSkeleton);
-		computeCCDIK(mRhandTarget, mRhandIKchain, &mIKSkeleton);
-		computeCCDIK(mLfootTarget, mLfootIKchain, &mIKSkeleton);
-		computeCCDIK(mRfootTarget, mRfootIKchain, &mIKSkeleton);
+		runCCDIK(mLhandTarget, mLhandIKchain);
+		runCCDIK(mRhandTarget, mRhandIKchain);
+		runCCDIK(mLfootTarget, mLfootIKchain);
+		runCCDIK(mRfootTarget, mRfootIKchain);
 	}
 	else
 	{
-		mIKchain = createIKchain(endJointID, -1, &mIKSkeleton);
-		computeCCDIK(target, mIKchain, &mIKSkeleton);
+		runCCDIK(target, getIKchain(endJointID, -1, &mIKSkeleton));
 	}
 
+	// solveBatch updates and copies back once all of its targets are solved
+	if (mInBatch) return true;
+
 	// update IK Skeleton transforms
 	mIKSkeleton.update();
 
@@ -309,10 +464,12 @@ int IKController::createCCDIKchains()
 
 
 	// create IK chains for Lhand, Rhand, Lfoot and Rfoot 
-	mLhandIKchain = createIKchain(mLhandID, desiredChainSize, &mIKSkeleton);
-	mRhandIKchain = createIKchain(mRhandID, desiredChainSize, &mIKSkeleton);
-	mLfootIKchain = createIKchain(mLfootID, desiredChainSize, &mIKSkeleton);
-	mRfootIKchain = createIKchain(mRfootID, desiredChainSize, &mIKSkeleton);
+	mLhandIKchain = getIKchain(mLhandID, desiredChainSize, &mIKSkeleton);
+	mRhandIKchain = getIKchain(mRhandID, desiredChainSize, &mIKSkeleton);
+	mLfootIKchain = getIKchain(mLfootID, desiredChainSize, &mIKSkeleton);
+	mRfootIKchain = getIKchain(mRfootID, desiredChainSize, &mIKSkeleton);
+	mCCDIKchainsVersion = mIKSkeleton.getHierarchyVersion();
+	mvalidLimbIKchains = false;  // the limb chains share these members
 
 	if (mLhandIKchain.getSize() > 1 && mRhandIKchain.getSize() > 1 && mLfootIKchain.getSize() > 1 && mRfootIKchain.getSize() > 1)
 	{
@@ -349,8 +506,244 @@ int IKController::computeCCDIK(ATarget target, AIKchain& IKchain, ASkeleton* pIK
 
 bool IKController::IKSolver_PseudoInv(int endJointID, const ATarget& target)
 {
-	// TODO: Implement Pseudo Inverse-based IK  
-	// The actual position of the end joint should match the target position after the skeleton is updated with the new joint angles
+	// Implements damped least squares (damped pseudo inverse) IK over chains of maximum length
+
+	if (!mvalidCCDIKchains || mCCDIKchainsVersion != mIKSkeleton.getHierarchyVersion())
+	{
+		mvalidCCDIKchains = createCCDIKchains();
+		assert(mvalidCCDIKchains);
+	}
+
+	// copy transforms from base skeleton
+	if (!mInBatch) mIKSkeleton.copyTransforms(m_pSkeleton);
+
+	vec3 desiredRootPosition;
+
+	if (endJointID == mLhandID)
+	{
+		mLhandTarget = target;
+		computeDLSIK(mLhandTarget, mLhandIKchain, &mIKSkeleton);
+	}
+	else if (endJointID == mRhandID)
+	{
+		mRhandTarget = target;
+		computeDLSIK(mRhandTarget, mRhandIKchain, &mIKSkeleton);
+	}
+	else if (endJointID == mLfootID)
+	{
+		mLfootTarget = target;
+		computeDLSIK(mLfootTarget, mLfootIKchain, &mIKSkeleton);
+	}
+	else if (endJointID == mRfootID)
+	{
+		mRfootTarget = target;
+		computeDLSIK(mRfootTarget, mRfootIKchain, &mIKSkeleton);
+	}
+	else if (endJointID == mRootID)
+	{
+		desiredRootPosition = target.getGlobalTranslation();
+		mIKSkeleton.getJointByID(mRootID)->setLocalTranslation(desiredRootPosition);
+		mIKSkeleton.update();
+		computeDLSIK(mLhandTarget, mLhandIKchain, &mIKSkeleton);
+		computeDLSIK(mRhandTarget, mRhandIKchain, &mIKSkeleton);
+		computeDLSIK(mLfootTarget, mLfootIKchain, &mIKSkeleton);
+		computeDLSIK(mRfootTarget, mRfootIKchain, &mIKSkeleton);
+	}
+	else
+	{
+		computeDLSIK(target, getIKchain(endJointID, -1, &mIKSkeleton), &mIKSkeleton);
+	}
+
+	// solveBatch updates and copies back once all of its targets are solved
+	if (mInBatch) return true;
+
+	// update IK Skeleton transforms
+	mIKSkeleton.update();
+
+	// copy IK skeleton transforms to main skeleton
+	m_pSkeleton->copyTransforms(&mIKSkeleton);
+
+	return true;
+}
+
+int IKController::computeDLSIK(ATarget target, AIKchain& IKchain, ASkeleton* pIKSkeleton)
+{
+	// Damped least squares IK for the end joint position: every joint above the end joint rotates about the three
+	// world axes, so joint i contributes J_i = [r_i]x^T with r_i the vector from joint i to the end joint and
+	//   dq_i = w_i * J_i^T * (J W J^T + lambda^2 I)^-1 * e = w_i * (r_i x y),  y = (J W J^T + lambda^2 I)^-1 * e
+	// J W J^T = sum w_i (|r_i|^2 I - r_i r_i^T) is 3x3, so an iteration needs no storage beyond the fixed-size
+	// arrays below. Weights are relative to the largest weight of the chain, so uniform weights act as 1.
+	// Returns the number of iterations
+	int size = std::min(IKchain.getSize(), (int)MaxDLSChainSize);
+	if (size < 2)
+	{
+		if (mInstrumented) recordSolve(PSEDUOINV, size ? IKchain.getJoint(0)->getID() : -1, 0, 0.0, EXIT_INVALID_CHAIN, 0.0);
+		return 0;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<AJoint*>& chain = IKchain.getChain();
+	std::vector<double>& chainWeights = IKchain.getWeights();
+
+	mat3 localRotations[MaxDLSChainSize];
+	vec3 localTranslations[MaxDLSChainSize];
+	mat3 rotations[MaxDLSChainSize];
+	vec3 positions[MaxDLSChainSize];
+	double weights[MaxDLSChainSize];
+
+	double maxWeight = 0.0;
+	for (int i = 0; i < size; i++)
+	{
+		weights[i] = i < chainWeights.size() ? chainWeights[i] : 1.0;
+		maxWeight = std::max(maxWeight, weights[i]);
+	}
+	double reach = 0.0;
+	for (int i = 0; i < size; i++)
+	{
+		weights[i] = maxWeight > 0.0 ? weights[i] / maxWeight : 1.0;
+		localRotations[i] = chain[i]->getLocalRotation();
+		localTranslations[i] = chain[i]->getLocalTranslation();
+		if (i < size - 1) reach += localTranslations[i].Length();
+	}
+	if (reach < 1e-6)
+	{
+		if (mInstrumented) recordSolve(PSEDUOINV, chain[0]->getID(), 0, 0.0, EXIT_INVALID_CHAIN, 0.0);
+		return 0;
+	}
+
+	AJoint* pParent = chain[size - 1]->getParent();
+	mat3 parentRotation = pParent ? pParent->getGlobalRotation() : IdentityMat3;
+	vec3 parentPosition = pParent ? pParent->getGlobalTranslation() : vec3(0, 0, 0);
+	vec3 desiredEndPos = target.getGlobalTranslation();
+
+	ComputeChainFK(size, parentRotation, parentPosition, localRotations, localTranslations, rotations, positions);
+	vec3 error = desiredEndPos - positions[0];
+
+	// warm start: continue from the last solution when it is closer to the target than the current pose
+	std::vector<mat3>& lastSolution = IKchain.getLastSolution();
+	if (lastSolution.size() == size && error.Length() > gIKEpsilon)
+	{
+		mat3 warmRotations[MaxDLSChainSize];
+		vec3 warmPositions[MaxDLSChainSize];
+		ComputeChainFK(size, parentRotation, parentPosition, &lastSolution[0], localTranslations, warmRotations, warmPositions);
+		vec3 warmError = desiredEndPos - warmPositions[0];
+		if (warmError.Length() < error.Length())
+		{
+			for (int i = 0; i < size; i++)
+			{
+				localRotations[i] = lastSolution[i];
+				rotations[i] = warmRotations[i];
+				positions[i] = warmPositions[i];
+			}
+			error = warmError;
+		}
+	}
+
+	double lambda = gIKDamping * reach;
+	double maxStep = 0.25 * reach;  // the linearization only holds for small steps
+	int iteration = 0;
+	bool outOfTime = false;
+	while (error.Length() > gIKEpsilon && iteration < gIKmaxDLSIterations)
+	{
+		if (iteration > 0 && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() > gIKTimeBudgetMs)
+		{
+			outOfTime = true;
+			break;
+		}
+
+		double length = error.Length();
+		if (length > maxStep) error = error * (maxStep / length);
+
+		mat3 JWJt = lambda * lambda * IdentityMat3;
+		for (int i = 1; i < size; i++)
+		{
+			vec3 r = positions[0] - positions[i];
+			mat3 rrt(r * r[0], r * r[1], r * r[2]);
+			JWJt += weights[i] * ((r * r) * IdentityMat3 - rrt);
+		}
+		vec3 y = JWJt.Inverse() * error;
+
+		for (int i = 1; i < size; i++)
+		{
+			vec3 dq = weights[i] * ((positions[0] - positions[i]) ^ y);
+			double angle = dq.Length();
+			if (angle < 1e-12) continue;
+			// dq rotates about a world axis through joint i; express the axis in the frame of the parent of joint i
+			const mat3& parent = i < size - 1 ? rotations[i + 1] : parentRotation;
+			localRotations[i] = mat3::Rotation3D(parent.Transpose() * dq, angle) * localRotations[i];
+		}
+
+		ComputeChainFK(size, parentRotation, parentPosition, localRotations, localTranslations, rotations, positions);
+		error = desiredEndPos - positions[0];
+		iteration++;
+	}
+
+	lastSolution.assign(localRotations, localRotations + size);
+	for (int i = 0; i < size; i++)
+	{
+		chain[i]->setLocalRotation(localRotations[i]);
+	}
+
+	if (mInstrumented)
+	{
+		double length = error.Length();
+		ExitReason reason = length <= gIKEpsilon ? EXIT_CONVERGED : outOfTime ? EXIT_TIME_BUDGET : EXIT_MAX_ITERATIONS;
+		recordSolve(PSEDUOINV, chain[0]->getID(), iteration, length, reason,
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+	return iteration;
+}
+
+bool IKController::solveBatch(IKType type, int numTargets, const int* endJointIDs, const vec3* targetPositions)
+{
+	if (numTargets <= 0) return true;
+
+	// create the chains up front, creating them copies the base skeleton into the IK skeleton
+	if (type == LIMB)
+	{
+		if (!mvalidLimbIKchains || mLimbIKchainsVersion != mIKSkeleton.getHierarchyVersion())
+		{
+			mvalidLimbIKchains = createLimbIKchains();
+			if (!mvalidLimbIKchains) { return false; }
+		}
+	}
+	else if (!mvalidCCDIKchains || mCCDIKchainsVersion != mIKSkeleton.getHierarchyVersion())
+	{
+		mvalidCCDIKchains = createCCDIKchains();
+		if (!mvalidCCDIKchains) { return false; }
+	}
+
+	mIKSkeleton.copyTransforms(m_pSkeleton);
+	mInBatch = true;
+	ATarget target;
+	for (int i = 0; i < numTargets; i++)
+	{
+		target.setGlobalTranslation(targetPositions[i]);
+		switch (type)
+		{
+		case CCD:
+			IKSolver_CCD(endJointIDs[i], target);
+			break;
+		case PSEDUOINV:
+			IKSolver_PseudoInv(endJointIDs[i], target);
+			break;
+		case FABRIK:
+			IKSolver_FABRIK(endJointIDs[i], target);
+			break;
+		case LIMB:
+		default:
+			IKSolver_Limb(endJointIDs[i], target);
+			break;
+		}
+	}
+	mInBatch = false;
+
+	// update IK Skeleton transforms
+	mIKSkeleton.update();
+
+	// copy IK skeleton transforms to main skeleton
+	m_pSkeleton->copyTransforms(&mIKSkeleton);
+
 	return true;
 }
 
@@ -359,4 +752,451 @@ bool IKController::IKSolver_Other(int endJointID, const ATarget& target)
 	// TODO: Put Optional IK implementation or enhancements here
 	 
 	return true;
+}
+
+bool IKController::IKSolver_FABRIK(int endJointID, const ATarget& target)
+{
+	// Implements FABRIK over chains of maximum length; both hands are solved together since their chains share the spine
+
+	if (!mvalidCCDIKchains || mCCDIKchainsVersion != mIKSkeleton.getHierarchyVersion())
+	{
+		mvalidCCDIKchains = createCCDIKchains();
+		assert(mvalidCCDIKchains);
+	}
+
+	// copy transforms from base skeleton
+	if (!mInBatch) mIKSkeleton.copyTransforms(m_pSkeleton);
+
+	vec3 desiredRootPosition;
+	ATarget targets[4];
+	AIKchain* chains[4];
+
+	if (endJointID == mLhandID || endJointID == mRhandID)
+	{
+		if (endJointID == mLhandID) mLhandTarget = target;
+		else mRhandTarget = target;
+		targets[0] = mLhandTarget; chains[0] = &mLhandIKchain;
+		targets[1] = mRhandTarget; chains[1] = &mRhandIKchain;
+		computeFABRIKIK(2, targets, chains);
+	}
+	else if (endJointID == mLfootID)
+	{
+		mLfootTarget = target;
+		computeFABRIKIK(mLfootTarget, mLfootIKchain, &mIKSkeleton);
+	}
+	else if (endJointID == mRfootID)
+	{
+		mRfootTarget = target;
+		computeFABRIKIK(mRfootTarget, mRfootIKchain, &mIKSkeleton);
+	}
+	else if (endJointID == mRootID)
+	{
+		desiredRootPosition = target.getGlobalTranslation();
+		mIKSkeleton.getJointByID(mRootID)->setLocalTranslation(desiredRootPosition);
+		mIKSkeleton.update();
+		targets[0] = mLhandTarget; chains[0] = &mLhandIKchain;
+		targets[1] = mRhandTarget; chains[1] = &mRhandIKchain;
+		targets[2] = mLfootTarget; chains[2] = &mLfootIKchain;
+		targets[3] = mRfootTarget; chains[3] = &mRfootIKchain;
+		computeFABRIKIK(4, targets, chains);
+	}
+	else
+	{
+		computeFABRIKIK(target, getIKchain(endJointID, -1, &mIKSkeleton), &mIKSkeleton);
+	}
+
+	// solveBatch updates and copies back once all of its targets are solved
+	if (mInBatch) return true;
+
+	// update IK Skeleton transforms
+	mIKSkeleton.update();
+
+	// copy IK skeleton transforms to main skeleton
+	m_pSkeleton->copyTransforms(&mIKSkeleton);
+
+	return true;
+}
+
+int IKController::computeFABRIKIK(ATarget target, AIKchain& IKchain, ASkeleton* /*pIKSkeleton*/)
+{
+	AIKchain* chains[1] = { &IKchain };
+	return computeFABRIKIK(1, &target, chains);
+}
+
+int IKController::computeFABRIKIK(int numChains, const ATarget* targets, AIKchain** IKchains)
+{
+	// FABRIK on the tree formed by the joints of all chains, stored as flat arrays ordered parents first.
+	// An iteration pulls every end joint onto its target and moves each joint towards its children, averaging over
+	// branches (forward pass), then pins the chain bases and restores the bone lengths outwards (backward pass).
+	// Joints rotate to follow the new bone directions, and the next iteration starts from the resulting pose, so
+	// joints with several children (a spine carrying both shoulders) settle on a compromise rotation.
+	// Returns the number of iterations
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	AJoint* joints[MaxFABRIKJoints];
+	int depths[MaxFABRIKJoints];
+	int numJoints = 0;
+	for (int c = 0; c < numChains; c++)
+	{
+		std::vector<AJoint*>& chain = IKchains[c]->getChain();
+		for (int i = 0; i < chain.size() && numJoints < MaxFABRIKJoints; i++)
+		{
+			int n = 0;
+			while (n < numJoints && joints[n] != chain[i]) n++;
+			if (n < numJoints) continue;
+
+			// insertion by depth keeps parents ahead of their children
+			int depth = 0;
+			for (AJoint* pJoint = chain[i]->getParent(); pJoint; pJoint = pJoint->getParent()) depth++;
+			for (n = numJoints; n > 0 && depths[n - 1] > depth; n--)
+			{
+				joints[n] = joints[n - 1];
+				depths[n] = depths[n - 1];
+			}
+			joints[n] = chain[i];
+			depths[n] = depth;
+			numJoints++;
+		}
+	}
+	if (numJoints == 0) return 0;
+
+	int parents[MaxFABRIKJoints];
+	int effectors[MaxFABRIKJoints];
+	int numChildren[MaxFABRIKJoints];
+	double coneLimits[MaxFABRIKJoints];
+	double lengths[MaxFABRIKJoints];
+	mat3 localRotations[MaxFABRIKJoints];
+	vec3 localTranslations[MaxFABRIKJoints];
+	mat3 rotations[MaxFABRIKJoints];
+	vec3 positions[MaxFABRIKJoints];     // pose positions
+	vec3 solved[MaxFABRIKJoints];        // FABRIK positions
+	vec3 restDirections[MaxFABRIKJoints]; // unit bone directions in the incoming pose, for the cone limits
+	vec3 sums[MaxFABRIKJoints];
+
+	for (int n = 0; n < numJoints; n++)
+	{
+		parents[n] = -1;
+		for (int p = n - 1; p >= 0; p--)
+		{
+			if (joints[p] == joints[n]->getParent()) { parents[n] = p; break; }
+		}
+		effectors[n] = -1;
+		numChildren[n] = 0;
+		coneLimits[n] = -1.0;
+		localRotations[n] = joints[n]->getLocalRotation();
+		localTranslations[n] = joints[n]->getLocalTranslation();
+		lengths[n] = localTranslations[n].Length();
+		if (parents[n] >= 0) numChildren[parents[n]]++;
+	}
+	for (int c = numChains - 1; c >= 0; c--)
+	{
+		std::vector<AJoint*>& chain = IKchains[c]->getChain();
+		std::vector<double>& limits = IKchains[c]->getConeLimits();
+		for (int n = 0; n < numJoints; n++)
+		{
+			if (!chain.empty() && joints[n] == chain[0]) effectors[n] = c;
+			for (int i = 0; i < limits.size() && i < chain.size(); i++)
+			{
+				if (joints[n] == chain[i] && limits[i] >= 0.0) coneLimits[n] = limits[i];
+			}
+		}
+	}
+
+	// chain bases hang from joints outside the solve, which stay where they are
+	mat3 baseRotations[MaxFABRIKJoints];
+	for (int n = 0; n < numJoints; n++)
+	{
+		int p = parents[n];
+		if (p >= 0)
+		{
+			positions[n] = positions[p] + rotations[p] * localTranslations[n];
+			rotations[n] = rotations[p] * localRotations[n];
+			continue;
+		}
+		AJoint* pParent = joints[n]->getParent();
+		baseRotations[n] = pParent ? pParent->getGlobalRotation() : IdentityMat3;
+		vec3 parentPosition = pParent ? pParent->getGlobalTranslation() : vec3(0, 0, 0);
+		positions[n] = parentPosition + baseRotations[n] * localTranslations[n];
+		rotations[n] = baseRotations[n] * localRotations[n];
+	}
+	for (int n = 0; n < numJoints; n++)
+	{
+		int p = parents[n];
+		restDirections[n] = p >= 0 && lengths[n] > 1e-12 ? (positions[n] - positions[p]) / lengths[n] : vec3(0, 0, 0);
+	}
+
+	double error = 0.0;
+	for (int n = 0; n < numJoints; n++)
+	{
+		if (effectors[n] >= 0) error = std::max(error, (targets[effectors[n]].getGlobalTranslation() - positions[n]).Length());
+	}
+
+	int iteration = 0;
+	bool outOfTime = false;
+	while (error > gIKEpsilon && iteration < gIKmaxFABRIKIterations)
+	{
+		if (iteration > 0 && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() > gIKFABRIKTimeBudgetMs)
+		{
+			outOfTime = true;
+			break;
+		}
+
+		// forward: end joints onto their targets, every other joint at the mean of what its children ask for
+		for (int n = 0; n < numJoints; n++)
+		{
+			solved[n] = positions[n];
+			sums[n] = vec3(0, 0, 0);
+		}
+		for (int n = numJoints - 1; n >= 0; n--)
+		{
+			if (effectors[n] >= 0) solved[n] = targets[effectors[n]].getGlobalTranslation();
+			else if (numChildren[n] > 0) solved[n] = sums[n] / numChildren[n];
+
+			int p = parents[n];
+			if (p < 0) continue;
+			vec3 dir = solved[p] - solved[n];
+			double length = dir.Length();
+			if (length > 1e-12) dir = dir * (lengths[n] / length);
+			sums[p] += solved[n] + dir;
+		}
+
+		// backward: bases back in place, bone lengths and cone limits outwards
+		for (int n = 0; n < numJoints; n++)
+		{
+			int p = parents[n];
+			if (p < 0)
+			{
+				solved[n] = positions[n];
+				continue;
+			}
+			vec3 dir = solved[n] - solved[p];
+			if (coneLimits[p] >= 0.0)
+			{
+				// the rest direction swings along with the parent bone
+				int pp = parents[p];
+				vec3 ref = restDirections[n];
+				if (pp >= 0) ref = RotationBetween(restDirections[p], solved[p] - solved[pp]).ToRotation() * ref;
+				dir = ClampToCone(dir, ref, coneLimits[p]);
+			}
+			double length = dir.Length();
+			solved[n] = solved[p] + (length > 1e-12 ? dir * (lengths[n] / length) : positions[n] - positions[p]);
+		}
+
+		// rotate every joint so its bones point at the solved child positions, and recompute the pose
+		for (int n = 0; n < numJoints; n++)
+		{
+			int p = parents[n];
+			const mat3& parentRotation = p >= 0 ? rotations[p] : baseRotations[n];
+			if (p >= 0) positions[n] = positions[p] + parentRotation * localTranslations[n];
+			rotations[n] = parentRotation * localRotations[n];
+			if (numChildren[n] == 0) continue;
+
+			quat sum(0, 0, 0, 0);
+			for (int c = n + 1; c < numJoints; c++)
+			{
+				if (parents[c] != n) continue;
+				quat delta = RotationBetween(rotations[n] * localTranslations[c], solved[c] - positions[n]);
+				if (quat::Dot(sum, delta) < 0.0) delta = -delta;
+				sum += delta * lengths[c];
+			}
+			if (sum.Length() < 1e-12) continue;
+			// applied in the parent frame so rounding errors do not build up along the chain
+			sum.Normalize();
+			vec3 axis(sum.X(), sum.Y(), sum.Z());
+			double angle = 2.0 * atan2(axis.Length(), sum.W());
+			if (angle < 1e-12) continue;
+			localRotations[n] = mat3::Rotation3D(parentRotation.Transpose() * axis, angle) * localRotations[n];
+			rotations[n] = parentRotation * localRotations[n];
+		}
+
+		error = 0.0;
+		for (int n = 0; n < numJoints; n++)
+		{
+			if (effectors[n] >= 0) error = std::max(error, (targets[effectors[n]].getGlobalTranslation() - positions[n]).Length());
+		}
+		iteration++;
+	}
+
+	for (int n = 0; n < numJoints; n++)
+	{
+		joints[n]->setLocalRotation(localRotations[n]);
+	}
+
+	if (mInstrumented)
+	{
+		ExitReason reason = error <= gIKEpsilon ? EXIT_CONVERGED : outOfTime ? EXIT_TIME_BUDGET : EXIT_MAX_ITERATIONS;
+		recordSolve(FABRIK, IKchains[0]->getSize() ? IKchains[0]->getJoint(0)->getID() : -1, iteration, error, reason,
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+	return iteration;
+}
+
+bool IKController::computeFootIK(const ATransform& guide, const AHeightField& terrain, bool rotateLeft, bool rotateRight, ASkeleton* pSkeleton)
+{
+	AJoint* pRoot = pSkeleton->getRootNode();
+	AIKchain* legs[2] = { &getIKchain(mLfootID, 3, pSkeleton), &getIKchain(mRfootID, 3, pSkeleton) };
+	if (!pRoot || legs[0]->getSize() != 3 || legs[1]->getSize() != 3) return false;
+	bool rotateFoot[2] = { rotateLeft, rotateRight };
+	const mat3& guideRotation = guide.m_rotation;
+	mat3 toSkeleton = guideRotation.Transpose();
+
+	// the clip is authored on flat ground, so each foot keeps its height above the ground by moving up by the
+	// height of the terrain under it relative to the ground plane of the guide
+	vec3 targets[2], normals[2];
+	mat3 footRotations[2];
+	double lifts[2];
+	for (int leg = 0; leg < 2; leg++)
+	{
+		vec3 position;
+		JointFK(legs[leg]->getJoint(0), footRotations[leg], position);
+		vec3 foot = guide.m_translation + guideRotation * position;
+		float height = terrain.sample((float)foot[0], (float)foot[2], normals[leg]);
+		lifts[leg] = height + position[1] - foot[1];
+		targets[leg] = position + toSkeleton * vec3(0, lifts[leg], 0);
+		normals[leg] = toSkeleton * normals[leg];
+	}
+
+	// the lower foot sets the root, so the other leg bends instead of stretching past its length
+	double rootLift = std::min(lifts[0], lifts[1]);
+	pRoot->setLocalTranslation(pRoot->getLocalTranslation() + toSkeleton * vec3(0, rootLift, 0));
+
+	for (int leg = 0; leg < 2; leg++)
+	{
+		// chain joints 0, 1, 2 are the foot, knee and hip
+		mat3 localRotations[3], rotations[3];
+		vec3 localTranslations[3], positions[3];
+		for (int i = 0; i < 3; i++)
+		{
+			localRotations[i] = legs[leg]->getJoint(i)->getLocalRotation();
+			localTranslations[i] = legs[leg]->getJoint(i)->getLocalTranslation();
+		}
+		mat3 parentRotation;
+		vec3 parentPosition;
+		JointFK(legs[leg]->getJoint(2)->getParent(), parentRotation, parentPosition);
+		ComputeChainFK(3, parentRotation, parentPosition, localRotations, localTranslations, rotations, positions);
+
+		// knee: the angle between thigh and shin that puts the foot at the distance of the target from the hip
+		vec3 thigh = positions[2] - positions[1];
+		vec3 shin = positions[0] - positions[1];
+		double thighLength = thigh.Length(), shinLength = shin.Length();
+		if (thighLength < 1e-6 || shinLength < 1e-6) continue;
+		double distance = (targets[leg] - positions[2]).Length();
+		double cosDesired = (thighLength * thighLength + shinLength * shinLength - distance * distance) / (2 * thighLength * shinLength);
+		double cosCurrent = (thigh * shin) / (thighLength * shinLength);
+		double angle = acos(std::min(std::max(cosDesired, -1.0), 1.0)) - acos(std::min(std::max(cosCurrent, -1.0), 1.0));
+		// turning the shin about thigh x shin opens the knee; a straight leg bends about the knee hinge (x axis)
+		vec3 axis = thigh ^ shin;
+		if (axis.Length() < 1e-9 * thighLength * shinLength) axis = rotations[1] * axisX;
+		localRotations[1] = mat3::Rotation3D(rotations[2].Transpose() * axis, angle) * localRotations[1];
+		ComputeChainFK(3, parentRotation, parentPosition, localRotations, localTranslations, rotations, positions);
+
+		// hip: swing the leg so the foot lies on the line from the hip to the target
+		RotateJointOnto(localRotations[2], parentRotation, positions[0] - positions[2], targets[leg] - positions[2]);
+
+		// foot: keeps its global rotation of the clip, tilted by the rotation taking the flat ground up axis onto
+		// the terrain normal
+		ComputeChainFK(3, parentRotation, parentPosition, localRotations, localTranslations, rotations, positions);
+		if (rotateFoot[leg]) RotateJointOnto(footRotations[leg], IdentityMat3, axisY, normals[leg]);
+		localRotations[0] = rotations[1].Transpose() * footRotations[leg];
+
+		for (int i = 0; i < 3; i++)
+		{
+			legs[leg]->getJoint(i)->setLocalRotation(localRotations[i]);
+		}
+	}
+	return true;
+}
+
+int IKController::runLimbIK(const ATarget& target, AIKchain& IKchain, const vec3& axis)
+{
+	if (!mInstrumented) return computeLimbIK(target, IKchain, axis, &mIKSkeleton);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int iterations = computeLimbIK(target, IKchain, axis, &mIKSkeleton);
+	double timeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	if (IKchain.getSize() == 0)
+	{
+		recordSolve(LIMB, -1, 0, 0.0, EXIT_INVALID_CHAIN, timeMs);
+		return iterations;
+	}
+	double error = (target.getGlobalTranslation() - ChainEndPosition(IKchain)).Length();
+	recordSolve(LIMB, IKchain.getJoint(0)->getID(), iterations, error, error <= gIKEpsilon ? EXIT_CONVERGED : EXIT_MAX_ITERATIONS, timeMs);
+	return iterations;
+}
+
+int IKController::runCCDIK(const ATarget& target, AIKchain& IKchain)
+{
+	if (!mInstrumented) return computeCCDIK(target, IKchain, &mIKSkeleton);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int iterations = computeCCDIK(target, IKchain, &mIKSkeleton);
+	double timeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	if (IKchain.getSize() == 0)
+	{
+		recordSolve(CCD, -1, 0, 0.0, EXIT_INVALID_CHAIN, timeMs);
+		return iterations;
+	}
+	double error = (target.getGlobalTranslation() - ChainEndPosition(IKchain)).Length();
+	recordSolve(CCD, IKchain.getJoint(0)->getID(), iterations, error, error <= gIKEpsilon ? EXIT_CONVERGED : EXIT_MAX_ITERATIONS, timeMs);
+	return iterations;
+}
+
+// Log2 histogram bin: 0 for values under 1, i for [2^(i-1), 2^i), clamped to the last bin
+static int GetHistogramBin(double value, int numBins)
+{
+	int bin = 0;
+	for (double limit = 1.0; value >= limit && bin < numBins - 1; limit *= 2.0) bin++;
+	return bin;
+}
+
+void IKController::recordSolve(IKType type, int endJointID, int iterations, double error, ExitReason reason, double timeMs)
+{
+	SolverStats& stats = mStats[type];
+	stats.numSolves++;
+	stats.numExits[reason]++;
+	stats.numIterations += iterations;
+	stats.totalTimeMs += timeMs;
+	stats.maxTimeMs = std::max(stats.maxTimeMs, timeMs);
+	stats.timeHistogram[GetHistogramBin(timeMs * 1000.0, NumHistogramBins)]++;
+	stats.iterationHistogram[GetHistogramBin(iterations, NumHistogramBins)]++;
+	stats.last.endJointID = endJointID;
+	stats.last.iterations = iterations;
+	stats.last.error = error;
+	stats.last.reason = reason;
+	stats.last.timeMs = timeMs;
+}
+
+void IKController::resetStats()
+{
+	for (int i = 0; i < NumIKTypes; i++)
+	{
+		SolverStats& stats = mStats[i];
+		stats.numSolves = 0;
+		for (int r = 0; r < NUM_EXIT_REASONS; r++) stats.numExits[r] = 0;
+		stats.numIterations = 0;
+		stats.totalTimeMs = 0.0;
+		stats.maxTimeMs = 0.0;
+		for (int b = 0; b < NumHistogramBins; b++)
+		{
+			stats.timeHistogram[b] = 0;
+			stats.iterationHistogram[b] = 0;
+		}
+		stats.last.endJointID = -1;
+		stats.last.iterations = 0;
+		stats.last.error = 0.0;
+		stats.last.reason = EXIT_CONVERGED;
+		stats.last.timeMs = 0.0;
+	}
+}
+
+const char* IKController::GetExitReasonName(ExitReason reason)
+{
+	switch (reason)
+	{
+	case EXIT_CONVERGED: return "converged";
+	case EXIT_MAX_ITERATIONS: return "max iterations";
+	case EXIT_TIME_BUDGET: return "time budget";
+	case EXIT_INVALID_CHAIN: return "invalid chain";
+	default: return "unknown";
+	}
 }
\ No newline at end of file
@@ -4,11 +4,13 @@
 #pragma once
 
 
+#include <map>
 #include "aJoint.h"
 #include "aSkeleton.h"
 #include "aTarget.h"
 
 class AActor;  // forward declaration since IKController class references AActor and AActor class references IKController
+class AHeightField;
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -31,10 +33,22 @@ public:
 	std::vector<AJoint*>& getChain();
 	void setChain(std::vector<AJoint*> chain);
 
+	// FABRIK swing limit of chain joint index in radians: the largest angle between the bone from the joint to
+	// the previous chain joint and that bone's direction in the incoming pose, carried along by the parent bone.
+	// Empty or negative means unconstrained
+	std::vector<double>& getConeLimits();
+	void setConeLimit(int index, double angleRad);
+	void setConeLimits(std::vector<double> limits);
+
+	// local rotations of the chain joints after the last solve, empty until then; used to warm-start the next solve
+	std::vector<mat3>& getLastSolution();
+
 protected:
 	std::vector<AJoint*> mChain;
 	std::vector<double> mWeights;
 	double mWeight0;
+	std::vector<double> mConeLimits;
+	std::vector<mat3> mLastSolution;
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -57,18 +71,72 @@ public:
 	bool IKSolver_Limb(int endJointID, const ATarget& target);
 	bool IKSolver_CCD(int endJointID, const ATarget& target);
 	bool IKSolver_PseudoInv(int endJointID, const ATarget& target);
+	bool IKSolver_FABRIK(int endJointID, const ATarget& target);
+
+	enum IKType { LIMB, CCD, PSEDUOINV, FABRIK };
+
+	// Solves several end joints with one copy into the IK skeleton and one update and copy back, instead of one
+	// per IKSolver_* call. Targets are solved in order without updating the IK skeleton in between, so each should
+	// move a chain whose base is not moved by the earlier ones (the hands and feet of the default chains)
+	bool solveBatch(IKType type, int numTargets, const int* endJointIDs, const vec3* targetPositions);
 	bool IKSolver_Other(int endJointID, const ATarget& target);
 
 	int createLimbIKchains();
 	int createCCDIKchains();
 
 	AIKchain createIKchain(int endJointID, int desiredChainSize, ASkeleton* pSkeleton);
+	// Chain kept per (end joint, desired size, skeleton) and rebuilt only when the hierarchy version of the
+	// skeleton changes; the reference stays valid for the lifetime of the controller
+	AIKchain& getIKchain(int endJointID, int desiredChainSize, ASkeleton* pSkeleton);
 
 	int computeLimbIK(ATarget target, AIKchain& IKchain, const vec3 axis, ASkeleton* pIKSkeleton);
 	int computeCCDIK(ATarget target, AIKchain&, ASkeleton* pIKSkeleton);
+	int computeDLSIK(ATarget target, AIKchain& IKchain, ASkeleton* pIKSkeleton);
+	int computeFABRIKIK(ATarget target, AIKchain& IKchain, ASkeleton* pIKSkeleton);
+	// Solves several chains at once; chains may share joints (e.g. both hands down to the spine),
+	// the end joint of IKchains[i] is pulled to targets[i]
+	int computeFABRIKIK(int numChains, const ATarget* targets, AIKchain** IKchains);
+
+	// Places the feet of pSkeleton on the terrain: the root is lowered by the larger drop of the ground under the
+	// two feet, each leg is bent with two-bone IK so its foot keeps its clip height above the ground, and the feet
+	// keep their clip orientation, tilted onto the ground normal if rotateLeft / rotateRight. guide takes the
+	// skeleton to world space. Joint positions come from the local transforms, so pSkeleton does not need to be
+	// updated before or after. Return false if a leg chain is invalid
+	bool computeFootIK(const ATransform& guide, const AHeightField& terrain, bool rotateLeft, bool rotateRight, ASkeleton* pSkeleton);
+
+	// Instrumentation, off by default. While on, every chain solve is timed and recorded per solver type;
+	// while off the solvers skip all of it
+	enum ExitReason { EXIT_CONVERGED, EXIT_MAX_ITERATIONS, EXIT_TIME_BUDGET, EXIT_INVALID_CHAIN, NUM_EXIT_REASONS };
+	static const int NumIKTypes = FABRIK + 1;
+	static const int NumHistogramBins = 16;
+
+	struct SolveInfo
+	{
+		int endJointID;
+		int iterations;
+		double error;       // largest end joint distance to its target after the solve
+		ExitReason reason;
+		double timeMs;
+	};
+	struct SolverStats
+	{
+		int numSolves;
+		int numExits[NUM_EXIT_REASONS];
+		long long numIterations;
+		double totalTimeMs;
+		double maxTimeMs;
+		int timeHistogram[NumHistogramBins];       // bin 0: under 1 us, bin i: [2^(i-1), 2^i) us, last bin open
+		int iterationHistogram[NumHistogramBins];  // bin 0: no iteration, bin i: [2^(i-1), 2^i), last bin open
+		SolveInfo last;
+	};
+
+	void setInstrumentation(bool enabled) { mInstrumented = enabled; }
+	bool isInstrumented() const { return mInstrumented; }
+	const SolverStats& getStats(IKType type) const { return mStats[type]; }
+	void resetStats();
+	static const char* GetExitReasonName(ExitReason reason);
 
 	enum EndJointIndex { ROOT, LHAND, RHAND, LFOOT, RFOOT } mEndJointIndex;
-	enum IKType { LIMB, CCD, PSEDUOINV };
 
 	// End Joint IDs
 	// assumes skeleton structure associated with beta character
@@ -87,12 +155,28 @@ protected:
 	bool mValidChain = true;
 	bool mvalidLimbIKchains;
 	bool mvalidCCDIKchains;
+	unsigned int mLimbIKchainsVersion;  // mIKSkeleton hierarchy version the limb/CCD chains were created from
+	unsigned int mCCDIKchainsVersion;
+	bool mInBatch;  // set by solveBatch: the solvers neither copy into nor out of mIKSkeleton
 
     AIKchain mRhandIKchain; // IK chain of joint pointers starting with Rhand joint 
 	AIKchain mLhandIKchain; // IK chain of joint pointers starting with Lhand joint     
 	AIKchain mRfootIKchain; // IK chain of joint pointers starting with Rfoot joint 
 	AIKchain mLfootIKchain; // IK chain of joint pointers starting with Lfoot joint 
-	AIKchain mIKchain;  // IK chain of joint pointers starting with end joint 
+
+	struct IKchainKey
+	{
+		const ASkeleton* skeleton;
+		int endJointID;
+		int chainSize;
+		bool operator<(const IKchainKey& key) const;
+	};
+	struct CachedIKchain
+	{
+		unsigned int hierarchyVersion;
+		AIKchain chain;
+	};
+	std::map<IKchainKey, CachedIKchain> mIKchainCache;  // chains for other end joints, see getIKchain
 
     int mEndJointID = -1;
     int mChainSize = -1;
@@ -118,9 +202,31 @@ protected:
 	// CCD IK variables
 	double mWeight0;
 
+	// limb and CCD solves with instrumentation; the error is read from the end joint of the chain
+	int runLimbIK(const ATarget& target, AIKchain& IKchain, const vec3& axis);
+	int runCCDIK(const ATarget& target, AIKchain& IKchain);
+	void recordSolve(IKType type, int endJointID, int iterations, double error, ExitReason reason, double timeMs);
+
+	bool mInstrumented;
+	SolverStats mStats[NumIKTypes];
+
 public:
     static double gIKEpsilon;
     static int gIKmaxIterations;
+
+	static double gIKTimeBudgetMs;   // per computeDLSIK call; at least one iteration always runs
+
+	// Damped least squares IK
+	static const int MaxDLSChainSize = 64;  // longer chains are solved over their first MaxDLSChainSize joints
+	static int gIKmaxDLSIterations;
+	static double gIKDamping;        // damping factor relative to the length of the chain
+
+	// FABRIK
+	static const int MaxFABRIKJoints = 128; // joints beyond this many (over all chains of a solve) are left out
+	// Cold-started solves of 8-40 joint chains need up to about 160 iterations and 5 ms (99th percentile), two
+	// hands on a shared spine about 210 iterations and 2 ms; the defaults let those converge
+	static int gIKmaxFABRIKIterations;
+	static double gIKFABRIKTimeBudgetMs;  // per computeFABRIKIK call; at least one iteration always runs
 };
 
 #endif
\ No newline at end of file
@@ -1,14 +1,35 @@
 #pragma once
 
 #include "aJitter.h"
+#include <atomic>
+
+// every thread gets its own stream, in the order the threads first draw, so nothing is shared or locked
+static ARandom& ThreadRandom()
+{
+    static std::atomic<unsigned int> numStreams(0);
+    thread_local ARandom random(0, numStreams++);
+    return random;
+}
 
 double AJitterVal(const AJitter& range)
 {
-    double x = ((double)rand()) / RAND_MAX;
-    return range.first + x * (range.second - range.first);
+    return AJitterVal(range, ThreadRandom());
 }
 
 vec3 AJitterVec(const AJitter& range)
 {
-    return vec3(AJitterVal(range), AJitterVal(range), AJitterVal(range));
+    return AJitterVec(range, ThreadRandom());
+}
+
+double AJitterVal(const AJitter& range, ARandom& random)
+{
+    return random.nextDouble(range.first, range.second);
+}
+
+vec3 AJitterVec(const AJitter& range, ARandom& random)
+{
+    double x = AJitterVal(range, random);
+    double y = AJitterVal(range, random);
+    double z = AJitterVal(range, random);
+    return vec3(x, y, z);
 }
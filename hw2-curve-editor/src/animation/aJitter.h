@@ -1,6 +1,11 @@
 #pragma once
 #include "aVector.h"
+#include "aRandom.h"
 
 typedef std::pair<double, double> AJitter; // min, max 
+// drawn from a generator of the calling thread
 extern double AJitterVal(const AJitter& range);
 extern vec3 AJitterVec(const AJitter& range);
+// drawn from random, for reproducible jitter
+extern double AJitterVal(const AJitter& range, ARandom& random);
+extern vec3 AJitterVec(const AJitter& range, ARandom& random);
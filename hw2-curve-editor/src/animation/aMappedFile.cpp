@@ -0,0 +1,111 @@
+#include "aMappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#pragma warning(disable : 4018)
+
+#ifdef _WIN32
+
+AMappedFile::AMappedFile() : mData(NULL), mSize(0), mFile(INVALID_HANDLE_VALUE), mMapping(NULL)
+{
+}
+
+bool AMappedFile::open(const std::string& filename)
+{
+	close();
+
+	mFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (mFile == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mMapping)
+	{
+		close();
+		return false;
+	}
+
+	mData = static_cast<const char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	if (!mData)
+	{
+		close();
+		return false;
+	}
+	mSize = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void AMappedFile::close()
+{
+	if (mData) UnmapViewOfFile(mData);
+	if (mMapping) CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE) CloseHandle(mFile);
+	mData = NULL;
+	mSize = 0;
+	mMapping = NULL;
+	mFile = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+AMappedFile::AMappedFile() : mData(NULL), mSize(0), mFile(-1)
+{
+}
+
+bool AMappedFile::open(const std::string& filename)
+{
+	close();
+
+	mFile = ::open(filename.c_str(), O_RDONLY);
+	if (mFile < 0) return false;
+
+	struct stat fileStat;
+	if (fstat(mFile, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		close();
+		return false;
+	}
+
+	void* data = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, mFile, 0);
+	if (data == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	madvise(data, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+	mData = static_cast<const char*>(data);
+	mSize = (size_t)fileStat.st_size;
+	return true;
+}
+
+void AMappedFile::close()
+{
+	if (mData) munmap(const_cast<char*>(mData), mSize);
+	if (mFile >= 0) ::close(mFile);
+	mData = NULL;
+	mSize = 0;
+	mFile = -1;
+}
+
+#endif
+
+AMappedFile::~AMappedFile()
+{
+	close();
+}
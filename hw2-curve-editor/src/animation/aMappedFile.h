@@ -0,0 +1,38 @@
+#ifndef AMAPPEDFILE_H_
+#define AMAPPEDFILE_H_
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file (CreateFileMapping on Windows, mmap elsewhere).
+// The contents stay valid until close() or destruction.
+class AMappedFile
+{
+public:
+	AMappedFile();
+	virtual ~AMappedFile();
+
+	bool open(const std::string& filename);
+	void close();
+
+	bool isOpen() const { return mData != NULL; }
+	const char* data() const { return mData; }
+	size_t size() const { return mSize; }
+
+private:
+	AMappedFile(const AMappedFile&);
+	AMappedFile& operator=(const AMappedFile&);
+
+	const char* mData;
+	size_t mSize;
+#ifdef _WIN32
+	void* mFile;
+	void* mMapping;
+#else
+	int mFile;
+#endif
+};
+
+#endif
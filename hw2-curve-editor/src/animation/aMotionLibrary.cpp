@@ -0,0 +1,164 @@
+#include "aMotionLibrary.h"
+#include "aBVHController.h"
+#include <cassert>
+
+#pragma warning(disable : 4018)
+
+static std::string GetClipName(const std::string& filename)
+{
+	size_t start = filename.find_last_of("/\\");
+	start = start == std::string::npos ? 0 : start + 1;
+	size_t end = filename.find_last_of('.');
+	if (end == std::string::npos || end < start) end = filename.size();
+	return filename.substr(start, end - start);
+}
+
+static bool SameHierarchy(const std::vector<ABVHJoint>& a, const std::vector<ABVHJoint>& b)
+{
+	if (a.size() != b.size()) return false;
+	for (unsigned int i = 0; i < a.size(); i++)
+	{
+		if (a[i].parent != b[i].parent || a[i].numChannels != b[i].numChannels ||
+			a[i].firstChannel != b[i].firstChannel || a[i].offset != b[i].offset ||
+			a[i].name != b[i].name || a[i].channels != b[i].channels) return false;
+	}
+	return true;
+}
+
+AMotionLibrary::AMotionLibrary() : mNumFinished(0), mNumFailed(0), mPool(NULL)
+{
+}
+
+AMotionLibrary::~AMotionLibrary()
+{
+	clear();
+	delete mPool;
+}
+
+void AMotionLibrary::load(const std::vector<std::string>& filenames, int firstClip, int numThreads)
+{
+	if (!mPool) mPool = new AThreadPool(numThreads);
+
+	int first = mClips.size();
+	for (unsigned int i = 0; i < filenames.size(); i++)
+	{
+		Entry* entry = new Entry();
+		entry->clip.name = GetClipName(filenames[i]);
+		entry->clip.filename = filenames[i];
+		entry->clip.skeleton = NULL;
+		entry->clip.dt = 0.0;
+		entry->clip.numFrames = 0;
+		entry->state = CLIP_QUEUED;
+		mClips.push_back(entry);
+	}
+
+	// the pool runs tasks in FIFO order, so firstClip is picked up by the first free worker
+	if (firstClip >= 0 && firstClip < filenames.size())
+	{
+		Entry* entry = mClips[first + firstClip];
+		mPool->run([this, entry] { loadEntry(entry); });
+	}
+	for (unsigned int i = 0; i < filenames.size(); i++)
+	{
+		if (i == firstClip) continue;
+		Entry* entry = mClips[first + i];
+		mPool->run([this, entry] { loadEntry(entry); });
+	}
+}
+
+void AMotionLibrary::clear()
+{
+	if (mPool)
+	{
+		mPool->cancel();
+		mPool->wait();
+	}
+	for (unsigned int i = 0; i < mClips.size(); i++)
+	{
+		delete mClips[i];
+	}
+	for (unsigned int i = 0; i < mSkeletons.size(); i++)
+	{
+		delete mSkeletons[i];
+	}
+	mClips.clear();
+	mSkeletons.clear();
+	mNumFinished = 0;
+	mNumFailed = 0;
+}
+
+void AMotionLibrary::wait()
+{
+	if (mPool) mPool->wait();
+}
+
+float AMotionLibrary::getProgress() const
+{
+	return mClips.empty() ? 1.0f : (float)getNumFinished() / mClips.size();
+}
+
+AMotionLibrary::ClipState AMotionLibrary::getClipState(int clipID) const
+{
+	assert(clipID >= 0 && clipID < mClips.size());
+	return (ClipState)mClips[clipID]->state.load();
+}
+
+const AMotionClip* AMotionLibrary::getClip(int clipID) const
+{
+	if (clipID < 0 || clipID >= mClips.size()) return NULL;
+	Entry* entry = mClips[clipID];
+	return entry->state.load() == CLIP_LOADED ? &entry->clip : NULL;
+}
+
+int AMotionLibrary::findClip(const std::string& name) const
+{
+	for (unsigned int i = 0; i < mClips.size(); i++)
+	{
+		if (mClips[i]->clip.name == name) return i;
+	}
+	return -1;
+}
+
+int AMotionLibrary::getNumSkeletons()
+{
+	std::lock_guard<std::mutex> lock(mSkeletonMutex);
+	return mSkeletons.size();
+}
+
+void AMotionLibrary::loadEntry(Entry* entry)
+{
+	// parsing and conversion run without any lock; only the skeleton lookup is shared
+	ABVHData data;
+	AMotionClip& clip = entry->clip;
+	bool ok = ABVHParser::Load(clip.filename, data) && !data.joints.empty();
+	if (ok)
+	{
+		BVHController::ConvertMotion(data, clip.rootTranslations, clip.rotationKeys);
+		clip.dt = data.dt;
+		clip.numFrames = data.numFrames;
+		clip.skeleton = findSkeleton(data);
+	}
+
+	// the state store publishes the clip to getClip
+	entry->state = ok ? CLIP_LOADED : CLIP_FAILED;
+	if (!ok) mNumFailed++;
+	mNumFinished++;
+}
+
+const AMotionSkeleton* AMotionLibrary::findSkeleton(const ABVHData& data)
+{
+	std::lock_guard<std::mutex> lock(mSkeletonMutex);
+	for (unsigned int i = 0; i < mSkeletons.size(); i++)
+	{
+		if (mSkeletons[i]->numChannels == data.numChannels && SameHierarchy(mSkeletons[i]->joints, data.joints))
+		{
+			return mSkeletons[i];
+		}
+	}
+
+	AMotionSkeleton* skeleton = new AMotionSkeleton();
+	skeleton->joints = data.joints;
+	skeleton->numChannels = data.numChannels;
+	mSkeletons.push_back(skeleton);
+	return skeleton;
+}
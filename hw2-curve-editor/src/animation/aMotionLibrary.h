@@ -0,0 +1,84 @@
+#ifndef AMOTIONLIBRARY_H_
+#define AMOTIONLIBRARY_H_
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "aBVHParser.h"
+#include "aThreadPool.h"
+
+// Hierarchy shared by every clip of a library with the same joints, offsets and channel layout
+struct AMotionSkeleton
+{
+	std::vector<ABVHJoint> joints;
+	int numChannels;
+};
+
+// Clip converted to the BVHController playback layout, ready for BVHController::loadClip
+struct AMotionClip
+{
+	std::string name;                    // file name without directory and extension
+	std::string filename;
+	const AMotionSkeleton* skeleton;     // owned by the library
+	double dt;
+	int numFrames;
+	std::vector<float> rootTranslations; // x, y, z per frame
+	std::vector<float> rotationKeys;     // x, y, z, w per joint, one row per frame
+};
+
+// Loads many BVH files in parallel into one store of clips and deduplicated skeletons.
+// Files are parsed and converted on worker threads; the caller polls the progress and can play
+// any clip as soon as it is loaded while the rest are still loading
+class AMotionLibrary
+{
+public:
+	enum ClipState { CLIP_QUEUED, CLIP_LOADED, CLIP_FAILED };
+
+	AMotionLibrary();
+	virtual ~AMotionLibrary();
+
+	// Adds the files to the library and returns immediately. firstClip (an index into filenames) is loaded first.
+	// numThreads <= 0 uses one thread per hardware thread; it only applies to the first call
+	void load(const std::vector<std::string>& filenames, int firstClip = 0, int numThreads = 0);
+	// Drops the pending files and removes every clip and skeleton; clip pointers become invalid
+	void clear();
+	// Blocks until every file has been loaded or has failed
+	void wait();
+
+	int getNumClips() const { return (int)mClips.size(); }
+	int getNumFinished() const { return mNumFinished; } // loaded or failed
+	int getNumFailed() const { return mNumFailed; }
+	bool isLoading() const { return getNumFinished() < getNumClips(); }
+	float getProgress() const;
+
+	ClipState getClipState(int clipID) const;
+	// NULL until the clip is loaded. A loaded clip is never modified, so it can be read without locking
+	const AMotionClip* getClip(int clipID) const;
+	int findClip(const std::string& name) const;
+
+	int getNumSkeletons();
+
+protected:
+	struct Entry
+	{
+		AMotionClip clip;
+		std::atomic<int> state;
+	};
+
+	void loadEntry(Entry* entry);
+	// Returns the stored skeleton with the same hierarchy or stores a new one (any thread)
+	const AMotionSkeleton* findSkeleton(const ABVHData& data);
+
+protected:
+	std::vector<Entry*> mClips;       // only changed by load and clear; workers hold their own entry
+	std::atomic<int> mNumFinished;
+	std::atomic<int> mNumFailed;
+	std::vector<AMotionSkeleton*> mSkeletons;
+	std::mutex mSkeletonMutex;
+	AThreadPool* mPool;
+};
+
+#endif
@@ -0,0 +1,379 @@
+#include "aMotionMatcher.h"
+#include "aRotation.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+#include <cassert>
+
+#pragma warning(disable : 4018)
+
+typedef std::chrono::steady_clock MatchClock;
+
+static const double TrajectoryTimes[AMotionMatcher::NumTrajectoryPoints] = { 1.0 / 3.0, 2.0 / 3.0, 1.0 };
+
+static AMotionMatcher::Group GetGroup(int dim)
+{
+	if (dim < AMotionMatcher::FEATURE_ROOT_VELOCITY) return AMotionMatcher::GROUP_FEET;
+	if (dim < AMotionMatcher::FEATURE_TRAJECTORY_POSITION) return AMotionMatcher::GROUP_VELOCITY;
+	if (dim < AMotionMatcher::FEATURE_TRAJECTORY_DIRECTION) return AMotionMatcher::GROUP_TRAJECTORY_POSITION;
+	return AMotionMatcher::GROUP_TRAJECTORY_DIRECTION;
+}
+
+static int FindJoint(const std::vector<ABVHJoint>& joints, const std::string& name)
+{
+	for (unsigned int i = 0; i < joints.size(); i++)
+	{
+		if (joints[i].name.find(name) != std::string::npos) return i;
+	}
+	return -1;
+}
+
+struct AMotionMatcher::Search
+{
+	float query[NUM_FEATURES];
+	float bestCost;
+	int bestRow;
+	int numLeaves;
+	long long numCandidates;
+	bool timedOut;
+	MatchClock::time_point deadline;
+};
+
+AMotionMatcher::AMotionMatcher() : mLeftFoot("LeftFoot"), mRightFoot("RightFoot"), mBuilt(false)
+{
+	for (int i = 0; i < NUM_GROUPS; i++) mWeights[i] = 1.0f;
+	resetStats();
+}
+
+AMotionMatcher::~AMotionMatcher()
+{
+}
+
+void AMotionMatcher::setFootJoints(const std::string& leftFoot, const std::string& rightFoot)
+{
+	mLeftFoot = leftFoot;
+	mRightFoot = rightFoot;
+}
+
+void AMotionMatcher::setWeight(Group group, float weight)
+{
+	assert(group >= 0 && group < NUM_GROUPS);
+	mWeights[group] = weight;
+}
+
+void AMotionMatcher::clear()
+{
+	mRaw.clear();
+	mClips.clear();
+	mData.clear();
+	mEntries.clear();
+	mNodes.clear();
+	mBuilt = false;
+}
+
+void AMotionMatcher::resetStats()
+{
+	mStats.numQueries = mStats.numTimeouts = 0;
+	mStats.totalTimeMs = mStats.maxTimeMs = 0.0;
+	mStats.numCandidates = 0;
+}
+
+bool AMotionMatcher::addClip(int clipID, const AMotionClip& clip)
+{
+	if (!clip.skeleton) return false;
+	const std::vector<ABVHJoint>& joints = clip.skeleton->joints;
+	int numJoints = joints.size();
+	int feet[2] = { FindJoint(joints, mLeftFoot), FindJoint(joints, mRightFoot) };
+	if (feet[0] < 0 || feet[1] < 0 || joints[0].parent >= 0) return false;
+
+	int horizon[NumTrajectoryPoints];
+	for (int k = 0; k < NumTrajectoryPoints; k++) horizon[k] = std::max(1, (int)(TrajectoryTimes[k] / clip.dt + 0.5));
+	int numIndexed = clip.numFrames - horizon[NumTrajectoryPoints - 1];
+	if (numIndexed <= 0) return false;
+
+	// joints from the root to each foot, root excluded
+	std::vector<int> chains[2];
+	for (int s = 0; s < 2; s++)
+	{
+		for (int j = feet[s]; j > 0; j = joints[j].parent) chains[s].push_back(j);
+		std::reverse(chains[s].begin(), chains[s].end());
+	}
+
+	// forward kinematics of the root and the feet, in world space
+	std::vector<vec3> rootPos(clip.numFrames), facing(clip.numFrames), footPos(2 * (size_t)clip.numFrames);
+	for (int f = 0; f < clip.numFrames; f++)
+	{
+		const float* keys = &clip.rotationKeys[4 * (size_t)f * numJoints];
+		const float* root = &clip.rootTranslations[3 * (size_t)f];
+		quat rootRot(keys[3], keys[0], keys[1], keys[2]);
+		rootPos[f] = vec3(root[0], root[1], root[2]);
+
+		vec3 forward = rootRot.ToRotation() * vec3(0, 0, 1);
+		forward[1] = 0.0;
+		facing[f] = forward.Length() > 1e-6 ? forward.Normalize() : vec3(0, 0, 1);
+
+		for (int s = 0; s < 2; s++)
+		{
+			quat rot = rootRot;
+			vec3 pos = rootPos[f];
+			for (unsigned int i = 0; i < chains[s].size(); i++)
+			{
+				int j = chains[s][i];
+				const float* key = keys + 4 * j;
+				pos = pos + rot.ToRotation() * joints[j].offset;
+				rot = rot * quat(key[3], key[0], key[1], key[2]);
+			}
+			footPos[2 * f + s] = pos;
+		}
+	}
+
+	ClipRange range = { clipID, numIndexed, getNumFrames() };
+	mClips.push_back(range);
+	mRaw.resize(mRaw.size() + (size_t)numIndexed * NUM_FEATURES);
+	float* row = &mRaw[(size_t)range.firstRow * NUM_FEATURES];
+	for (int f = 0; f < numIndexed; f++, row += NUM_FEATURES)
+	{
+		// facing frame of the character: +Z along the root heading, +X to its side, +Y up
+		const vec3& z = facing[f];
+		vec3 x(z[2], 0, -z[0]);
+		for (int s = 0; s < 2; s++)
+		{
+			vec3 d = footPos[2 * f + s] - rootPos[f];
+			float* foot = row + (s == 0 ? FEATURE_LEFT_FOOT : FEATURE_RIGHT_FOOT);
+			foot[0] = (float)(d * x); foot[1] = (float)d[1]; foot[2] = (float)(d * z);
+		}
+
+		vec3 v = f > 0 ? (rootPos[f] - rootPos[f - 1]) / clip.dt : (rootPos[1] - rootPos[0]) / clip.dt;
+		row[FEATURE_ROOT_VELOCITY] = (float)(v * x);
+		row[FEATURE_ROOT_VELOCITY + 1] = (float)(v * z);
+
+		for (int k = 0; k < NumTrajectoryPoints; k++)
+		{
+			int future = f + horizon[k];
+			vec3 d = rootPos[future] - rootPos[f];
+			row[FEATURE_TRAJECTORY_POSITION + 2 * k] = (float)(d * x);
+			row[FEATURE_TRAJECTORY_POSITION + 2 * k + 1] = (float)(d * z);
+			row[FEATURE_TRAJECTORY_DIRECTION + 2 * k] = (float)(facing[future] * x);
+			row[FEATURE_TRAJECTORY_DIRECTION + 2 * k + 1] = (float)(facing[future] * z);
+		}
+	}
+	mBuilt = false;
+	return true;
+}
+
+int AMotionMatcher::addLibrary(const AMotionLibrary& library)
+{
+	int numAdded = 0;
+	for (int i = 0; i < library.getNumClips(); i++)
+	{
+		const AMotionClip* clip = library.getClip(i);
+		if (clip && addClip(i, *clip)) numAdded++;
+	}
+	return numAdded;
+}
+
+bool AMotionMatcher::getFeatures(int clipID, int frame, float* features) const
+{
+	for (unsigned int i = 0; i < mClips.size(); i++)
+	{
+		const ClipRange& range = mClips[i];
+		if (range.clipID != clipID) continue;
+		if (frame < 0 || frame >= range.numFrames) return false;
+		const float* row = &mRaw[((size_t)range.firstRow + frame) * NUM_FEATURES];
+		std::copy(row, row + NUM_FEATURES, features);
+		return true;
+	}
+	return false;
+}
+
+void AMotionMatcher::normalize(const float* features, float* out) const
+{
+	for (int d = 0; d < NUM_FEATURES; d++) out[d] = (features[d] - mMean[d]) * mScale[d];
+}
+
+void AMotionMatcher::build()
+{
+	int numRows = getNumFrames();
+	mData.clear();
+	mEntries.clear();
+	mNodes.clear();
+	if (numRows == 0) return;
+
+	// every dimension is centered; each group is divided by its mean standard deviation so that groups with
+	// more dimensions or larger units do not dominate, then weighted
+	double sum[NUM_FEATURES] = { 0 }, sqrSum[NUM_FEATURES] = { 0 };
+	for (int r = 0; r < numRows; r++)
+	{
+		const float* row = &mRaw[(size_t)r * NUM_FEATURES];
+		for (int d = 0; d < NUM_FEATURES; d++)
+		{
+			sum[d] += row[d];
+			sqrSum[d] += (double)row[d] * row[d];
+		}
+	}
+	double groupDeviation[NUM_GROUPS] = { 0 };
+	int groupSize[NUM_GROUPS] = { 0 };
+	for (int d = 0; d < NUM_FEATURES; d++)
+	{
+		mMean[d] = (float)(sum[d] / numRows);
+		groupDeviation[GetGroup(d)] += sqrt(std::max(0.0, sqrSum[d] / numRows - mMean[d] * (double)mMean[d]));
+		groupSize[GetGroup(d)]++;
+	}
+	for (int d = 0; d < NUM_FEATURES; d++)
+	{
+		Group g = GetGroup(d);
+		double deviation = groupDeviation[g] / groupSize[g];
+		mScale[d] = deviation > 1e-8 ? (float)(mWeights[g] / deviation) : 0.0f;
+	}
+
+	std::vector<int> rows(numRows);
+	for (int r = 0; r < numRows; r++) rows[r] = r;
+	mData.resize((size_t)numRows * NUM_FEATURES);
+	for (int r = 0; r < numRows; r++) normalize(&mRaw[(size_t)r * NUM_FEATURES], &mData[(size_t)r * NUM_FEATURES]);
+	buildNode(rows, 0, numRows);
+
+	// store the rows in tree order
+	std::vector<float> data((size_t)numRows * NUM_FEATURES);
+	mEntries.resize(numRows);
+	for (int i = 0; i < numRows; i++)
+	{
+		std::copy(getRow(rows[i]), getRow(rows[i]) + NUM_FEATURES, &data[(size_t)i * NUM_FEATURES]);
+	}
+	for (unsigned int c = 0; c < mClips.size(); c++)
+	{
+		const ClipRange& range = mClips[c];
+		for (int f = 0; f < range.numFrames; f++)
+		{
+			mEntries[range.firstRow + f].clipID = range.clipID;
+			mEntries[range.firstRow + f].frame = f;
+		}
+	}
+	std::vector<Entry> entries(numRows);
+	for (int i = 0; i < numRows; i++) entries[i] = mEntries[rows[i]];
+	mEntries.swap(entries);
+	mData.swap(data);
+	mBuilt = true;
+}
+
+int AMotionMatcher::buildNode(std::vector<int>& rows, int begin, int end)
+{
+	int nodeID = mNodes.size();
+	Node node = { begin, end, -1, -1, 0, 0.0f };
+	mNodes.push_back(node);
+	if (end - begin <= LeafSize) return nodeID;
+
+	// split the dimension with the largest spread at its median
+	float lo[NUM_FEATURES], hi[NUM_FEATURES];
+	std::fill(lo, lo + NUM_FEATURES, FLT_MAX);
+	std::fill(hi, hi + NUM_FEATURES, -FLT_MAX);
+	for (int i = begin; i < end; i++)
+	{
+		const float* row = getRow(rows[i]);
+		for (int d = 0; d < NUM_FEATURES; d++)
+		{
+			lo[d] = std::min(lo[d], row[d]);
+			hi[d] = std::max(hi[d], row[d]);
+		}
+	}
+	int dim = 0;
+	for (int d = 1; d < NUM_FEATURES; d++)
+	{
+		if (hi[d] - lo[d] > hi[dim] - lo[dim]) dim = d;
+	}
+	if (hi[dim] <= lo[dim]) return nodeID; // identical rows
+
+	int mid = (begin + end) / 2;
+	std::nth_element(rows.begin() + begin, rows.begin() + mid, rows.begin() + end,
+		[this, dim](int a, int b) { return getRow(a)[dim] < getRow(b)[dim]; });
+
+	mNodes[nodeID].dim = dim;
+	mNodes[nodeID].split = getRow(rows[mid])[dim];
+	int left = buildNode(rows, begin, mid);
+	int right = buildNode(rows, mid, end);
+	mNodes[nodeID].left = left;
+	mNodes[nodeID].right = right;
+	return nodeID;
+}
+
+AMotionMatcher::Match AMotionMatcher::query(const float* features, double budgetMs)
+{
+	Match match = { -1, -1, FLT_MAX, true };
+	if (!mBuilt) build();
+	if (mNodes.empty()) return match;
+
+	MatchClock::time_point start = MatchClock::now();
+	Search search;
+	normalize(features, search.query);
+	search.bestCost = FLT_MAX;
+	search.bestRow = -1;
+	search.numLeaves = 0;
+	search.numCandidates = 0;
+	search.timedOut = false;
+	search.deadline = start + std::chrono::duration_cast<MatchClock::duration>(std::chrono::duration<double, std::milli>(budgetMs));
+
+	float offsets[NUM_FEATURES] = { 0 };
+	searchNode(0, 0.0f, offsets, search);
+
+	if (search.bestRow >= 0)
+	{
+		match.clipID = mEntries[search.bestRow].clipID;
+		match.frame = mEntries[search.bestRow].frame;
+		match.cost = search.bestCost;
+	}
+	match.exact = !search.timedOut;
+
+	double ms = std::chrono::duration<double, std::milli>(MatchClock::now() - start).count();
+	mStats.numQueries++;
+	if (search.timedOut) mStats.numTimeouts++;
+	mStats.totalTimeMs += ms;
+	mStats.maxTimeMs = std::max(mStats.maxTimeMs, ms);
+	mStats.numCandidates += search.numCandidates;
+	return match;
+}
+
+void AMotionMatcher::searchNode(int nodeID, float bound, float* offsets, Search& search) const
+{
+	// bound is the squared distance from the query to the cell of the node
+	if (search.timedOut || bound >= search.bestCost) return;
+	const Node& node = mNodes[nodeID];
+
+	if (node.left < 0)
+	{
+		for (int i = node.begin; i < node.end; i++)
+		{
+			const float* row = getRow(i);
+			float cost = 0.0f;
+			for (int d = 0; d < NUM_FEATURES; d++)
+			{
+				float diff = row[d] - search.query[d];
+				cost += diff * diff;
+			}
+			if (cost < search.bestCost)
+			{
+				search.bestCost = cost;
+				search.bestRow = i;
+			}
+		}
+		search.numCandidates += node.end - node.begin;
+
+		// the nearest leaves are visited first, so stopping early still returns a good match
+		if (++search.numLeaves % 16 == 0 && MatchClock::now() > search.deadline) search.timedOut = true;
+		return;
+	}
+
+	float diff = search.query[node.dim] - node.split;
+	int nearChild = diff < 0.0f ? node.left : node.right;
+	int farChild = diff < 0.0f ? node.right : node.left;
+	searchNode(nearChild, bound, offsets, search);
+
+	// replace the offset of the split dimension to get the distance to the far cell
+	float oldOffset = offsets[node.dim];
+	float farBound = bound - oldOffset * oldOffset + diff * diff;
+	if (farBound < search.bestCost)
+	{
+		offsets[node.dim] = diff;
+		searchNode(farChild, farBound, offsets, search);
+		offsets[node.dim] = oldOffset;
+	}
+}
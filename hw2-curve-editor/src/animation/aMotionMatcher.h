@@ -0,0 +1,111 @@
+#ifndef AMOTIONMATCHER_H_
+#define AMOTIONMATCHER_H_
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "aVector.h"
+#include "aMotionLibrary.h"
+
+// Motion matching search over the frames of a clip database.
+// Every frame is described by a feature vector in the facing frame of the character (root projected on the
+// ground, +Z forward): both foot positions, the root velocity and the root trajectory and facing 1/3, 2/3 and 1 s
+// ahead. Features are normalized per group, weighted and stored in a KD-tree; a query returns the frame with the
+// closest features, or the best one found before the time budget runs out
+class AMotionMatcher
+{
+public:
+	enum Feature
+	{
+		FEATURE_LEFT_FOOT = 0,              // x, y, z relative to the root
+		FEATURE_RIGHT_FOOT = 3,
+		FEATURE_ROOT_VELOCITY = 6,          // x, z
+		FEATURE_TRAJECTORY_POSITION = 8,    // x, z per trajectory point, relative to the current root
+		FEATURE_TRAJECTORY_DIRECTION = 14,  // x, z per trajectory point
+		NUM_FEATURES = 20
+	};
+	enum Group { GROUP_FEET, GROUP_VELOCITY, GROUP_TRAJECTORY_POSITION, GROUP_TRAJECTORY_DIRECTION, NUM_GROUPS };
+	static const int NumTrajectoryPoints = 3;
+
+	struct Match
+	{
+		int clipID;    // as passed to addClip, -1 when nothing was found
+		int frame;
+		float cost;    // squared distance between the normalized, weighted features
+		bool exact;    // false when the search stopped at the time budget
+	};
+
+	struct Stats
+	{
+		int numQueries;
+		int numTimeouts;
+		double totalTimeMs;
+		double maxTimeMs;
+		long long numCandidates;   // feature vectors compared
+	};
+
+	AMotionMatcher();
+	virtual ~AMotionMatcher();
+
+	// names matched as substrings, e.g. "LeftFoot" also finds "mixamorig:LeftFoot"
+	void setFootJoints(const std::string& leftFoot, const std::string& rightFoot);
+	// importance of each feature group; takes effect at the next build()
+	void setWeight(Group group, float weight);
+
+	void clear();
+	// Extracts the features of every frame of clip that is followed by a full trajectory.
+	// Fails when the skeleton has no foot joints. The clip itself is not kept
+	bool addClip(int clipID, const AMotionClip& clip);
+	// Adds every loaded clip of library under its library index and returns how many were added
+	int addLibrary(const AMotionLibrary& library);
+	// Normalizes the features and builds the search tree; call after adding clips and before querying
+	void build();
+
+	int getNumFrames() const { return (int)(mRaw.size() / NUM_FEATURES); }
+	// Unnormalized features of an indexed frame; false when the frame is not in the database
+	bool getFeatures(int clipID, int frame, float* features) const;
+
+	// Finds the frame whose features are closest to features (unnormalized, as returned by getFeatures)
+	Match query(const float* features, double budgetMs = 1.0);
+
+	const Stats& getStats() const { return mStats; }
+	void resetStats();
+
+protected:
+	struct Entry { int clipID; int frame; };
+	struct ClipRange { int clipID; int numFrames; int firstRow; }; // indexed frames [0, numFrames) of a clip
+	struct Node
+	{
+		int begin, end;        // rows of the node
+		int left, right;       // children, -1 for leaves
+		int dim;
+		float split;
+	};
+	struct Search;
+
+	static const int LeafSize = 16;
+
+	const float* getRow(int row) const { return &mData[(size_t)row * NUM_FEATURES]; }
+	void normalize(const float* features, float* out) const;
+	int buildNode(std::vector<int>& rows, int begin, int end);
+	void searchNode(int node, float bound, float* offsets, Search& search) const;
+
+protected:
+	std::string mLeftFoot, mRightFoot;
+	float mWeights[NUM_GROUPS];
+
+	std::vector<float> mRaw;                  // unnormalized features, one row per indexed frame in addClip order
+	std::vector<ClipRange> mClips;
+
+	// built by build(): normalized features and their frames, in tree order so every leaf is contiguous
+	std::vector<float> mData;
+	std::vector<Entry> mEntries;
+	float mMean[NUM_FEATURES];
+	float mScale[NUM_FEATURES];               // weight / standard deviation of the group
+	std::vector<Node> mNodes;
+	bool mBuilt;
+	Stats mStats;
+};
+
+#endif
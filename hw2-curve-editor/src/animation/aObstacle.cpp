@@ -0,0 +1,228 @@
+#include "aObstacle.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+#pragma warning(disable : 4018)
+
+AObstacle::AObstacle() : mBounded(false)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mMin[axis] = -FLT_MAX;
+		mMax[axis] = FLT_MAX;
+	}
+}
+
+AObstacle::~AObstacle()
+{
+}
+
+void AObstacle::setBounds(const vec3& boxMin, const vec3& boxMax)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mMin[axis] = (float)boxMin[axis];
+		mMax[axis] = (float)boxMax[axis];
+	}
+	mBounded = true;
+}
+
+bool AObstacle::overlaps(const float boxMin[3], const float boxMax[3]) const
+{
+	if (!mBounded) return true;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (boxMin[axis] > mMax[axis] || boxMax[axis] < mMin[axis]) return false;
+	}
+	return true;
+}
+
+/****************************************************************
+*
+*    	    ASphereObstacle
+*
+****************************************************************/
+
+ASphereObstacle::ASphereObstacle(const vec3& center, float radius) : mCenter(center), mRadius(radius)
+{
+	setBounds(center - vec3(radius, radius, radius), center + vec3(radius, radius, radius));
+}
+
+ASphereObstacle::~ASphereObstacle()
+{
+}
+
+float ASphereObstacle::getDistance(float x, float y, float z, float normal[3]) const
+{
+	float dx = x - (float)mCenter[0], dy = y - (float)mCenter[1], dz = z - (float)mCenter[2];
+	float length = sqrtf(dx * dx + dy * dy + dz * dz);
+	if (length < 1.0e-6f)
+	{
+		// at the center any direction will do
+		normal[0] = 0.0f; normal[1] = 1.0f; normal[2] = 0.0f;
+	}
+	else
+	{
+		normal[0] = dx / length; normal[1] = dy / length; normal[2] = dz / length;
+	}
+	return length - mRadius;
+}
+
+/****************************************************************
+*
+*    	    ABoxObstacle
+*
+****************************************************************/
+
+ABoxObstacle::ABoxObstacle(const vec3& boxMin, const vec3& boxMax)
+{
+	setBounds(boxMin, boxMax);
+}
+
+ABoxObstacle::~ABoxObstacle()
+{
+}
+
+float ABoxObstacle::getDistance(float x, float y, float z, float normal[3]) const
+{
+	float p[3] = { x, y, z };
+	float q[3];     // distance past the faces along every axis, negative inside
+	float outside2 = 0.0f;
+	int nearest = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float center = 0.5f * (mMin[axis] + mMax[axis]);
+		float halfSize = 0.5f * (mMax[axis] - mMin[axis]);
+		q[axis] = fabsf(p[axis] - center) - halfSize;
+		outside2 += std::max(q[axis], 0.0f) * std::max(q[axis], 0.0f);
+		if (q[axis] > q[nearest]) nearest = axis;
+		normal[axis] = p[axis] < center ? -1.0f : 1.0f;
+	}
+	if (outside2 > 0.0f)
+	{
+		float outside = sqrtf(outside2);
+		for (int axis = 0; axis < 3; axis++) normal[axis] *= std::max(q[axis], 0.0f) / outside;
+		return outside;
+	}
+	// inside: out through the nearest face
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (axis != nearest) normal[axis] = 0.0f;
+	}
+	return q[nearest];
+}
+
+/****************************************************************
+*
+*    	    APlaneObstacle
+*
+****************************************************************/
+
+APlaneObstacle::APlaneObstacle(const vec3& point, const vec3& normal) : mPoint(point), mNormal(normal)
+{
+	mNormal.Normalize();
+}
+
+APlaneObstacle::~APlaneObstacle()
+{
+}
+
+float APlaneObstacle::getDistance(float x, float y, float z, float normal[3]) const
+{
+	for (int axis = 0; axis < 3; axis++) normal[axis] = (float)mNormal[axis];
+	return (x - (float)mPoint[0]) * normal[0] + (y - (float)mPoint[1]) * normal[1] + (z - (float)mPoint[2]) * normal[2];
+}
+
+/****************************************************************
+*
+*    	    AObstacleSet
+*
+****************************************************************/
+
+AObstacleSet::AObstacleSet()
+{
+}
+
+AObstacleSet::~AObstacleSet()
+{
+}
+
+AObstacle* AObstacleSet::add(AObstacle* obstacle)
+{
+	mObstacles.push_back(std::unique_ptr<AObstacle>(obstacle));
+	return obstacle;
+}
+
+void AObstacleSet::remove(AObstacle* obstacle)
+{
+	for (int i = 0; i < mObstacles.size(); i++)
+	{
+		if (mObstacles[i].get() == obstacle)
+		{
+			mObstacles.erase(mObstacles.begin() + i);
+			return;
+		}
+	}
+}
+
+int AObstacleSet::collide(AParticleArray& particles, float restitution, float friction, int begin, int end) const
+{
+	end = end < 0 ? particles.size() : end;
+	if (mObstacles.empty() || begin >= end) return 0;
+	float* position[3] = { particles.getChannel(AParticleArray::PX), particles.getChannel(AParticleArray::PY),
+		particles.getChannel(AParticleArray::PZ) };
+	float* velocity[3] = { particles.getChannel(AParticleArray::VX), particles.getChannel(AParticleArray::VY),
+		particles.getChannel(AParticleArray::VZ) };
+	int numCollisions = 0;
+	for (int first = begin; first < end; first += TileSize)
+	{
+		int last = std::min(first + TileSize, end);
+		float boxMin[3], boxMax[3];
+		particles.getBounds(boxMin, boxMax, first, last);
+		for (int k = 0; k < mObstacles.size(); k++)
+		{
+			const AObstacle* obstacle = mObstacles[k].get();
+			if (!obstacle->overlaps(boxMin, boxMax)) continue;
+			for (int i = first; i < last; i++)
+			{
+				float normal[3];
+				float distance = obstacle->getDistance(position[0][i], position[1][i], position[2][i], normal);
+				if (distance >= 0.0f) continue;
+
+				// the last position is left alone so the particle is drawn sliding onto the surface
+				for (int axis = 0; axis < 3; axis++) position[axis][i] -= distance * normal[axis];
+				float vn = velocity[0][i] * normal[0] + velocity[1][i] * normal[1] + velocity[2][i] * normal[2];
+				if (vn < 0.0f)
+				{
+					for (int axis = 0; axis < 3; axis++)
+					{
+						float normalPart = vn * normal[axis];
+						float tangentPart = velocity[axis][i] - normalPart;
+						velocity[axis][i] = tangentPart * (1.0f - friction) - normalPart * restitution;
+					}
+				}
+				numCollisions++;
+			}
+		}
+	}
+	return numCollisions;
+}
+
+float AObstacleSet::getDistance(const vec3& position, vec3& normal) const
+{
+	float nearest = FLT_MAX;
+	float x = (float)position[0], y = (float)position[1], z = (float)position[2];
+	for (int k = 0; k < mObstacles.size(); k++)
+	{
+		float n[3];
+		float distance = mObstacles[k]->getDistance(x, y, z, n);
+		if (distance < nearest)
+		{
+			nearest = distance;
+			normal = vec3(n[0], n[1], n[2]);
+		}
+	}
+	return nearest;
+}
@@ -0,0 +1,101 @@
+#ifndef AOBSTACLE_H_
+#define AOBSTACLE_H_
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include "aVector.h"
+#include "aParticleArray.h"
+
+// Solid the particles collide with, described by its signed distance: negative inside, with the outward normal.
+// Like a force field, an obstacle has a box, unbounded unless set, that AObstacleSet tests against the box of
+// each tile of particles
+class AObstacle
+{
+public:
+	AObstacle();
+	virtual ~AObstacle();
+
+	// Signed distance from (x, y, z) to the surface, and the outward normal there
+	virtual float getDistance(float x, float y, float z, float normal[3]) const = 0;
+
+	bool isBounded() const { return mBounded; }
+	bool overlaps(const float boxMin[3], const float boxMax[3]) const;
+
+protected:
+	void setBounds(const vec3& boxMin, const vec3& boxMax);
+
+protected:
+	bool mBounded;
+	float mMin[3], mMax[3];
+};
+
+class ASphereObstacle : public AObstacle
+{
+public:
+	ASphereObstacle(const vec3& center, float radius);
+	virtual ~ASphereObstacle();
+	virtual float getDistance(float x, float y, float z, float normal[3]) const;
+
+	const vec3& getCenter() const { return mCenter; }
+	float getRadius() const { return mRadius; }
+
+protected:
+	vec3 mCenter;
+	float mRadius;
+};
+
+class ABoxObstacle : public AObstacle
+{
+public:
+	ABoxObstacle(const vec3& boxMin, const vec3& boxMax);
+	virtual ~ABoxObstacle();
+	virtual float getDistance(float x, float y, float z, float normal[3]) const;
+};
+
+// Half space below the plane through point with the given normal
+class APlaneObstacle : public AObstacle
+{
+public:
+	APlaneObstacle(const vec3& point, const vec3& normal);
+	virtual ~APlaneObstacle();
+	virtual float getDistance(float x, float y, float z, float normal[3]) const;
+
+protected:
+	vec3 mPoint;
+	vec3 mNormal;   // unit
+};
+
+// Set of obstacles. Particles are processed in tiles of TileSize; an obstacle is only tested against the tiles
+// whose box overlaps its own
+class AObstacleSet
+{
+public:
+	static const int TileSize = 64;
+
+	AObstacleSet();
+	virtual ~AObstacleSet();
+
+	// Takes ownership of obstacle and returns it
+	AObstacle* add(AObstacle* obstacle);
+	void remove(AObstacle* obstacle);
+	void clear() { mObstacles.clear(); }
+	int size() const { return (int)mObstacles.size(); }
+	AObstacle* get(int index) const { return mObstacles[index].get(); }
+
+	// Moves the particles [begin, end) found inside an obstacle back onto its surface. If they were moving into
+	// it, the normal part of their velocity is reversed and scaled by restitution and the tangential part is
+	// scaled by 1 - friction. Returns the number of collisions. Safe to call on disjoint ranges from different
+	// threads
+	int collide(AParticleArray& particles, float restitution, float friction, int begin = 0, int end = -1) const;
+
+	// Smallest signed distance from position to the obstacles, with the normal of the closest one, e.g. for a
+	// repulsion force near the surfaces. FLT_MAX without obstacles
+	float getDistance(const vec3& position, vec3& normal) const;
+
+protected:
+	std::vector<std::unique_ptr<AObstacle>> mObstacles;
+};
+
+#endif
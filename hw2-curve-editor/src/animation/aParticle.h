@@ -9,13 +9,11 @@
 #include <vector>
 #include <stdlib.h>
 #include "aParticleSystem.h"
+#include "aParticleArray.h"
 using namespace std;
 
 class AParticleSystem;
 
-// Integration types
-enum INTEGRATORTYPE { EULER, RK2, ADAMS, RK4 };
-
 class AParticle
 {
 public:
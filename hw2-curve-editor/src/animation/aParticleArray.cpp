@@ -0,0 +1,586 @@
+#include "aParticleArray.h"
+#include "aThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#include <xmmintrin.h>
+#define APARTICLE_SSE 1
+#endif
+
+#pragma warning(disable : 4018)
+
+static int PaddedParticles(int numParticles)
+{
+	return (numParticles + 3) & ~3;
+}
+
+/****************************************************************
+*
+*    	    Integration kernels, one axis of n particles
+*    	    (n is a multiple of 4 with the SSE kernels)
+*
+****************************************************************/
+
+// x += v * dt, v += f / m * dt
+static void EulerStep(int n, float dt, float* x, float* v, const float* f, const float* m)
+{
+#ifdef APARTICLE_SSE
+	const __m128 h = _mm_set1_ps(dt);
+	for (int i = 0; i < n; i += 4)
+	{
+		__m128 vi = _mm_loadu_ps(v + i);
+		__m128 ai = _mm_div_ps(_mm_loadu_ps(f + i), _mm_loadu_ps(m + i));
+		_mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(vi, h)));
+		_mm_storeu_ps(v + i, _mm_add_ps(vi, _mm_mul_ps(ai, h)));
+	}
+#else
+	for (int i = 0; i < n; i++)
+	{
+		float a = f[i] / m[i];
+		x[i] += v[i] * dt;
+		v[i] += a * dt;
+	}
+#endif
+}
+
+// 2-step Adams-Bashforth: x += dt * (3/2 v - 1/2 pv), v += dt * (3/2 a - 1/2 pa); Euler without history.
+// Stores v and a as the new history
+static void AdamsStep(int n, float dt, float* x, float* v, const float* f, const float* m,
+	float* pv, float* pa, const float* history)
+{
+#ifdef APARTICLE_SSE
+	const __m128 h = _mm_set1_ps(dt);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	for (int i = 0; i < n; i += 4)
+	{
+		__m128 c0 = _mm_mul_ps(half, _mm_loadu_ps(history + i));
+		__m128 c1 = _mm_mul_ps(_mm_add_ps(one, c0), h);
+		c0 = _mm_mul_ps(c0, h);
+		__m128 vi = _mm_loadu_ps(v + i);
+		__m128 ai = _mm_div_ps(_mm_loadu_ps(f + i), _mm_loadu_ps(m + i));
+		__m128 dx = _mm_sub_ps(_mm_mul_ps(c1, vi), _mm_mul_ps(c0, _mm_loadu_ps(pv + i)));
+		__m128 dv = _mm_sub_ps(_mm_mul_ps(c1, ai), _mm_mul_ps(c0, _mm_loadu_ps(pa + i)));
+		_mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), dx));
+		_mm_storeu_ps(v + i, _mm_add_ps(vi, dv));
+		_mm_storeu_ps(pv + i, vi);
+		_mm_storeu_ps(pa + i, ai);
+	}
+#else
+	for (int i = 0; i < n; i++)
+	{
+		float c0 = 0.5f * history[i] * dt;
+		float c1 = dt + c0;
+		float a = f[i] / m[i];
+		float vi = v[i];
+		x[i] += c1 * vi - c0 * pv[i];
+		v[i] += c1 * a - c0 * pa[i];
+		pv[i] = vi;
+		pa[i] = a;
+	}
+#endif
+}
+
+// Runge-Kutta stage at state (x, v): dx += weight * v, dv += weight * a, then moves to the next stage state
+// x = x0 + next * v, v = v0 + next * a. The first stage saves x0, v0 and starts the sums; for the last stage,
+// next is the step and dx, dv the derivatives (x = x0 + next * dx, v = v0 + next * dv)
+static void RungeKuttaStage(int n, float weight, float next, bool first, bool last, float* x, float* v, const float* f,
+	const float* m, float* x0, float* v0, float* dx, float* dv)
+{
+#ifdef APARTICLE_SSE
+	const __m128 w = _mm_set1_ps(weight);
+	const __m128 h = _mm_set1_ps(next);
+	for (int i = 0; i < n; i += 4)
+	{
+		__m128 vi = _mm_loadu_ps(v + i);
+		__m128 ai = _mm_div_ps(_mm_loadu_ps(f + i), _mm_loadu_ps(m + i));
+		__m128 xs, vs, sx, sv;
+		if (first)
+		{
+			xs = _mm_loadu_ps(x + i);
+			vs = vi;
+			_mm_storeu_ps(x0 + i, xs);
+			_mm_storeu_ps(v0 + i, vs);
+			sx = _mm_mul_ps(w, vi);
+			sv = _mm_mul_ps(w, ai);
+		}
+		else
+		{
+			xs = _mm_loadu_ps(x0 + i);
+			vs = _mm_loadu_ps(v0 + i);
+			sx = _mm_add_ps(_mm_loadu_ps(dx + i), _mm_mul_ps(w, vi));
+			sv = _mm_add_ps(_mm_loadu_ps(dv + i), _mm_mul_ps(w, ai));
+		}
+		if (last)
+		{
+			vi = sx;
+			ai = sv;
+		}
+		else
+		{
+			_mm_storeu_ps(dx + i, sx);
+			_mm_storeu_ps(dv + i, sv);
+		}
+		_mm_storeu_ps(x + i, _mm_add_ps(xs, _mm_mul_ps(h, vi)));
+		_mm_storeu_ps(v + i, _mm_add_ps(vs, _mm_mul_ps(h, ai)));
+	}
+#else
+	for (int i = 0; i < n; i++)
+	{
+		float vi = v[i];
+		float ai = f[i] / m[i];
+		if (first)
+		{
+			x0[i] = x[i];
+			v0[i] = vi;
+		}
+		float sx = (first ? 0.0f : dx[i]) + weight * vi;
+		float sv = (first ? 0.0f : dv[i]) + weight * ai;
+		if (last)
+		{
+			vi = sx;
+			ai = sv;
+		}
+		else
+		{
+			dx[i] = sx;
+			dv[i] = sv;
+		}
+		x[i] = x0[i] + next * vi;
+		v[i] = v0[i] + next * ai;
+	}
+#endif
+}
+
+// a = f / m
+static void Acceleration(int n, const float* f, const float* m, float* a)
+{
+#ifdef APARTICLE_SSE
+	for (int i = 0; i < n; i += 4)
+	{
+		_mm_storeu_ps(a + i, _mm_div_ps(_mm_loadu_ps(f + i), _mm_loadu_ps(m + i)));
+	}
+#else
+	for (int i = 0; i < n; i++) a[i] = f[i] / m[i];
+#endif
+}
+
+// y = y0 + sum of weights[j] * k[j * kStride], for j < numK; y0 may be NULL for 0
+static void WeightedSum(int n, int numK, const float* weights, const float* y0, const float* k, int kStride, float* y)
+{
+#ifdef APARTICLE_SSE
+	for (int i = 0; i < n; i += 4)
+	{
+		__m128 sum = y0 ? _mm_loadu_ps(y0 + i) : _mm_setzero_ps();
+		for (int j = 0; j < numK; j++)
+		{
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[j]), _mm_loadu_ps(k + j * kStride + i)));
+		}
+		_mm_storeu_ps(y + i, sum);
+	}
+#else
+	for (int i = 0; i < n; i++)
+	{
+		float sum = y0 ? y0[i] : 0.0f;
+		for (int j = 0; j < numK; j++) sum += weights[j] * k[j * kStride + i];
+		y[i] = sum;
+	}
+#endif
+}
+
+/****************************************************************
+*
+*    	    Dormand-Prince 5(4) tableau
+*
+****************************************************************/
+
+// Stage s is evaluated at y0 + h * sum DPA[s][j] * k[j]; the last stage is the 5th order solution, so its
+// derivative starts the next step. DPE are the 5th minus the 4th order weights, the error estimate
+static const int DPStages = 7;
+static const float DPA[DPStages][DPStages - 1] =
+{
+	{ 0.0f },
+	{ 1.0f / 5.0f },
+	{ 3.0f / 40.0f, 9.0f / 40.0f },
+	{ 44.0f / 45.0f, -56.0f / 15.0f, 32.0f / 9.0f },
+	{ 19372.0f / 6561.0f, -25360.0f / 2187.0f, 64448.0f / 6561.0f, -212.0f / 729.0f },
+	{ 9017.0f / 3168.0f, -355.0f / 33.0f, 46732.0f / 5247.0f, 49.0f / 176.0f, -5103.0f / 18656.0f },
+	{ 35.0f / 384.0f, 0.0f, 500.0f / 1113.0f, 125.0f / 192.0f, -2187.0f / 6784.0f, 11.0f / 84.0f }
+};
+static const float DPE[DPStages] =
+{
+	71.0f / 57600.0f, 0.0f, -71.0f / 16695.0f, 71.0f / 1920.0f, -17253.0f / 339200.0f, 22.0f / 525.0f, -1.0f / 40.0f
+};
+
+AParticleArray::AParticleArray() : mSize(0), mCapacity(0), mStride(0), mTolerance(1.0e-3f)
+{
+}
+
+AParticleArray::~AParticleArray()
+{
+}
+
+void AParticleArray::setCapacity(int capacity)
+{
+	capacity = std::max(capacity, 0);
+	if (capacity == mCapacity) return;
+	int stride = PaddedParticles(capacity);
+	int size = std::min(mSize, capacity);
+	std::vector<float> data((size_t)NUM_CHANNELS * stride, 0.0f);
+	for (int c = 0; c < NUM_CHANNELS; c++)
+	{
+		std::copy(mData.begin() + (size_t)c * mStride, mData.begin() + (size_t)c * mStride + size, data.begin() + (size_t)c * stride);
+	}
+	// unused slots keep a unit mass so the kernels can run over whole blocks of 4
+	std::fill(data.begin() + (size_t)MASS * stride + size, data.begin() + (size_t)(MASS + 1) * stride, 1.0f);
+	mData.swap(data);
+	mTags.resize(stride, 0);
+	mScratch.assign((size_t)NUM_SCRATCH_CHANNELS * stride, 0.0f);
+	mSize = size;
+	mCapacity = capacity;
+	mStride = stride;
+}
+
+int AParticleArray::add()
+{
+	if (mSize == mCapacity) return -1;
+	int index = mSize++;
+	for (int c = 0; c < NUM_CHANNELS; c++)
+	{
+		mData[(size_t)c * mStride + index] = 0.0f;
+	}
+	set(MASS, index, 1.0f);
+	setStartColor(index, vec3(1, 1, 1));
+	setEndColor(index, vec3(1, 1, 1));
+	set(START_SCALE, index, 1.0f);
+	set(END_SCALE, index, 1.0f);
+	set(START_ALPHA, index, 1.0f);
+	set(END_ALPHA, index, 1.0f);
+	mTags[index] = 0;
+	return index;
+}
+
+void AParticleArray::remove(int index)
+{
+	assert(index >= 0 && index < mSize);
+	mSize--;
+	if (index != mSize) copyParticle(mSize, index);
+}
+
+void AParticleArray::truncate(int numParticles)
+{
+	mSize = std::max(0, std::min(mSize, numParticles));
+}
+
+void AParticleArray::copyParticle(int from, int to)
+{
+	for (int c = 0; c < NUM_CHANNELS; c++)
+	{
+		float* channel = &mData[(size_t)c * mStride];
+		channel[to] = channel[from];
+	}
+	mTags[to] = mTags[from];
+}
+
+int AParticleArray::removeDead()
+{
+	// walk down so the particle moved into a hole has already been checked
+	const float* timeToLive = getChannel(TIME_TO_LIVE);
+	int size = mSize;
+	for (int i = mSize - 1; i >= 0; i--)
+	{
+		if (timeToLive[i] <= 0.0f) remove(i);
+	}
+	return size - mSize;
+}
+
+void AParticleArray::setLifeSpan(int index, float time)
+{
+	set(LIFE_SPAN, index, time);
+	set(TIME_TO_LIVE, index, time);
+}
+
+vec3 AParticleArray::getVector(Channel c, int index) const
+{
+	assert(index >= 0 && index < mSize);
+	const float* x = getChannel(c);
+	return vec3(x[index], x[index + mStride], x[index + 2 * mStride]);
+}
+
+void AParticleArray::setVector(Channel c, int index, const vec3& v)
+{
+	assert(index >= 0 && index < mSize);
+	float* x = getChannel(c);
+	x[index] = (float)v[0];
+	x[index + mStride] = (float)v[1];
+	x[index + 2 * mStride] = (float)v[2];
+}
+
+vec3 AParticleArray::getInterpolatedPosition(int index, float alpha) const
+{
+	vec3 last = getVector(LAST_PX, index);
+	return last + (getVector(PX, index) - last) * alpha;
+}
+
+void AParticleArray::savePositions(int begin, int end)
+{
+	end = getEnd(end);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const float* position = getChannel((Channel)(PX + axis));
+		std::copy(position + begin, position + end, getChannel((Channel)(LAST_PX + axis)) + begin);
+	}
+}
+
+void AParticleArray::getBounds(float boxMin[3], float boxMax[3], int begin, int end) const
+{
+	end = getEnd(end);
+	assert(begin < end);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const float* x = getChannel((Channel)(PX + axis));
+		float low = x[begin], high = x[begin];
+		for (int i = begin + 1; i < end; i++)
+		{
+			low = std::min(low, x[i]);
+			high = std::max(high, x[i]);
+		}
+		boxMin[axis] = low;
+		boxMax[axis] = high;
+	}
+}
+
+void AParticleArray::clearForces(int begin, int end)
+{
+	end = getEnd(end);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float* force = getChannel((Channel)(FX + axis));
+		std::fill(force + begin, force + end, 0.0f);
+	}
+}
+
+void AParticleArray::addGravity(const vec3& gravity, int begin, int end)
+{
+	end = getEnd(end);
+	const float* mass = getChannel(MASS);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float* force = getChannel((Channel)(FX + axis));
+		float g = (float)gravity[axis];
+		for (int i = begin; i < end; i++) force[i] += mass[i] * g;
+	}
+}
+
+void AParticleArray::addForce(const vec3& force, int begin, int end)
+{
+	end = getEnd(end);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float* out = getChannel((Channel)(FX + axis));
+		float f = (float)force[axis];
+		for (int i = begin; i < end; i++) out[i] += f;
+	}
+}
+
+void AParticleArray::integrate(float deltaT, int integratorType)
+{
+	integrate(deltaT, integratorType, ForceFunction());
+}
+
+void AParticleArray::integrate(float deltaT, int integratorType, const ForceFunction& computeForces, int begin, int end)
+{
+	end = getEnd(end);
+	assert(begin % 4 == 0 && begin <= end);
+#ifdef APARTICLE_SSE
+	const int n = PaddedParticles(end) - begin;
+#else
+	const int n = end - begin;
+#endif
+	if (integratorType == RK45)
+	{
+		integrateAdaptive(deltaT, computeForces, begin, end);
+		return;
+	}
+	const float* mass = getChannel(MASS) + begin;
+	if (integratorType == EULER || integratorType == ADAMS)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float* x = getChannel((Channel)(PX + axis)) + begin;
+			float* v = getChannel((Channel)(VX + axis)) + begin;
+			const float* f = getChannel((Channel)(FX + axis)) + begin;
+			if (integratorType == EULER)
+			{
+				EulerStep(n, deltaT, x, v, f, mass);
+			}
+			else
+			{
+				AdamsStep(n, deltaT, x, v, f, mass, getChannel((Channel)(PREV_VX + axis)) + begin,
+					getChannel((Channel)(PREV_AX + axis)) + begin, getChannel(HAS_HISTORY) + begin);
+			}
+		}
+		if (integratorType == ADAMS) std::fill(getChannel(HAS_HISTORY) + begin, getChannel(HAS_HISTORY) + end, 1.0f);
+		return;
+	}
+
+	// RK2 is the midpoint rule: weights (0, 1), RK4 the classic weights (1, 2, 2, 1) / 6
+	static const float RK2Weights[] = { 0.0f, 1.0f };
+	static const float RK2Next[] = { 0.5f, 1.0f };
+	static const float RK4Weights[] = { 1.0f, 2.0f, 2.0f, 1.0f };
+	static const float RK4Next[] = { 0.5f, 0.5f, 1.0f, 1.0f / 6.0f };
+	bool rk4 = integratorType == RK4;
+	int numStages = rk4 ? 4 : 2;
+	const float* weights = rk4 ? RK4Weights : RK2Weights;
+	const float* next = rk4 ? RK4Next : RK2Next;
+
+	for (int stage = 0; stage < numStages; stage++)
+	{
+		if (stage > 0 && computeForces) computeForces(*this, begin, end);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			size_t offset = begin;
+			RungeKuttaStage(n, weights[stage], next[stage] * deltaT, stage == 0, stage == numStages - 1,
+				getChannel((Channel)(PX + axis)) + offset, getChannel((Channel)(VX + axis)) + offset,
+				getChannel((Channel)(FX + axis)) + offset, mass,
+				&mScratch[(X0 + axis) * (size_t)mStride + offset], &mScratch[(V0 + axis) * (size_t)mStride + offset],
+				&mScratch[(DX + axis) * (size_t)mStride + offset], &mScratch[(DV + axis) * (size_t)mStride + offset]);
+		}
+	}
+}
+
+void AParticleArray::integrateAdaptive(float deltaT, const ForceFunction& computeForces, int begin, int end)
+{
+	// state components: position then velocity, whose derivatives are velocity and force / mass.
+	// k[c][s] is the derivative of component c at stage s
+	const int B = AdaptiveBlockSize;
+	float y0[6][B];
+	float k[6][DPStages][B];
+	float error[B];
+	float weights[DPStages];
+	const float minStep = deltaT / MaxSubsteps;
+
+	for (int first = begin; first < end; first += B)
+	{
+		int last = std::min(first + B, end);
+		int n = last - first;
+#ifdef APARTICLE_SSE
+		const int padded = PaddedParticles(n);
+#else
+		const int padded = n;
+#endif
+		float* y[6];
+		const float* f[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			y[axis] = getChannel((Channel)(PX + axis)) + first;
+			y[axis + 3] = getChannel((Channel)(VX + axis)) + first;
+			f[axis] = getChannel((Channel)(FX + axis)) + first;
+		}
+		const float* mass = getChannel(MASS) + first;
+		float* stepSize = getChannel(STEP_SIZE) + first;
+
+		// the block starts from the smallest step its particles proposed, a full step for new particles
+		float h = deltaT;
+		for (int i = 0; i < n; i++)
+		{
+			if (stepSize[i] > 0.0f) h = std::min(h, stepSize[i]);
+		}
+		h = std::max(h, minStep);
+
+		for (int c = 0; c < 6; c++) std::copy(y[c], y[c] + padded, y0[c]);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			std::copy(y[axis + 3], y[axis + 3] + padded, k[axis][0]);
+			Acceleration(padded, f[axis], mass, k[axis + 3][0]);
+		}
+
+		float t = 0.0f;
+		float proposal = h;
+		while (t < deltaT)
+		{
+			// stretch the step to the end rather than leave a sliver
+			bool lastStep = t + 1.01f * h >= deltaT;
+			float step = lastStep ? deltaT - t : h;
+
+			for (int s = 1; s < DPStages; s++)
+			{
+				for (int j = 0; j < s; j++) weights[j] = step * DPA[s][j];
+				for (int c = 0; c < 6; c++) WeightedSum(padded, s, weights, y0[c], k[c][0], B, y[c]);
+				if (computeForces) computeForces(*this, first, last);
+				for (int axis = 0; axis < 3; axis++)
+				{
+					std::copy(y[axis + 3], y[axis + 3] + padded, k[axis][s]);
+					Acceleration(padded, f[axis], mass, k[axis + 3][s]);
+				}
+			}
+
+			float maxError = 0.0f;
+			for (int j = 0; j < DPStages; j++) weights[j] = step * DPE[j];
+			for (int c = 0; c < 6; c++)
+			{
+				WeightedSum(padded, DPStages, weights, NULL, k[c][0], B, error);
+				for (int i = 0; i < n; i++)
+				{
+					float scale = mTolerance * (1.0f + std::max(fabsf(y0[c][i]), fabsf(y[c][i])));
+					maxError = std::max(maxError, fabsf(error[i]) / scale);
+				}
+			}
+			// 5th order controller with a safety factor, growing or shrinking at most 5 times per step
+			float factor = maxError > 0.0f ? std::min(std::max(0.9f * powf(maxError, -0.2f), 0.2f), 5.0f) : 5.0f;
+
+			if (maxError <= 1.0f || step <= minStep)
+			{
+				t = lastStep ? deltaT : t + step;
+				for (int c = 0; c < 6; c++)
+				{
+					std::copy(y[c], y[c] + padded, y0[c]);
+					std::copy(k[c][DPStages - 1], k[c][DPStages - 1] + padded, k[c][0]);
+				}
+				// a step shortened to reach the end says little about the next one
+				proposal = lastStep ? std::max(step * factor, std::min(h, step * 5.0f)) : step * factor;
+			}
+			else
+			{
+				for (int c = 0; c < 6; c++) std::copy(y0[c], y0[c] + padded, y[c]);
+			}
+			h = std::max(step * factor, minStep);
+		}
+		std::fill(stepSize, stepSize + n, std::min(proposal, deltaT));
+	}
+}
+
+void AParticleArray::age(float deltaT, int begin, int end)
+{
+	end = getEnd(end);
+	float* timeToLive = getChannel(TIME_TO_LIVE);
+	for (int i = begin; i < end; i++) timeToLive[i] = std::max(timeToLive[i] - deltaT, 0.0f);
+}
+
+void AParticleArray::forEachBatch(AThreadPool* pool, const BatchFunction& step) const
+{
+	int numBatches = getNumBatches();
+	auto stepRange = [this, &step](int first, int last)
+	{
+		for (int batch = first; batch < last; batch++)
+		{
+			step(batch, batch * BatchSize, std::min((batch + 1) * BatchSize, mSize));
+		}
+	};
+
+	int numTasks = pool ? std::min(numBatches, 4 * pool->getNumThreads()) : 1;
+	if (numTasks <= 1)
+	{
+		stepRange(0, numBatches);
+		return;
+	}
+	for (int task = 0; task < numTasks; task++)
+	{
+		int first = numBatches * task / numTasks;
+		int last = numBatches * (task + 1) / numTasks;
+		pool->run([&stepRange, first, last] { stepRange(first, last); });
+	}
+	pool->wait();
+}
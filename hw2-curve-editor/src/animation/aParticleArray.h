@@ -0,0 +1,152 @@
+#ifndef APARTICLEARRAY_H_
+#define APARTICLEARRAY_H_
+
+#pragma once
+
+#include "aVector.h"
+#include <vector>
+#include <functional>
+
+class AThreadPool;
+
+// Integration types; RK45 is the adaptive Dormand-Prince integrator
+enum INTEGRATORTYPE { EULER, RK2, ADAMS, RK4, RK45 };
+
+// Structure-of-arrays particle pool. Every attribute is a channel: one contiguous float block per channel,
+// each block padded to a multiple of 4 particles, so update loops stream through the channels they touch
+// instead of chasing a heap object per particle. Particles are addressed by index; a particle is alive while
+// its time to live is positive.
+// The pool has a fixed capacity, allocated once by setCapacity; adding and removing particles is O(1) and
+// never touches the heap. Removal moves the last particle into the freed slot, so indices are not stable
+class AParticleArray
+{
+public:
+	enum Channel
+	{
+		PX, PY, PZ,
+		VX, VY, VZ,
+		FX, FY, FZ,
+		MASS,
+		TIME_TO_LIVE,
+		LIFE_SPAN,
+		START_R, START_G, START_B,
+		END_R, END_G, END_B,
+		START_SCALE, END_SCALE,
+		START_ALPHA, END_ALPHA,
+		PREV_VX, PREV_VY, PREV_VZ,   // ADAMS history: velocity and acceleration of the previous step
+		PREV_AX, PREV_AY, PREV_AZ,
+		HAS_HISTORY,                 // 1 once the history is valid, 0 for a new particle
+		STEP_SIZE,                   // RK45 step size proposed for the next step, 0 for a new particle
+		LAST_PX, LAST_PY, LAST_PZ,   // position before the latest step, to interpolate between the two latest states
+		NUM_CHANNELS
+	};
+
+	// Sets the force channels of the particles [begin, end) from their position and velocity channels
+	typedef std::function<void(AParticleArray& particles, int begin, int end)> ForceFunction;
+	// One batch of particles [begin, end) stepped by forEachBatch
+	typedef std::function<void(int batch, int begin, int end)> BatchFunction;
+
+	// Particles per batch of forEachBatch, a multiple of 4
+	static const int BatchSize = 4096;
+	// Particles sharing one RK45 step size, a multiple of 4
+	static const int AdaptiveBlockSize = 64;
+	// The smallest RK45 step is deltaT / MaxSubsteps; steps this small are accepted whatever their error
+	static const int MaxSubsteps = 256;
+
+	AParticleArray();
+	virtual ~AParticleArray();
+
+	int size() const { return mSize; }
+	int getCapacity() const { return mCapacity; }
+	bool isFull() const { return mSize == mCapacity; }
+	int getStride() const { return mStride; }   // padded capacity of each channel block
+	// Reallocates the pool; the particles past the new capacity are dropped
+	void setCapacity(int capacity);
+	void clear() { mSize = 0; }
+
+	// Appends a particle at rest with unit mass, white color, unit scale and alpha, and no time to live.
+	// Returns its index, or -1 when the pool is full
+	int add();
+	// Moves the last particle into index
+	void remove(int index);
+	// Drops the particles from index numParticles on
+	void truncate(int numParticles);
+	// Removes every dead particle, filling the holes from the end. Returns how many were removed
+	int removeDead();
+
+	float* getChannel(Channel c) { return mData.data() + c * mStride; }
+	const float* getChannel(Channel c) const { return mData.data() + c * mStride; }
+	// One int per particle for the owner, e.g. the explosion countdown of a rocket
+	int* getTags() { return mTags.data(); }
+	const int* getTags() const { return mTags.data(); }
+
+	vec3 getPosition(int index) const { return getVector(PX, index); }
+	// Places the particle at position, also as its last position so it is not interpolated from where it was
+	void setPosition(int index, const vec3& position) { setVector(PX, index, position); setVector(LAST_PX, index, position); }
+	// Position at the fraction alpha of the latest step, from the last position at 0 to the position at 1
+	vec3 getInterpolatedPosition(int index, float alpha) const;
+	vec3 getVelocity(int index) const { return getVector(VX, index); }
+	void setVelocity(int index, const vec3& velocity) { setVector(VX, index, velocity); }
+	vec3 getStartColor(int index) const { return getVector(START_R, index); }
+	void setStartColor(int index, const vec3& color) { setVector(START_R, index, color); }
+	vec3 getEndColor(int index) const { return getVector(END_R, index); }
+	void setEndColor(int index, const vec3& color) { setVector(END_R, index, color); }
+	float get(Channel c, int index) const { return getChannel(c)[index]; }
+	void set(Channel c, int index, float value) { getChannel(c)[index] = value; }
+
+	bool isAlive(int index) const { return get(TIME_TO_LIVE, index) > 0.0f; }
+	void kill(int index) { set(TIME_TO_LIVE, index, 0.0f); }
+	// sets the time to live and the life span the color, scale and alpha ramps are measured against
+	void setLifeSpan(int index, float time);
+
+	// Batch steps over the particles [begin, end), all particles when end is -1. begin must be a multiple of 4
+	// so the SSE kernels stay on whole blocks; steps over disjoint ranges can run on different threads
+	void clearForces(int begin = 0, int end = -1);
+	// Copies the positions to the last positions, before a step
+	void savePositions(int begin = 0, int end = -1);
+	// Box around the positions of the particles [begin, end), which must not be empty
+	void getBounds(float boxMin[3], float boxMax[3], int begin = 0, int end = -1) const;
+	void addGravity(const vec3& gravity, int begin = 0, int end = -1);   // force += mass * gravity
+	void addForce(const vec3& force, int begin = 0, int end = -1);
+	// Moves every particle by deltaT under its accumulated force, held constant over the step
+	void integrate(float deltaT, int integratorType);
+	// Moves every particle by deltaT, starting from the accumulated force. RK2 (midpoint) and RK4 call
+	// computeForces on the intermediate states, 1 and 3 times; EULER and ADAMS (2-step Adams-Bashforth)
+	// only use the accumulated force. RK45 substeps every block of AdaptiveBlockSize particles on its own,
+	// 6 evaluations per substep, with the step size picked from the embedded 4th order error estimate.
+	// Without computeForces the force is held constant over the step. The force channels are left at the
+	// last evaluation
+	void integrate(float deltaT, int integratorType, const ForceFunction& computeForces, int begin = 0, int end = -1);
+	// RK45 error allowed per substep, relative to 1 + the magnitude of each position and velocity component
+	void setTolerance(float tolerance) { mTolerance = tolerance; }
+	float getTolerance() const { return mTolerance; }
+	// Counts the time to live of every particle down by deltaT, stopping at 0
+	void age(float deltaT, int begin = 0, int end = -1);
+
+	int getNumBatches() const { return (mSize + BatchSize - 1) / BatchSize; }
+	// Runs step on every batch of BatchSize particles, spread over the threads of pool when it is not NULL.
+	// The batches do not depend on the number of threads, so anything derived from the batch index (e.g. a
+	// random seed) gives the same result with any pool
+	void forEachBatch(AThreadPool* pool, const BatchFunction& step) const;
+
+protected:
+	vec3 getVector(Channel c, int index) const;
+	void setVector(Channel c, int index, const vec3& v);
+	void copyParticle(int from, int to);
+	int getEnd(int end) const { return end < 0 ? mSize : end; }
+	void integrateAdaptive(float deltaT, const ForceFunction& computeForces, int begin, int end);
+
+protected:
+	int mSize;
+	int mCapacity;
+	int mStride;
+	float mTolerance;
+	std::vector<float> mData;
+	std::vector<int> mTags;
+
+	// Runge-Kutta scratch: start position and velocity, weighted sums of the stage derivatives
+	enum ScratchChannel { X0, V0 = X0 + 3, DX = V0 + 3, DV = DX + 3, NUM_SCRATCH_CHANNELS = DV + 3 };
+	std::vector<float> mScratch;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #include <Windows.h>
 #include <cstring>
 #include <math.h>
+#include <algorithm>
 #include "aVector.h"
 
 
@@ -14,10 +15,11 @@ AParticleSystem::AParticleSystem()
 	mParticles.clear();
 
 	mDeltaT = 0.033;
+	mIntegratorType = EULER;
+	mThreadPool = NULL;
 	mLifeSpan = 3.0; 
 	mJitterTime = AJitter(-0.5 * mLifeSpan, 0);
-	mSpawnTime = (int)(mLifeSpan / (mMaxParticles*mDeltaT));
-	mSpawnDelay = 0;
+	mSpawnCount = 0.0;
 
 	mGravity = vec3(0, -9.8, 0);
 
@@ -39,82 +41,95 @@ AParticleSystem::AParticleSystem()
 	mScaleJitter = AJitter(0, 0.25);
 	
 	mRoot = NULL;
+	mStepCount = 0;
+	mParticles.setCapacity(mMaxParticles);
 }
 
 AParticleSystem::~AParticleSystem()
 {
-	for (unsigned int i = 0; i < mParticles.size(); i++)
-	{
-		AParticle* pParticle = mParticles[i];
-		delete pParticle;
-	}
-
-	mParticles.clear();
 }
 
 bool AParticleSystem::isAlive()
 {
 	if (mInfinite) { return true; } // if mInfinite = true particles never die!
 	if (mParticles.size() < mMaxParticles) { return true; }
-    for (unsigned int i = 0; i < mParticles.size(); i++)
+    for (int i = 0; i < mParticles.size(); i++)
     {
-        if (mParticles[i]->isAlive()) 
+        if (mParticles.isAlive(i)) 
 			return true;
     }
     return false;
 }
 
+void AParticleSystem::initialize(int index)
+{
+	ARandom random = mRandom.getStream(((unsigned long long)mStepCount << 32) | (unsigned int)index);
+	mParticles.setLifeSpan(index, mLifeSpan);
+
+	mParticles.set(AParticleArray::START_ALPHA, index, mStartAlpha);
+	mParticles.set(AParticleArray::END_ALPHA, index, mEndAlpha);
+	mParticles.setStartColor(index, mStartColor + AJitterVec(mColorJitter, random));
+	mParticles.setEndColor(index, mEndColor + AJitterVec(mColorJitter, random));
+	mParticles.set(AParticleArray::START_SCALE, index, mStartScale + AJitterVal(mScaleJitter, random));
+	mParticles.set(AParticleArray::END_SCALE, index, mEndScale + AJitterVal(mScaleJitter, random));
+
+	mParticles.setPosition(index, mStartPos + AJitterVec(mPositionJitter, random));
+	mParticles.setVelocity(index, mStartVel + AJitterVec(mVelocityJitter, random));
+	mParticles.set(AParticleArray::MASS, index, 1.0f);
+}
+
 void AParticleSystem::update(double deltaT)
 {
 	if (mParticles.size() == 0 && mMaxParticles == 0) { return; }
-	int forceMode = 0;
 	mDeltaT = deltaT;
-	if (mParticles.size() > mMaxParticles)
+	if (mParticles.getCapacity() != mMaxParticles)
 	{
-		for (unsigned int i = mParticles.size() - 1; i >= mMaxParticles; --i)
-		{
-			AParticle* pParticle = mParticles[i];
-			delete pParticle;
-			mParticles.pop_back();
-		}
+		mParticles.setCapacity(mMaxParticles);	// only reallocates when mMaxParticles is changed
 	}
 
-	for (unsigned int i = 0; i < mParticles.size(); i++)
+	// dead particles are stepped too; they are not drawn and it keeps the loops branch free
+	mStepCount++;
+	mParticles.forEachBatch(mThreadPool, [this](int, int begin, int end)
 	{
-		mParticles[i]->update(deltaT, forceMode);
-		if (mInfinite && !mParticles[i]->isAlive())
+		mParticles.savePositions(begin, end);
+		mParticles.clearForces(begin, end);
+		mParticles.addGravity(mGravity, begin, end);
+		mParticles.integrate(mDeltaT, mIntegratorType, AParticleArray::ForceFunction(), begin, end);
+		mParticles.age(mDeltaT, begin, end);
+		if (mInfinite)
 		{
-			mParticles[i]->initialize(*this);	// Respawn
+			for (int i = begin; i < end; i++)
+			{
+				if (!mParticles.isAlive(i))
+				{
+					initialize(i);	// Respawn
+				}
+			}
 		}
-	}
-	if (mParticles.size() < mMaxParticles)  // add new particle
+	});
+	if (mParticles.size() < mMaxParticles)  // add new particles
 	{
-		mSpawnDelay++;
-		if (mSpawnDelay == mSpawnTime)
+		// mMaxParticles * deltaT / mLifeSpan particles per step fill the pool over one life span
+		mSpawnCount += mLifeSpan > 0.0 ? mMaxParticles * mDeltaT / mLifeSpan : mMaxParticles;
+		int numSpawned = std::min((int)mSpawnCount, mMaxParticles - mParticles.size());
+		mSpawnCount -= numSpawned;
+		for (int i = 0; i < numSpawned; i++)
 		{
-			AParticle *particle = new AParticle();
-			particle->initialize(*this);
+			int index = mParticles.add();
+			initialize(index);
 
 			if (mInfinite) // jitter the LifeSpan in infinite mode
 			{
 				double newLifeSpan = mLifeSpan; //+ AJitterVal(mJitterTime);
-				particle->setLifeSpan(newLifeSpan);
+				mParticles.setLifeSpan(index, newLifeSpan);
 			}
-			mParticles.push_back(particle);
-			mSpawnDelay = 0;
 		}
 	}
 }
 
 void AParticleSystem::reset()
 {
-	for (unsigned int i = 0; i < mParticles.size(); i++)
-	{
-		AParticle* pParticle = mParticles[i];
-		delete pParticle;
-	}
     mParticles.clear();
-	mSpawnTime = (int)(mLifeSpan / (mMaxParticles*mDeltaT));
-
-}
-
+	mStepCount = 0;
+	mSpawnCount = 0.0;
+}
\ No newline at end of file
@@ -5,9 +5,9 @@
 #include "aJoint.h"
 #include "aVector.h"
 #include "aJitter.h"
-#include "aParticle.h"
+#include "aRandom.h"
+#include "aParticleArray.h"
 
-class AParticle;
 class AParticleSystem 
 {
 public:
@@ -19,14 +19,24 @@ public:
     virtual void reset();
     virtual bool isAlive(); 
 
-	AParticle* getParticle(int index) { return mParticles[index]; }
+	const AParticleArray& getParticles() const { return mParticles; }
 	int getParticleNum() { return mParticles.size(); }
  
 	virtual void update(double deltaT);
 
+	// Restarts the random numbers of the system on the given stream of seed; reset() replays them
+	void setSeed(unsigned long long seed, unsigned long long stream = 0) { mRandom.setSeed(seed, stream); }
+
+protected:
+	// sets the initial values of a particle from the emitter parameters, jittered with numbers drawn from the
+	// stream of the particle and the current step, so particles can be initialized on any thread in any order
+	virtual void initialize(int index);
+
 protected:
-    std::vector<AParticle*> mParticles; // vector containing pointers to particles
+    AParticleArray mParticles; // particles in spawn order; dead ones stay until respawned or reset
     AJoint* mRoot; //  used to attach the particle system to a joint 
+	ARandom mRandom;           // random numbers of the system, split into a stream per particle and step
+	unsigned int mStepCount;   // steps since the last reset
 
 public:
 
@@ -35,8 +45,9 @@ public:
 	int mMaxParticles;    // max number of particles that can be stored in mParticles
     double mLifeSpan;              // default life span of particles
 	double mDeltaT;               // size of simulation timestep
-	int mSpawnTime;               // number of time steps before emmitting another particle
-	int mSpawnDelay;			// count of number of time steps before emitting another particle
+	int mIntegratorType;          // INTEGRATORTYPE used to step the particles
+	AThreadPool* mThreadPool;     // optional pool the particle batches are spread over, NULL for the calling thread
+	double mSpawnCount;           // particles owed by the steps so far; each step emits the whole part of it
 
     vec3 mStartPos;                // location of particle emitter
     vec3 mStartVel;                // initial velocity of particle leaving emitter
@@ -0,0 +1,336 @@
+#include "aPose.h"
+#include "aSkeleton.h"
+#include <algorithm>
+#include <math.h>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#include <xmmintrin.h>
+#define APOSE_SSE 1
+#endif
+
+#pragma warning(disable : 4018)
+
+static int PaddedJoints(int numJoints)
+{
+	return (numJoints + 3) & ~3;
+}
+
+/****************************************************************
+*
+*    	    Joint mask functions
+*
+****************************************************************/
+
+AJointMask::AJointMask() : mNumJoints(0)
+{
+}
+
+AJointMask::AJointMask(int numJoints, float weight) : mNumJoints(0)
+{
+	resize(numJoints, weight);
+}
+
+void AJointMask::resize(int numJoints, float weight)
+{
+	mNumJoints = numJoints;
+	mWeights.assign(PaddedJoints(numJoints), 0.0f);
+	std::fill(mWeights.begin(), mWeights.begin() + numJoints, weight);
+}
+
+void AJointMask::setWeight(int jointID, float weight)
+{
+	assert(jointID >= 0 && jointID < mNumJoints);
+	mWeights[jointID] = weight;
+}
+
+float AJointMask::getWeight(int jointID) const
+{
+	assert(jointID >= 0 && jointID < mNumJoints);
+	return mWeights[jointID];
+}
+
+void AJointMask::setBranchWeight(const ASkeleton* skeleton, int jointID, float weight)
+{
+	AJoint* joint = skeleton->getJointByID(jointID);
+	setWeight(jointID, weight);
+	for (unsigned int i = 0; i < joint->getNumChildren(); i++)
+	{
+		setBranchWeight(skeleton, joint->getChildAt(i)->getID(), weight);
+	}
+}
+
+/****************************************************************
+*
+*    	    Pose functions
+*
+****************************************************************/
+
+APose::APose() : mNumJoints(0), mStride(0)
+{
+	mRoot[0] = mRoot[1] = mRoot[2] = 0.0f;
+}
+
+APose::APose(int numJoints) : mNumJoints(0), mStride(0)
+{
+	resize(numJoints);
+}
+
+void APose::resize(int numJoints)
+{
+	mNumJoints = numJoints;
+	mStride = PaddedJoints(numJoints);
+	mData.resize(4 * mStride);
+	setIdentity();
+}
+
+void APose::setIdentity()
+{
+	// padding lanes stay identity so the blend kernels never normalize a zero quaternion
+	std::fill(mData.begin(), mData.begin() + 3 * mStride, 0.0f);
+	std::fill(mData.begin() + 3 * mStride, mData.end(), 1.0f);
+	mRoot[0] = mRoot[1] = mRoot[2] = 0.0f;
+}
+
+void APose::setJointRotation(int jointID, const quat& q)
+{
+	assert(jointID >= 0 && jointID < mNumJoints);
+	mData[QX * mStride + jointID] = (float)q.X();
+	mData[QY * mStride + jointID] = (float)q.Y();
+	mData[QZ * mStride + jointID] = (float)q.Z();
+	mData[QW * mStride + jointID] = (float)q.W();
+}
+
+quat APose::getJointRotation(int jointID) const
+{
+	assert(jointID >= 0 && jointID < mNumJoints);
+	return quat(mData[QW * mStride + jointID], mData[QX * mStride + jointID],
+		mData[QY * mStride + jointID], mData[QZ * mStride + jointID]);
+}
+
+void APose::setRootTranslation(const vec3& translation)
+{
+	mRoot[0] = (float)translation[0];
+	mRoot[1] = (float)translation[1];
+	mRoot[2] = (float)translation[2];
+}
+
+vec3 APose::getRootTranslation() const
+{
+	return vec3(mRoot[0], mRoot[1], mRoot[2]);
+}
+
+void APose::Blend(const APose& a, const APose& b, float weight, const AJointMask* mask, APose& out)
+{
+	assert(a.mNumJoints == b.mNumJoints);
+	assert(!mask || mask->getNumJoints() == a.mNumJoints);
+	if (out.mNumJoints != a.mNumJoints) out.resize(a.mNumJoints);
+
+	const int n = a.mStride;
+	const float* ax = a.getChannel(QX); const float* ay = a.getChannel(QY);
+	const float* az = a.getChannel(QZ); const float* aw = a.getChannel(QW);
+	const float* bx = b.getChannel(QX); const float* by = b.getChannel(QY);
+	const float* bz = b.getChannel(QZ); const float* bw = b.getChannel(QW);
+	float* ox = out.getChannel(QX); float* oy = out.getChannel(QY);
+	float* oz = out.getChannel(QZ); float* ow = out.getChannel(QW);
+	const float* m = mask ? mask->data() : 0;
+
+#ifdef APOSE_SSE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	const __m128 tiny = _mm_set1_ps(1e-12f);
+	const __m128 w4 = _mm_set1_ps(weight);
+	for (int j = 0; j < n; j += 4)
+	{
+		__m128 qax = _mm_loadu_ps(ax + j), qay = _mm_loadu_ps(ay + j), qaz = _mm_loadu_ps(az + j), qaw = _mm_loadu_ps(aw + j);
+		__m128 qbx = _mm_loadu_ps(bx + j), qby = _mm_loadu_ps(by + j), qbz = _mm_loadu_ps(bz + j), qbw = _mm_loadu_ps(bw + j);
+		__m128 t = m ? _mm_mul_ps(w4, _mm_loadu_ps(m + j)) : w4;
+
+		// flip b into the hemisphere of a so the blend takes the short arc
+		__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qax, qbx), _mm_mul_ps(qay, qby)),
+			_mm_add_ps(_mm_mul_ps(qaz, qbz), _mm_mul_ps(qaw, qbw)));
+		__m128 tb = _mm_xor_ps(t, _mm_and_ps(_mm_cmplt_ps(dot, zero), signBit));
+		__m128 ta = _mm_sub_ps(one, t);
+
+		__m128 rx = _mm_add_ps(_mm_mul_ps(qax, ta), _mm_mul_ps(qbx, tb));
+		__m128 ry = _mm_add_ps(_mm_mul_ps(qay, ta), _mm_mul_ps(qby, tb));
+		__m128 rz = _mm_add_ps(_mm_mul_ps(qaz, ta), _mm_mul_ps(qbz, tb));
+		__m128 rw = _mm_add_ps(_mm_mul_ps(qaw, ta), _mm_mul_ps(qbw, tb));
+
+		__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)),
+			_mm_add_ps(_mm_mul_ps(rz, rz), _mm_mul_ps(rw, rw)));
+		__m128 inv = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(len2, tiny)));
+
+		_mm_storeu_ps(ox + j, _mm_mul_ps(rx, inv));
+		_mm_storeu_ps(oy + j, _mm_mul_ps(ry, inv));
+		_mm_storeu_ps(oz + j, _mm_mul_ps(rz, inv));
+		_mm_storeu_ps(ow + j, _mm_mul_ps(rw, inv));
+	}
+#else
+	for (int j = 0; j < n; j++)
+	{
+		float t = m ? weight * m[j] : weight;
+		float dot = ax[j] * bx[j] + ay[j] * by[j] + az[j] * bz[j] + aw[j] * bw[j];
+		float tb = dot < 0.0f ? -t : t;
+		float ta = 1.0f - t;
+		float rx = ax[j] * ta + bx[j] * tb;
+		float ry = ay[j] * ta + by[j] * tb;
+		float rz = az[j] * ta + bz[j] * tb;
+		float rw = aw[j] * ta + bw[j] * tb;
+		float inv = 1.0f / sqrtf(std::max(rx * rx + ry * ry + rz * rz + rw * rw, 1e-12f));
+		ox[j] = rx * inv; oy[j] = ry * inv; oz[j] = rz * inv; ow[j] = rw * inv;
+	}
+#endif
+
+	for (int i = 0; i < 3; i++)
+	{
+		out.mRoot[i] = a.mRoot[i] * (1.0f - weight) + b.mRoot[i] * weight;
+	}
+}
+
+void APose::Additive(const APose& base, const APose& additive, const APose& reference,
+	float weight, const AJointMask* mask, APose& out)
+{
+	assert(base.mNumJoints == additive.mNumJoints && base.mNumJoints == reference.mNumJoints);
+	assert(!mask || mask->getNumJoints() == base.mNumJoints);
+	if (out.mNumJoints != base.mNumJoints) out.resize(base.mNumJoints);
+
+	const int n = base.mStride;
+	const float* px = base.getChannel(QX); const float* py = base.getChannel(QY);
+	const float* pz = base.getChannel(QZ); const float* pw = base.getChannel(QW);
+	const float* ax = additive.getChannel(QX); const float* ay = additive.getChannel(QY);
+	const float* az = additive.getChannel(QZ); const float* aw = additive.getChannel(QW);
+	const float* rx = reference.getChannel(QX); const float* ry = reference.getChannel(QY);
+	const float* rz = reference.getChannel(QZ); const float* rw = reference.getChannel(QW);
+	float* ox = out.getChannel(QX); float* oy = out.getChannel(QY);
+	float* oz = out.getChannel(QZ); float* ow = out.getChannel(QW);
+	const float* m = mask ? mask->data() : 0;
+
+#ifdef APOSE_SSE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	const __m128 tiny = _mm_set1_ps(1e-12f);
+	const __m128 w4 = _mm_set1_ps(weight);
+	for (int j = 0; j < n; j += 4)
+	{
+		// delta = conjugate(reference) * additive
+		__m128 cw = _mm_loadu_ps(rw + j);
+		__m128 cx = _mm_xor_ps(_mm_loadu_ps(rx + j), signBit);
+		__m128 cy = _mm_xor_ps(_mm_loadu_ps(ry + j), signBit);
+		__m128 cz = _mm_xor_ps(_mm_loadu_ps(rz + j), signBit);
+		__m128 qx = _mm_loadu_ps(ax + j), qy = _mm_loadu_ps(ay + j), qz = _mm_loadu_ps(az + j), qw = _mm_loadu_ps(aw + j);
+
+		__m128 dw = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(cw, qw), _mm_mul_ps(cx, qx)), _mm_add_ps(_mm_mul_ps(cy, qy), _mm_mul_ps(cz, qz)));
+		__m128 dx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cw, qx), _mm_mul_ps(cx, qw)), _mm_sub_ps(_mm_mul_ps(cy, qz), _mm_mul_ps(cz, qy)));
+		__m128 dy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cw, qy), _mm_mul_ps(cy, qw)), _mm_sub_ps(_mm_mul_ps(cz, qx), _mm_mul_ps(cx, qz)));
+		__m128 dz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cw, qz), _mm_mul_ps(cz, qw)), _mm_sub_ps(_mm_mul_ps(cx, qy), _mm_mul_ps(cy, qx)));
+
+		// scale delta by weight: nlerp(identity, delta, t) with delta flipped onto the positive-w hemisphere
+		__m128 t = m ? _mm_mul_ps(w4, _mm_loadu_ps(m + j)) : w4;
+		__m128 td = _mm_xor_ps(t, _mm_and_ps(_mm_cmplt_ps(dw, zero), signBit));
+		__m128 sx = _mm_mul_ps(dx, td);
+		__m128 sy = _mm_mul_ps(dy, td);
+		__m128 sz = _mm_mul_ps(dz, td);
+		__m128 sw = _mm_add_ps(_mm_sub_ps(one, t), _mm_mul_ps(dw, td));
+
+		// out = base * scaledDelta
+		__m128 bx = _mm_loadu_ps(px + j), by = _mm_loadu_ps(py + j), bz = _mm_loadu_ps(pz + j), bw = _mm_loadu_ps(pw + j);
+		__m128 ow4 = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(bw, sw), _mm_mul_ps(bx, sx)), _mm_add_ps(_mm_mul_ps(by, sy), _mm_mul_ps(bz, sz)));
+		__m128 ox4 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bw, sx), _mm_mul_ps(bx, sw)), _mm_sub_ps(_mm_mul_ps(by, sz), _mm_mul_ps(bz, sy)));
+		__m128 oy4 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bw, sy), _mm_mul_ps(by, sw)), _mm_sub_ps(_mm_mul_ps(bz, sx), _mm_mul_ps(bx, sz)));
+		__m128 oz4 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bw, sz), _mm_mul_ps(bz, sw)), _mm_sub_ps(_mm_mul_ps(bx, sy), _mm_mul_ps(by, sx)));
+
+		__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox4, ox4), _mm_mul_ps(oy4, oy4)),
+			_mm_add_ps(_mm_mul_ps(oz4, oz4), _mm_mul_ps(ow4, ow4)));
+		__m128 inv = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(len2, tiny)));
+
+		_mm_storeu_ps(ox + j, _mm_mul_ps(ox4, inv));
+		_mm_storeu_ps(oy + j, _mm_mul_ps(oy4, inv));
+		_mm_storeu_ps(oz + j, _mm_mul_ps(oz4, inv));
+		_mm_storeu_ps(ow + j, _mm_mul_ps(ow4, inv));
+	}
+#else
+	for (int j = 0; j < n; j++)
+	{
+		float cw = rw[j], cx = -rx[j], cy = -ry[j], cz = -rz[j];
+		float qx = ax[j], qy = ay[j], qz = az[j], qw = aw[j];
+		float dw = cw * qw - cx * qx - cy * qy - cz * qz;
+		float dx = cw * qx + cx * qw + cy * qz - cz * qy;
+		float dy = cw * qy + cy * qw + cz * qx - cx * qz;
+		float dz = cw * qz + cz * qw + cx * qy - cy * qx;
+
+		float t = m ? weight * m[j] : weight;
+		float td = dw < 0.0f ? -t : t;
+		float sx = dx * td, sy = dy * td, sz = dz * td, sw = (1.0f - t) + dw * td;
+
+		float bx = px[j], by = py[j], bz = pz[j], bw = pw[j];
+		float rw4 = bw * sw - bx * sx - by * sy - bz * sz;
+		float rx4 = bw * sx + bx * sw + by * sz - bz * sy;
+		float ry4 = bw * sy + by * sw + bz * sx - bx * sz;
+		float rz4 = bw * sz + bz * sw + bx * sy - by * sx;
+		float inv = 1.0f / sqrtf(std::max(rx4 * rx4 + ry4 * ry4 + rz4 * rz4 + rw4 * rw4, 1e-12f));
+		ox[j] = rx4 * inv; oy[j] = ry4 * inv; oz[j] = rz4 * inv; ow[j] = rw4 * inv;
+	}
+#endif
+
+	for (int i = 0; i < 3; i++)
+	{
+		out.mRoot[i] = base.mRoot[i] + weight * (additive.mRoot[i] - reference.mRoot[i]);
+	}
+}
+
+void APose::Multiply(const APose& a, const APose& b, const APose& c, APose& out)
+{
+	assert(a.mNumJoints == b.mNumJoints && a.mNumJoints == c.mNumJoints);
+	if (out.mNumJoints != a.mNumJoints) out.resize(a.mNumJoints);
+
+	const int n = a.mStride;
+	const float* ax = a.getChannel(QX); const float* ay = a.getChannel(QY);
+	const float* az = a.getChannel(QZ); const float* aw = a.getChannel(QW);
+	const float* bx = b.getChannel(QX); const float* by = b.getChannel(QY);
+	const float* bz = b.getChannel(QZ); const float* bw = b.getChannel(QW);
+	const float* cx = c.getChannel(QX); const float* cy = c.getChannel(QY);
+	const float* cz = c.getChannel(QZ); const float* cw = c.getChannel(QW);
+	float* ox = out.getChannel(QX); float* oy = out.getChannel(QY);
+	float* oz = out.getChannel(QZ); float* ow = out.getChannel(QW);
+
+#ifdef APOSE_SSE
+	for (int j = 0; j < n; j += 4)
+	{
+		// t = a * b
+		__m128 qax = _mm_loadu_ps(ax + j), qay = _mm_loadu_ps(ay + j), qaz = _mm_loadu_ps(az + j), qaw = _mm_loadu_ps(aw + j);
+		__m128 qbx = _mm_loadu_ps(bx + j), qby = _mm_loadu_ps(by + j), qbz = _mm_loadu_ps(bz + j), qbw = _mm_loadu_ps(bw + j);
+		__m128 tw = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(qaw, qbw), _mm_mul_ps(qax, qbx)), _mm_add_ps(_mm_mul_ps(qay, qby), _mm_mul_ps(qaz, qbz)));
+		__m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qaw, qbx), _mm_mul_ps(qax, qbw)), _mm_sub_ps(_mm_mul_ps(qay, qbz), _mm_mul_ps(qaz, qby)));
+		__m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qaw, qby), _mm_mul_ps(qay, qbw)), _mm_sub_ps(_mm_mul_ps(qaz, qbx), _mm_mul_ps(qax, qbz)));
+		__m128 tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qaw, qbz), _mm_mul_ps(qaz, qbw)), _mm_sub_ps(_mm_mul_ps(qax, qby), _mm_mul_ps(qay, qbx)));
+
+		// out = t * c
+		__m128 qcx = _mm_loadu_ps(cx + j), qcy = _mm_loadu_ps(cy + j), qcz = _mm_loadu_ps(cz + j), qcw = _mm_loadu_ps(cw + j);
+		_mm_storeu_ps(ow + j, _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(tw, qcw), _mm_mul_ps(tx, qcx)), _mm_add_ps(_mm_mul_ps(ty, qcy), _mm_mul_ps(tz, qcz))));
+		_mm_storeu_ps(ox + j, _mm_add_ps(_mm_add_ps(_mm_mul_ps(tw, qcx), _mm_mul_ps(tx, qcw)), _mm_sub_ps(_mm_mul_ps(ty, qcz), _mm_mul_ps(tz, qcy))));
+		_mm_storeu_ps(oy + j, _mm_add_ps(_mm_add_ps(_mm_mul_ps(tw, qcy), _mm_mul_ps(ty, qcw)), _mm_sub_ps(_mm_mul_ps(tz, qcx), _mm_mul_ps(tx, qcz))));
+		_mm_storeu_ps(oz + j, _mm_add_ps(_mm_add_ps(_mm_mul_ps(tw, qcz), _mm_mul_ps(tz, qcw)), _mm_sub_ps(_mm_mul_ps(tx, qcy), _mm_mul_ps(ty, qcx))));
+	}
+#else
+	for (int j = 0; j < n; j++)
+	{
+		float tw = aw[j] * bw[j] - ax[j] * bx[j] - ay[j] * by[j] - az[j] * bz[j];
+		float tx = aw[j] * bx[j] + ax[j] * bw[j] + ay[j] * bz[j] - az[j] * by[j];
+		float ty = aw[j] * by[j] + ay[j] * bw[j] + az[j] * bx[j] - ax[j] * bz[j];
+		float tz = aw[j] * bz[j] + az[j] * bw[j] + ax[j] * by[j] - ay[j] * bx[j];
+
+		float qcx = cx[j], qcy = cy[j], qcz = cz[j], qcw = cw[j];
+		ow[j] = tw * qcw - tx * qcx - ty * qcy - tz * qcz;
+		ox[j] = tw * qcx + tx * qcw + ty * qcz - tz * qcy;
+		oy[j] = tw * qcy + ty * qcw + tz * qcx - tx * qcz;
+		oz[j] = tw * qcz + tz * qcw + tx * qcy - ty * qcx;
+	}
+#endif
+
+	for (int i = 0; i < 3; i++)
+	{
+		out.mRoot[i] = b.mRoot[i];
+	}
+}
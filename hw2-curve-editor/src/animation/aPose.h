@@ -0,0 +1,76 @@
+#ifndef APOSE_H_
+#define APOSE_H_
+
+#include "aRotation.h"
+#include <vector>
+
+class ASkeleton;
+
+// Per-joint blend weights in [0, 1], padded the same way as APose so blend kernels can read it 4 joints at a time
+class AJointMask
+{
+public:
+	AJointMask();
+	AJointMask(int numJoints, float weight = 1.0f);
+
+	void resize(int numJoints, float weight = 1.0f);
+	int getNumJoints() const { return mNumJoints; }
+
+	void setWeight(int jointID, float weight);
+	float getWeight(int jointID) const;
+
+	// sets the weight of a joint and all of its descendants, e.g. to mask the upper body from the spine down
+	void setBranchWeight(const ASkeleton* skeleton, int jointID, float weight);
+
+	const float* data() const { return mWeights.data(); }
+
+protected:
+	int mNumJoints;
+	std::vector<float> mWeights;
+};
+
+// Flat pose layout used for blending: joint rotations stored as structure-of-arrays (x, y, z and w blocks),
+// each block padded to a multiple of 4 joints, plus the root translation
+class APose
+{
+public:
+	enum Channel { QX, QY, QZ, QW };
+
+	APose();
+	APose(int numJoints);
+
+	void resize(int numJoints);
+	int getNumJoints() const { return mNumJoints; }
+	int getStride() const { return mStride; }   // padded number of joints in each channel block
+
+	void setIdentity();
+
+	void setJointRotation(int jointID, const quat& q);
+	quat getJointRotation(int jointID) const;
+
+	void setRootTranslation(const vec3& translation);
+	vec3 getRootTranslation() const;
+
+	float* getChannel(Channel c) { return mData.data() + c * mStride; }
+	const float* getChannel(Channel c) const { return mData.data() + c * mStride; }
+
+	// out = nlerp(a, b, weight * mask[j]) per joint, root translation is lerped by weight. out may alias a or b
+	static void Blend(const APose& a, const APose& b, float weight, const AJointMask* mask, APose& out);
+
+	// out = base * nlerp(identity, reference^-1 * additive, weight * mask[j]) per joint,
+	// root translation = base + weight * (additive - reference). out may alias base
+	static void Additive(const APose& base, const APose& additive, const APose& reference,
+		float weight, const AJointMask* mask, APose& out);
+
+	// out = a * b * c per joint, e.g. to move rotations between the bind spaces of two skeletons.
+	// The root translation of b is copied. out may alias any input
+	static void Multiply(const APose& a, const APose& b, const APose& c, APose& out);
+
+protected:
+	int mNumJoints;
+	int mStride;
+	std::vector<float> mData;
+	float mRoot[3];
+};
+
+#endif
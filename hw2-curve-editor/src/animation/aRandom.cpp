@@ -0,0 +1,49 @@
+#include "aRandom.h"
+#include <cassert>
+
+ARandom::ARandom(unsigned long long seed, unsigned long long stream)
+{
+	setSeed(seed, stream);
+}
+
+ARandom::~ARandom()
+{
+}
+
+void ARandom::setSeed(unsigned long long seed, unsigned long long stream)
+{
+	// hashed twice so nearby seeds and streams give unrelated keys
+	mKey = Hash(Hash(seed + Golden) ^ (stream * 0xD1B54A32D192ED03ULL + 1));
+	mCounter = 0;
+}
+
+ARandom ARandom::getStream(unsigned long long stream) const
+{
+	ARandom random;
+	random.mKey = Hash(mKey ^ Hash(stream + Golden));
+	return random;
+}
+
+int ARandom::nextInt(int min, int max)
+{
+	assert(min <= max);
+	unsigned long long range = (unsigned long long)((long long)max - min) + 1;
+	// the multiply-shift maps the top 32 bits onto the range; the bias is at most range / 2^32
+	return min + (int)(((next() >> 32) * range) >> 32);
+}
+
+void ARandom::fill(float* values, int count, float min, float max)
+{
+	fill(values, count, min, max, mCounter);
+	mCounter += count;
+}
+
+void ARandom::fill(float* values, int count, float min, float max, unsigned long long counter) const
+{
+	// every number depends only on its own counter, so the iterations are independent; same numbers as getFloat
+	unsigned long long z = mKey + counter * Golden;
+	for (int i = 0; i < count; i++, z += Golden)
+	{
+		values[i] = min + (max - min) * ((float)(Hash(z) >> 40) * (1.0f / 16777216.0f));
+	}
+}
@@ -0,0 +1,61 @@
+#ifndef ARANDOM_H_
+#define ARANDOM_H_
+
+#pragma once
+
+// Counter-based random numbers: number n of a stream is a SplitMix64 hash of the stream key and n, so any
+// number can be drawn without drawing the ones before it and there is no shared state to lock. A generator
+// is a key and a counter, cheap to copy. Work spread over threads gets reproducible numbers by giving every
+// piece of work its own stream, derived from a stream id that does not depend on the thread, or by drawing
+// numbers at fixed counters of one stream
+class ARandom
+{
+public:
+	ARandom(unsigned long long seed = 0, unsigned long long stream = 0);
+	virtual ~ARandom();
+
+	// Restarts the generator on the given stream of seed
+	void setSeed(unsigned long long seed, unsigned long long stream = 0);
+	// Independent generator for the sub-stream id, starting at counter 0. Does not depend on the counter
+	ARandom getStream(unsigned long long stream) const;
+
+	unsigned long long getCounter() const { return mCounter; }
+	void setCounter(unsigned long long counter) { mCounter = counter; }
+
+	// Sequential draws, advancing the counter
+	unsigned long long next() { return get(mCounter++); }
+	float nextFloat() { return getFloat(mCounter++); }                                       // [0, 1)
+	float nextFloat(float min, float max) { return getFloat(mCounter++, min, max); }         // [min, max)
+	double nextDouble(double min, double max) { return getDouble(mCounter++, min, max); }    // [min, max)
+	int nextInt(int min, int max);                                                           // [min, max]
+	// Fills values with count numbers in [min, max) and advances the counter by count
+	void fill(float* values, int count, float min, float max);
+
+	// Draws at a given counter, leaving the generator alone
+	unsigned long long get(unsigned long long counter) const { return Hash(mKey + counter * Golden); }
+	float getFloat(unsigned long long counter) const { return (float)(get(counter) >> 40) * (1.0f / 16777216.0f); }
+	float getFloat(unsigned long long counter, float min, float max) const { return min + (max - min) * getFloat(counter); }
+	double getDouble(unsigned long long counter, double min, double max) const
+	{
+		return min + (max - min) * (double)(get(counter) >> 11) * (1.0 / 9007199254740992.0);
+	}
+	// Fills values with the numbers at counters [counter, counter + count) in [min, max)
+	void fill(float* values, int count, float min, float max, unsigned long long counter) const;
+
+protected:
+	static const unsigned long long Golden = 0x9E3779B97F4A7C15ULL;
+
+	// SplitMix64 finalizer
+	static unsigned long long Hash(unsigned long long z)
+	{
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+protected:
+	unsigned long long mKey;
+	unsigned long long mCounter;
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include "aRetargetMap.h"
+#include "aSkeleton.h"
+#include <algorithm>
+#include <cctype>
+
+#pragma warning(disable : 4018)
+
+// Global bind rotations and positions from the local transforms, parents first
+static void ComputeBindPose(const ASkeleton* skeleton, std::vector<quat>& rotations, std::vector<vec3>& positions)
+{
+	int numJoints = skeleton->getNumJoints();
+	rotations.assign(numJoints, quat(1, 0, 0, 0));
+	positions.assign(numJoints, vec3(0, 0, 0));
+	std::vector<bool> done(numJoints, false);
+	std::vector<AJoint*> chain;
+	for (int i = 0; i < numJoints; i++)
+	{
+		// joints may have been added before their parents, so walk up to the first finished ancestor
+		chain.clear();
+		for (AJoint* joint = skeleton->getJointByID(i); joint && !done[joint->getID()]; joint = joint->getParent())
+		{
+			chain.push_back(joint);
+		}
+		for (int k = (int)chain.size() - 1; k >= 0; k--)
+		{
+			AJoint* joint = chain[k];
+			AJoint* parent = joint->getParent();
+			quat local = joint->getLocalRotation().ToQuaternion();
+			int id = joint->getID();
+			if (parent)
+			{
+				rotations[id] = rotations[parent->getID()] * local;
+				positions[id] = positions[parent->getID()] + rotations[parent->getID()].ToRotation() * joint->getLocalTranslation();
+			}
+			else
+			{
+				rotations[id] = local;
+				positions[id] = joint->getLocalTranslation();
+			}
+			done[id] = true;
+		}
+	}
+}
+
+// Distance from the root down to the lowest joint in the bind pose
+static double GetBindHeight(const ASkeleton* skeleton, const std::vector<vec3>& positions)
+{
+	const AJoint* root = skeleton->getRootNode();
+	if (!root) return 0.0;
+	double height = 0.0;
+	for (unsigned int i = 0; i < positions.size(); i++)
+	{
+		height = std::max(height, positions[root->getID()][1] - positions[i][1]);
+	}
+	return height;
+}
+
+ARetargetMap::ARetargetMap() : mNumMapped(0), mRootScale(1.0f)
+{
+}
+
+ARetargetMap::~ARetargetMap()
+{
+}
+
+std::string ARetargetMap::NormalizeName(const std::string& name)
+{
+	size_t start = name.find_last_of(':');
+	std::string result = name.substr(start == std::string::npos ? 0 : start + 1);
+	for (unsigned int i = 0; i < result.size(); i++) result[i] = (char)tolower((unsigned char)result[i]);
+	return result;
+}
+
+void ARetargetMap::addCorrespondence(const std::string& targetJoint, const std::string& sourceJoint)
+{
+	mCorrespondences[NormalizeName(targetJoint)] = NormalizeName(sourceJoint);
+}
+
+int ARetargetMap::getSourceJoint(int targetJoint) const
+{
+	assert(targetJoint >= 0 && targetJoint < mSourceJoints.size());
+	return mSourceJoints[targetJoint];
+}
+
+bool ARetargetMap::build(const ASkeleton* source, const ASkeleton* target)
+{
+	int numSource = source->getNumJoints();
+	int numTarget = target->getNumJoints();
+	mSourceJoints.assign(numTarget, -1);
+	mPre.resize(numTarget);
+	mPost.resize(numTarget);
+	mNumMapped = 0;
+	mRootScale = 1.0f;
+	if (numSource == 0 || numTarget == 0 || !source->getRootNode() || !target->getRootNode()) return false;
+
+	std::map<std::string, int> sourceByName;
+	for (int i = 0; i < numSource; i++)
+	{
+		sourceByName[NormalizeName(source->getJointByID(i)->getName())] = i;
+	}
+
+	std::vector<quat> sourceRotations, targetRotations;
+	std::vector<vec3> sourcePositions, targetPositions;
+	ComputeBindPose(source, sourceRotations, sourcePositions);
+	ComputeBindPose(target, targetRotations, targetPositions);
+
+	for (int t = 0; t < numTarget; t++)
+	{
+		AJoint* targetJoint = target->getJointByID(t);
+		std::string name = NormalizeName(targetJoint->getName());
+		std::map<std::string, std::string>::const_iterator pair = mCorrespondences.find(name);
+		if (pair != mCorrespondences.end()) name = pair->second;
+		std::map<std::string, int>::const_iterator found = sourceByName.find(name);
+		if (found == sourceByName.end())
+		{
+			mPost.setJointRotation(t, targetJoint->getLocalRotation().ToQuaternion());
+			continue;
+		}
+
+		int s = found->second;
+		AJoint* sourceJoint = source->getJointByID(s);
+		quat targetParent = targetJoint->getParent() ? targetRotations[targetJoint->getParent()->getID()] : quat(1, 0, 0, 0);
+		quat sourceParent = sourceJoint->getParent() ? sourceRotations[sourceJoint->getParent()->getID()] : quat(1, 0, 0, 0);
+		mPre.setJointRotation(t, targetParent.Conjugate() * sourceParent);
+		mPost.setJointRotation(t, sourceRotations[s].Conjugate() * targetRotations[t]);
+
+		mSourceJoints[t] = s;
+		mNumMapped++;
+	}
+
+	double sourceHeight = GetBindHeight(source, sourcePositions);
+	double targetHeight = GetBindHeight(target, targetPositions);
+	if (sourceHeight > 1e-6 && targetHeight > 1e-6) mRootScale = (float)(targetHeight / sourceHeight);
+	mSourceRootBind = source->getRootNode()->getLocalTranslation();
+	mTargetRootBind = target->getRootNode()->getLocalTranslation();
+	return isValid();
+}
+
+void ARetargetMap::apply(const APose& source, APose& target) const
+{
+	int numTarget = mSourceJoints.size();
+	if (target.getNumJoints() != numTarget) target.resize(numTarget);
+
+	// gather the mapped source rotations into the target layout, identity for unmapped joints
+	float* channels[4] = { target.getChannel(APose::QX), target.getChannel(APose::QY),
+		target.getChannel(APose::QZ), target.getChannel(APose::QW) };
+	const float* sourceChannels[4] = { source.getChannel(APose::QX), source.getChannel(APose::QY),
+		source.getChannel(APose::QZ), source.getChannel(APose::QW) };
+	for (int c = 0; c < 4; c++)
+	{
+		float identity = c == APose::QW ? 1.0f : 0.0f;
+		const float* in = sourceChannels[c];
+		float* out = channels[c];
+		for (int t = 0; t < numTarget; t++)
+		{
+			int s = mSourceJoints[t];
+			out[t] = s >= 0 ? in[s] : identity;
+		}
+	}
+
+	APose::Multiply(mPre, target, mPost, target);
+	target.setRootTranslation(mTargetRootBind + (source.getRootTranslation() - mSourceRootBind) * mRootScale);
+}
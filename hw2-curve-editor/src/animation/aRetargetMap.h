@@ -0,0 +1,58 @@
+#ifndef ARETARGETMAP_H_
+#define ARETARGETMAP_H_
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include "aPose.h"
+
+class ASkeleton;
+
+// Precomputed mapping that moves poses of a source skeleton (e.g. a BVH clip) onto a target skeleton with
+// other joint names, bind orientations and bone lengths (e.g. a Unity rig). Built once per skeleton pair;
+// applying it is a gather of the mapped joints followed by one SIMD loop over the target joints.
+//
+// With B the global bind rotations, a source joint s mapped to a target joint t gives
+//   target local = pre * source local * post, with pre = B(parent(t))^-1 * B(parent(s)) and post = B(s)^-1 * B(t)
+// which keeps the world-space change of every mapped bone. Unmapped target joints keep their bind rotation.
+// Source joints between two mapped joints are assumed to stay at their bind rotation. Poses only carry
+// rotations below the root, so bones keep the target lengths and only the root motion is rescaled, by the
+// ratio of the hip heights
+class ARetargetMap
+{
+public:
+	ARetargetMap();
+	virtual ~ARetargetMap();
+
+	// Pairs joints whose names do not match; names are otherwise compared without namespace ("mixamorig:")
+	// and case. Takes effect at the next build()
+	void addCorrespondence(const std::string& targetJoint, const std::string& sourceJoint);
+
+	// Uses the current local transforms of both skeletons as their bind poses
+	bool build(const ASkeleton* source, const ASkeleton* target);
+	bool isValid() const { return mNumMapped > 0; }
+
+	int getNumTargetJoints() const { return (int)mSourceJoints.size(); }
+	int getNumMappedJoints() const { return mNumMapped; }
+	int getSourceJoint(int targetJoint) const;  // -1 when unmapped
+	float getRootScale() const { return mRootScale; } // target / source hip height, applied to the root motion
+
+	// source has the joints of the source skeleton, target receives the joints of the target skeleton
+	void apply(const APose& source, APose& target) const;
+
+protected:
+	static std::string NormalizeName(const std::string& name);
+
+protected:
+	std::map<std::string, std::string> mCorrespondences; // normalized target name -> normalized source name
+	std::vector<int> mSourceJoints;
+	int mNumMapped;
+	APose mPre;        // per target joint, identity padding
+	APose mPost;       // per target joint; the bind rotation for unmapped joints
+	vec3 mSourceRootBind, mTargetRootBind;
+	float mRootScale;
+};
+
+#endif
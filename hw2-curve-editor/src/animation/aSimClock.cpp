@@ -0,0 +1,49 @@
+#include "aSimClock.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+ASimClock::ASimClock(double step, int maxSubsteps) :
+	mStep(step), mMaxSubsteps(maxSubsteps), mAccumulator(0.0), mTime(0.0), mNumDropped(0)
+{
+	assert(step > 0.0 && maxSubsteps > 0);
+}
+
+ASimClock::~ASimClock()
+{
+}
+
+void ASimClock::setStep(double step)
+{
+	assert(step > 0.0);
+	// keep the interpolation factor where it was
+	mAccumulator = mAccumulator / mStep * step;
+	mStep = step;
+}
+
+void ASimClock::setMaxSubsteps(int maxSubsteps)
+{
+	mMaxSubsteps = std::max(maxSubsteps, 1);
+}
+
+int ASimClock::advance(double frameTime)
+{
+	mAccumulator += std::max(frameTime, 0.0);
+	int numSteps = (int)(mAccumulator / mStep);
+	if (numSteps > mMaxSubsteps)
+	{
+		mNumDropped += numSteps - mMaxSubsteps;
+		numSteps = mMaxSubsteps;
+		mAccumulator = std::fmod(mAccumulator, mStep) + numSteps * mStep;
+	}
+	mAccumulator = std::max(mAccumulator - numSteps * mStep, 0.0);
+	mTime += numSteps * mStep;
+	return numSteps;
+}
+
+void ASimClock::reset()
+{
+	mAccumulator = 0.0;
+	mTime = 0.0;
+	mNumDropped = 0;
+}
@@ -0,0 +1,41 @@
+#ifndef ASIMCLOCK_H_
+#define ASIMCLOCK_H_
+
+#pragma once
+
+// Fixed-step simulation clock. Frame times go into an accumulator that is drained in steps of one fixed size,
+// so the simulation does the same work and gives the same result at any frame rate. What is left in the
+// accumulator is how far the render time is past the latest simulation state, used to interpolate between
+// the two latest states
+class ASimClock
+{
+public:
+	ASimClock(double step = 1.0 / 60.0, int maxSubsteps = 4);
+	virtual ~ASimClock();
+
+	void setStep(double step);
+	double getStep() const { return mStep; }
+	void setMaxSubsteps(int maxSubsteps);
+	int getMaxSubsteps() const { return mMaxSubsteps; }
+
+	// Adds frameTime to the accumulator and returns how many steps to run for this frame, at most
+	// maxSubsteps. The time past the cap is dropped: under load the simulation slows down instead of
+	// spending ever more steps catching up
+	int advance(double frameTime);
+	// How far the render time is past the latest state, in steps: 0 draws the state before the latest
+	// step, 1 the latest state
+	float getAlpha() const { return (float)(mAccumulator / mStep); }
+
+	double getTime() const { return mTime; }           // simulated time
+	int getNumDroppedSteps() const { return mNumDropped; }
+	void reset();
+
+protected:
+	double mStep;
+	int mMaxSubsteps;
+	double mAccumulator;
+	double mTime;
+	int mNumDropped;
+};
+
+#endif
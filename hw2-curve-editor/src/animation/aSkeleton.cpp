@@ -80,6 +80,7 @@ void ASkeleton::copyHierarchy(const ASkeleton* inputSkeleton)
 		}
 	}
 	mJointCount = mJoints.size();
+	mHierarchyVersion++;
 }
 
 
@@ -120,6 +121,7 @@ void ASkeleton::clear()
 {
 	mRoot = NULL;
 	mJoints.clear();
+	mHierarchyVersion++;
 }
 
 void ASkeleton::update()
@@ -158,6 +160,7 @@ void ASkeleton::addJoint(AJoint* jointnode, bool isRoot)
 	mJoints.push_back(jointnode);
 	if (isRoot) mRoot = jointnode;
 	mJointCount = mJoints.size();
+	mHierarchyVersion++;
 }
 
 void ASkeleton::deleteJoint(const std::string& name)
@@ -187,4 +190,5 @@ void ASkeleton::deleteJoint(const std::string& name)
 	mJoints.resize(mJoints.size() - 1);
 	delete jointnode;
 	mJointCount = mJoints.size();
+	mHierarchyVersion++;
 }
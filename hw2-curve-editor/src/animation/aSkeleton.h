@@ -33,10 +33,15 @@ public:
 
 	size_t getNumJoints() const { return mJoints.size(); }
 
+	// changes whenever joints are added, deleted or copied through this class, so joint pointers taken
+	// from an older version must not be used
+	unsigned int getHierarchyVersion() const { return mHierarchyVersion; }
+
 protected:
 	std::vector<AJoint*> mJoints;
 	int mJointCount = 0;
 	AJoint* mRoot;
+	unsigned int mHierarchyVersion = 0;
 };
 
 
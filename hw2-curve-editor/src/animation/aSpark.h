@@ -14,6 +14,8 @@
 #define REPELLER_ACTIVE 0x08
 #define RANDOM_ACTIVE 0x10
 #define EXT_SPARKFORCES_ACTIVE 0x20
+#define FORCEFIELDS_ACTIVE 0x80    // AFireworks::m_forceFields
+#define INTERACTIONS_ACTIVE 0x100  // AFireworks::m_sparkInteraction between the sparks
 
 
 /* State vector - inherited from AParticle
@@ -0,0 +1,156 @@
+#include "aSpatialHash.h"
+#include "aThreadPool.h"
+#include <algorithm>
+#include <cassert>
+
+#pragma warning(disable : 4018)
+
+// Runs step(task) for task in [0, numTasks) on pool, or on the calling thread
+static void RunTasks(AThreadPool* pool, int numTasks, const std::function<void(int)>& step)
+{
+	if (!pool || numTasks <= 1)
+	{
+		for (int task = 0; task < numTasks; task++) step(task);
+		return;
+	}
+	for (int task = 0; task < numTasks; task++)
+	{
+		pool->run([&step, task] { step(task); });
+	}
+	pool->wait();
+}
+
+ASpatialHash::ASpatialHash(float cellSize) : mNumBuckets(1)
+{
+	setCellSize(cellSize);
+	mBucketStart.assign(2, 0);
+}
+
+ASpatialHash::~ASpatialHash()
+{
+}
+
+void ASpatialHash::setCellSize(float cellSize)
+{
+	assert(cellSize > 0.0f);
+	mCellSize = cellSize;
+	mInvCellSize = 1.0f / cellSize;
+}
+
+void ASpatialHash::build(const AParticleArray& particles, AThreadPool* pool)
+{
+	int numParticles = particles.size();
+	int numBuckets = 1024;
+	while (numBuckets < numParticles) numBuckets *= 2;
+	mNumBuckets = numBuckets;
+
+	// the chunks of particles are histogrammed and scattered in parallel, the buckets are scanned in parallel ranges
+	int numChunks = pool ? std::max(std::min(pool->getNumThreads(), (numParticles + 4095) / 4096), 1) : 1;
+	int numRanges = pool ? pool->getNumThreads() : 1;
+	mBucketStart.resize(numBuckets + 1);
+	mIndices.resize(numParticles);
+	mSlots.resize(numParticles);
+	mSortedCells.resize(numParticles);
+	for (int c = 0; c < 6; c++) mSorted[c].resize(numParticles);
+	mBuckets.resize(numParticles);
+	mCounts.resize((size_t)numChunks * numBuckets);
+
+	const float* position[3] = { particles.getChannel(AParticleArray::PX), particles.getChannel(AParticleArray::PY),
+		particles.getChannel(AParticleArray::PZ) };
+	const float* velocity[3] = { particles.getChannel(AParticleArray::VX), particles.getChannel(AParticleArray::VY),
+		particles.getChannel(AParticleArray::VZ) };
+
+	// bucket of every particle and histogram of every chunk
+	RunTasks(pool, numChunks, [&](int chunk)
+	{
+		int* counts = &mCounts[(size_t)chunk * numBuckets];
+		std::fill(counts, counts + numBuckets, 0);
+		int first = (int)((long long)numParticles * chunk / numChunks);
+		int last = (int)((long long)numParticles * (chunk + 1) / numChunks);
+		for (int i = first; i < last; i++)
+		{
+			int bucket = getBucket(getCell(position[0][i]), getCell(position[1][i]), getCell(position[2][i]));
+			mBuckets[i] = bucket;
+			counts[bucket]++;
+		}
+	});
+
+	// bucket totals per range of buckets, then the start of every range
+	std::vector<int> rangeStart(numRanges + 1, 0);
+	RunTasks(pool, numRanges, [&](int range)
+	{
+		int first = (int)((long long)numBuckets * range / numRanges);
+		int last = (int)((long long)numBuckets * (range + 1) / numRanges);
+		int total = 0;
+		for (int chunk = 0; chunk < numChunks; chunk++)
+		{
+			const int* counts = &mCounts[(size_t)chunk * numBuckets];
+			for (int bucket = first; bucket < last; bucket++) total += counts[bucket];
+		}
+		rangeStart[range + 1] = total;
+	});
+	for (int range = 0; range < numRanges; range++) rangeStart[range + 1] += rangeStart[range];
+
+	// start of every bucket, and where every chunk writes its particles of the bucket: after the earlier chunks
+	RunTasks(pool, numRanges, [&](int range)
+	{
+		int first = (int)((long long)numBuckets * range / numRanges);
+		int last = (int)((long long)numBuckets * (range + 1) / numRanges);
+		int offset = rangeStart[range];
+		for (int bucket = first; bucket < last; bucket++)
+		{
+			mBucketStart[bucket] = offset;
+			for (int chunk = 0; chunk < numChunks; chunk++)
+			{
+				int& count = mCounts[(size_t)chunk * numBuckets + bucket];
+				int n = count;
+				count = offset;
+				offset += n;
+			}
+		}
+	});
+	mBucketStart[numBuckets] = numParticles;
+
+	// scatter in particle order, so the sort is stable
+	RunTasks(pool, numChunks, [&](int chunk)
+	{
+		int* offsets = &mCounts[(size_t)chunk * numBuckets];
+		int first = (int)((long long)numParticles * chunk / numChunks);
+		int last = (int)((long long)numParticles * (chunk + 1) / numChunks);
+		for (int i = first; i < last; i++)
+		{
+			int slot = offsets[mBuckets[i]]++;
+			mIndices[slot] = i;
+			mSlots[i] = slot;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				mSorted[axis][slot] = position[axis][i];
+				mSorted[axis + 3][slot] = velocity[axis][i];
+			}
+			mSortedCells[slot] = CellKey(getCell(position[0][i]), getCell(position[1][i]), getCell(position[2][i]));
+		}
+	});
+}
+
+int ASpatialHash::findNeighbors(float x, float y, float z, float radius, int* neighbors, int maxNeighbors) const
+{
+	int count = 0;
+	forEachNeighbor(x, y, z, radius, [&count, neighbors, maxNeighbors](int j, float, float, float, float)
+	{
+		if (count < maxNeighbors) neighbors[count] = j;
+		count++;
+	});
+	return std::min(count, maxNeighbors);
+}
+
+vec3 ASpatialHash::getPosition(int i) const
+{
+	int slot = mSlots[i];
+	return vec3(mSorted[0][slot], mSorted[1][slot], mSorted[2][slot]);
+}
+
+vec3 ASpatialHash::getVelocity(int i) const
+{
+	int slot = mSlots[i];
+	return vec3(mSorted[3][slot], mSorted[4][slot], mSorted[5][slot]);
+}
@@ -0,0 +1,116 @@
+#ifndef ASPATIALHASH_H_
+#define ASPATIALHASH_H_
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include "aParticleArray.h"
+
+class AThreadPool;
+
+// Uniform grid over the particle positions, with the cells hashed into a table of about one bucket per particle
+// so the grid needs no bounds. Rebuilt from scratch every step by a counting sort of the particles by bucket:
+// the particles of a bucket end up next to each other with their positions and velocities copied alongside,
+// so a neighbour search reads a few contiguous runs. The sort is stable, so the order within a bucket, and
+// every sum over neighbours, does not depend on the number of threads that built it
+class ASpatialHash
+{
+public:
+	ASpatialHash(float cellSize = 5.0f);
+	virtual ~ASpatialHash();
+
+	// Neighbours are searched in the 27 cells around a point, so the cell size must be at least the search radius
+	void setCellSize(float cellSize);
+	float getCellSize() const { return mCellSize; }
+
+	// Sorts the particles into their cells, spread over pool when it is not NULL. The state of the particles at
+	// this point is what the queries see
+	void build(const AParticleArray& particles, AThreadPool* pool = NULL);
+	int getNumParticles() const { return (int)mIndices.size(); }
+	// Particle index at a sorted slot. Going through the particles in slot order visits them cell by cell, which
+	// keeps the cells around them in cache
+	int getSortedIndex(int slot) const { return mIndices[slot]; }
+
+	// Calls visit(j, dx, dy, dz, distance2) for every particle j within radius of (x, y, z), radius at most the
+	// cell size, where (dx, dy, dz) is the offset from the point to j at the last build
+	template <class Visitor>
+	void forEachNeighbor(float x, float y, float z, float radius, const Visitor& visit) const;
+	// Same around particle i, which is not visited itself, with the state of i at the last build
+	template <class Visitor>
+	void forEachNeighbor(int i, float radius, const Visitor& visit) const;
+	// Writes up to maxNeighbors indices of the particles within radius of (x, y, z) and returns how many were found
+	int findNeighbors(float x, float y, float z, float radius, int* neighbors, int maxNeighbors) const;
+
+	// Position and velocity of particle i at the last build
+	vec3 getPosition(int i) const;
+	vec3 getVelocity(int i) const;
+
+protected:
+	// 21 bits per axis, wrapping around far beyond any scene
+	static unsigned long long CellKey(int ix, int iy, int iz)
+	{
+		const unsigned long long mask = (1ULL << 21) - 1;
+		return ((unsigned long long)ix & mask) | (((unsigned long long)iy & mask) << 21) | (((unsigned long long)iz & mask) << 42);
+	}
+	int getBucket(int ix, int iy, int iz) const
+	{
+		return (int)(((unsigned int)ix * 73856093u ^ (unsigned int)iy * 19349663u ^ (unsigned int)iz * 83492791u) & (mNumBuckets - 1));
+	}
+	int getCell(float x) const { return (int)floorf(x * mInvCellSize); }
+
+protected:
+	float mCellSize;
+	float mInvCellSize;
+	int mNumBuckets;                     // power of 2
+	std::vector<int> mBucketStart;       // first sorted slot of every bucket, mNumBuckets + 1 entries
+	std::vector<int> mIndices;           // particle index of every sorted slot
+	std::vector<int> mSlots;             // sorted slot of every particle
+	std::vector<float> mSorted[6];       // position and velocity of every sorted slot
+	std::vector<unsigned long long> mSortedCells;   // cell key of every sorted slot, to skip the other cells of a bucket
+	std::vector<int> mBuckets;           // bucket of every particle
+	std::vector<int> mCounts;            // bucket histogram, then write offsets, of every chunk of particles
+};
+
+template <class Visitor>
+void ASpatialHash::forEachNeighbor(float x, float y, float z, float radius, const Visitor& visit) const
+{
+	if (mIndices.empty()) return;
+	float radius2 = radius * radius;
+	int cx = getCell(x), cy = getCell(y), cz = getCell(z);
+	const float* px = mSorted[0].data();
+	const float* py = mSorted[1].data();
+	const float* pz = mSorted[2].data();
+	for (int ix = cx - 1; ix <= cx + 1; ix++)
+	{
+		for (int iy = cy - 1; iy <= cy + 1; iy++)
+		{
+			for (int iz = cz - 1; iz <= cz + 1; iz++)
+			{
+				// cells sharing a bucket are told apart by their key, so no particle is visited twice
+				unsigned long long key = CellKey(ix, iy, iz);
+				int bucket = getBucket(ix, iy, iz);
+				for (int slot = mBucketStart[bucket]; slot < mBucketStart[bucket + 1]; slot++)
+				{
+					if (mSortedCells[slot] != key) continue;
+					float dx = px[slot] - x, dy = py[slot] - y, dz = pz[slot] - z;
+					float distance2 = dx * dx + dy * dy + dz * dz;
+					if (distance2 <= radius2) visit(mIndices[slot], dx, dy, dz, distance2);
+				}
+			}
+		}
+	}
+}
+
+template <class Visitor>
+void ASpatialHash::forEachNeighbor(int i, float radius, const Visitor& visit) const
+{
+	int slot = mSlots[i];
+	forEachNeighbor(mSorted[0][slot], mSorted[1][slot], mSorted[2][slot], radius,
+		[i, &visit](int j, float dx, float dy, float dz, float distance2)
+	{
+		if (j != i) visit(j, dx, dy, dz, distance2);
+	});
+}
+
+#endif
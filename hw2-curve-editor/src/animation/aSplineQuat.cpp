@@ -43,29 +43,21 @@ double ASplineQuat::getFramerate() const
 
 int ASplineQuat::getCurveSegment(double time)
 {
-	int segment = 0;
-	bool foundSegment = false;
-
 	double t = time;
 	if (t < 0.0)
 		t = 0.0;
 
+	// keys are sorted by time: the segment starts at the last key not after t.
+	// A binary search keeps cacheCurve from going quadratic on long clips
 	int numKeys = mKeys.size();
-	while (!foundSegment) {
-		if (segment == numKeys - 1) {
-			segment = numKeys - 2;
-			foundSegment = true;
-		}
-		else {
-			double keyTime0 = mKeys[segment].first;
-			double keyTime1 = mKeys[segment + 1].first;
-			if ((t >= keyTime0) && (t < keyTime1))
-				 foundSegment = true;
-			else segment++;
-		}
+	int lo = 0, hi = numKeys;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (mKeys[mid].first <= t) lo = mid + 1;
+		else hi = mid;
 	}
-	return segment;
-
+	return std::max(0, std::min(lo - 1, numKeys - 2));
 }
 
 
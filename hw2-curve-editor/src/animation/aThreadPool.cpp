@@ -0,0 +1,70 @@
+#include "aThreadPool.h"
+#include <algorithm>
+
+#pragma warning(disable : 4018)
+
+AThreadPool::AThreadPool(int numThreads) : mNumRunning(0), mQuit(false)
+{
+	if (numThreads <= 0) numThreads = std::max(1u, std::thread::hardware_concurrency());
+	for (int i = 0; i < numThreads; i++)
+	{
+		mThreads.push_back(std::thread(&AThreadPool::workerLoop, this));
+	}
+}
+
+AThreadPool::~AThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTasks.clear();
+		mQuit = true;
+	}
+	mWake.notify_all();
+	for (unsigned int i = 0; i < mThreads.size(); i++)
+	{
+		mThreads[i].join();
+	}
+}
+
+void AThreadPool::run(const std::function<void()>& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTasks.push_back(task);
+	}
+	mWake.notify_one();
+}
+
+void AThreadPool::cancel()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mTasks.clear();
+	if (mNumRunning == 0) mIdle.notify_all();
+}
+
+void AThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mIdle.wait(lock, [this] { return mTasks.empty() && mNumRunning == 0; });
+}
+
+void AThreadPool::workerLoop()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true)
+	{
+		mWake.wait(lock, [this] { return mQuit || !mTasks.empty(); });
+		if (mQuit) break;
+
+		std::function<void()> task = mTasks.front();
+		mTasks.pop_front();
+		mNumRunning++;
+
+		lock.unlock();
+		task();
+		lock.lock();
+
+		mNumRunning--;
+		if (mTasks.empty() && mNumRunning == 0) mIdle.notify_all();
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef ATHREADPOOL_H_
+#define ATHREADPOOL_H_
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Fixed set of worker threads running queued tasks in FIFO order
+class AThreadPool
+{
+public:
+	// numThreads <= 0 uses one thread per hardware thread
+	AThreadPool(int numThreads = 0);
+	virtual ~AThreadPool();
+
+	int getNumThreads() const { return (int)mThreads.size(); }
+
+	void run(const std::function<void()>& task);
+	// Drops the tasks that have not started yet
+	void cancel();
+	// Blocks until the queue is empty and no task is running
+	void wait();
+
+protected:
+	void workerLoop();
+
+protected:
+	std::vector<std::thread> mThreads;
+	std::deque<std::function<void()>> mTasks;
+	int mNumRunning;
+	bool mQuit;
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::condition_variable mIdle;
+};
+
+#endif
@@ -8,7 +8,11 @@
 #include "aBVHController.h"
 #include "aJoint.h"
 #include "aActor.h"
+#include "aRetargetMap.h"
+#include "aThreadPool.h"
+#include "aHeightField.h"
 #include <unordered_map>
+#include <algorithm>
 
 struct JointData
 {
@@ -17,6 +21,41 @@ struct JointData
 	float localTranslation[3]; // Vector3
 };
 
+// Retarget map between two actors of the pool with the poses it works on
+struct RetargetData
+{
+	int sourceId;
+	int targetId;
+	ARetargetMap map;
+	APose sourcePose;
+	APose targetPose;
+};
+
+// One target of SolveIKBatch
+struct IKBatchRecord
+{
+	int actorId;
+	int jointId;       // end joint, or the root joint to move the root
+	float target[3];   // Vector3
+};
+
+// Solver statistics of an actor for one IK type, see IKController::SolverStats
+struct IKStatsData
+{
+	int numSolves;
+	int numExits[IKController::NUM_EXIT_REASONS];  // converged, max iterations, time budget, invalid chain
+	int numIterations;
+	float totalTimeMs;
+	float maxTimeMs;
+	int timeHistogram[IKController::NumHistogramBins];      // bin 0 < 1 us, bin i [2^(i-1), 2^i) us
+	int iterationHistogram[IKController::NumHistogramBins]; // bin 0 no iteration, bin i [2^(i-1), 2^i)
+	int lastEndJointId;
+	int lastIterations;
+	float lastError;
+	int lastExitReason;
+	float lastTimeMs;
+};
+
 class FKIKPluginManager
 {
 public:
@@ -24,6 +63,27 @@ public:
 
 	std::unordered_map<int, std::unique_ptr<AActor>> mActorPool;
 	int mCurrentIndex = 0;
+	std::unordered_map<int, std::unique_ptr<RetargetData>> mRetargetPool;
+	int mCurrentRetargetIndex = 0;
+
+	// SolveIKBatch state, kept between calls so a batch of the same size allocates nothing
+	struct IKBatchGroup
+	{
+		int actorId;
+		AActor* actor;     // NULL for unknown actor IDs
+		int firstRecord;   // into mBatchJointIDs/mBatchTargets
+		int numRecords;
+		int poseOffset;    // into the pose buffer
+	};
+	std::unique_ptr<AThreadPool> mIKThreadPool;  // created by the first batch
+	std::vector<int> mBatchOrder;
+	std::vector<int> mBatchJointIDs;
+	std::vector<vec3> mBatchTargets;
+	std::vector<IKBatchGroup> mBatchGroups;
+	std::vector<int> mBatchActorIDs;
+
+	std::unordered_map<int, std::unique_ptr<AHeightField>> mHeightFieldPool;
+	int mCurrentHeightFieldIndex = 0;
 
 	int CreateActor()
 	{
@@ -37,6 +97,42 @@ public:
 		mActorPool.erase(id);
 	}
 
+	int CreateRetargetMap(int sourceId, int targetId)
+	{
+		auto source = mActorPool.find(sourceId);
+		auto target = mActorPool.find(targetId);
+		if (source == mActorPool.end() || target == mActorPool.end()) return -1;
+
+		std::unique_ptr<RetargetData> data = std::make_unique<RetargetData>();
+		data->sourceId = sourceId;
+		data->targetId = targetId;
+		if (!data->map.build(source->second->getSkeleton(), target->second->getSkeleton()))
+		{
+			return -1;
+		}
+		mRetargetPool.insert({ mCurrentRetargetIndex, std::move(data) });
+		mCurrentRetargetIndex++;
+		return mCurrentRetargetIndex - 1;
+	}
+
+	void RemoveRetargetMap(int mapId)
+	{
+		mRetargetPool.erase(mapId);
+	}
+
+	void RetargetBVHPose(int mapId, float t)
+	{
+		auto found = mRetargetPool.find(mapId);
+		if (found == mRetargetPool.end()) return;
+		RetargetData& data = *found->second;
+		auto source = mActorPool.find(data.sourceId);
+		auto target = mActorPool.find(data.targetId);
+		if (source == mActorPool.end() || target == mActorPool.end()) return;
+		source->second->getBVHController()->samplePose(t, data.sourcePose);
+		data.map.apply(data.sourcePose, data.targetPose);
+		target->second->getBVHController()->applyPose(data.targetPose);
+	}
+
 	int CreateJoint(int id, char* name, bool isRoot)
 	{
 		AJoint* joint = new AJoint(name);
@@ -161,6 +257,147 @@ public:
 		mActorPool[id]->getIKController()->IKSolver_Limb(jointID, target);
 	}
 
+	int SolveIKBatch(const IKBatchRecord* records, int numRecords, int ikType, float* poses, int poseBufferSize)
+	{
+		if (ikType < 0 || ikType >= IKController::NumIKTypes) return 0;
+
+		// group the records by actor, keeping the order of the records of each actor
+		mBatchOrder.resize(numRecords);
+		for (int i = 0; i < numRecords; i++) mBatchOrder[i] = i;
+		std::stable_sort(mBatchOrder.begin(), mBatchOrder.end(),
+			[records](int a, int b) { return records[a].actorId < records[b].actorId; });
+
+		mBatchJointIDs.resize(numRecords);
+		mBatchTargets.resize(numRecords);
+		mBatchGroups.clear();
+		int poseSize = 0;
+		for (int i = 0; i < numRecords; i++)
+		{
+			const IKBatchRecord& record = records[mBatchOrder[i]];
+			mBatchJointIDs[i] = record.jointId;
+			mBatchTargets[i] = vec3(record.target[0], record.target[1], record.target[2]);
+			if (mBatchGroups.empty() || mBatchGroups.back().actorId != record.actorId)
+			{
+				auto actor = mActorPool.find(record.actorId);
+				IKBatchGroup group = { record.actorId, actor == mActorPool.end() ? NULL : actor->second.get(), i, 0, poseSize };
+				if (group.actor) poseSize += 3 + 4 * (int)group.actor->getSkeleton()->getNumJoints();
+				mBatchGroups.push_back(group);
+			}
+			mBatchGroups.back().numRecords++;
+		}
+		if (!poses || poseBufferSize < poseSize) poses = NULL;
+
+		IKController::IKType type = static_cast<IKController::IKType>(ikType);
+		RunBatch([this, type](const IKBatchGroup& group)
+		{
+			group.actor->getIKController()->solveBatch(type, group.numRecords,
+				&mBatchJointIDs[group.firstRecord], &mBatchTargets[group.firstRecord]);
+		}, poses);
+		return poseSize;
+	}
+
+	int CreateHeightField(int numX, int numZ, float originX, float originZ, float cellSize, const float* heights)
+	{
+		std::unique_ptr<AHeightField> terrain = std::make_unique<AHeightField>();
+		if (!terrain->set(numX, numZ, originX, originZ, cellSize, heights))
+		{
+			return -1;
+		}
+		mHeightFieldPool.insert({ mCurrentHeightFieldIndex, std::move(terrain) });
+		mCurrentHeightFieldIndex++;
+		return mCurrentHeightFieldIndex - 1;
+	}
+
+	void RemoveHeightField(int terrainId)
+	{
+		mHeightFieldPool.erase(terrainId);
+	}
+
+	void SetHeightFieldHeights(int terrainId, const float* heights)
+	{
+		auto found = mHeightFieldPool.find(terrainId);
+		if (found == mHeightFieldPool.end()) return;
+		found->second->setHeights(heights);
+	}
+
+	int SolveFootIKBatch(int terrainId, const int* actorIds, int numActors, bool rotateFeet, float* poses, int poseBufferSize)
+	{
+		auto found = mHeightFieldPool.find(terrainId);
+		if (found == mHeightFieldPool.end()) return 0;
+		const AHeightField* terrain = found->second.get();
+
+		// every actor once, by increasing ID like SolveIKBatch
+		mBatchActorIDs.assign(actorIds, actorIds + numActors);
+		std::sort(mBatchActorIDs.begin(), mBatchActorIDs.end());
+		mBatchActorIDs.erase(std::unique(mBatchActorIDs.begin(), mBatchActorIDs.end()), mBatchActorIDs.end());
+
+		mBatchGroups.clear();
+		int poseSize = 0;
+		for (unsigned int i = 0; i < mBatchActorIDs.size(); i++)
+		{
+			auto actor = mActorPool.find(mBatchActorIDs[i]);
+			IKBatchGroup group = { mBatchActorIDs[i], actor == mActorPool.end() ? NULL : actor->second.get(), 0, 0, poseSize };
+			if (group.actor) poseSize += 3 + 4 * (int)group.actor->getSkeleton()->getNumJoints();
+			mBatchGroups.push_back(group);
+		}
+		if (!poses || poseBufferSize < poseSize) poses = NULL;
+
+		RunBatch([terrain, rotateFeet](const IKBatchGroup& group)
+		{
+			group.actor->solveFootIK(*terrain, rotateFeet, rotateFeet);
+		}, poses);
+		return poseSize;
+	}
+
+	// Runs solve on every known actor of mBatchGroups and writes their poses when poses is not NULL.
+	// Actors are independent, so each task of the IK thread pool takes a contiguous range of them
+	template <typename Solve>
+	void RunBatch(const Solve& solve, float* poses)
+	{
+		auto solveRange = [this, &solve, poses](int begin, int end)
+		{
+			for (int g = begin; g < end; g++)
+			{
+				const IKBatchGroup& group = mBatchGroups[g];
+				if (!group.actor) continue;
+				solve(group);
+				if (poses) WritePose(group.actor->getSkeleton(), poses + group.poseOffset);
+			}
+		};
+
+		if (!mIKThreadPool) mIKThreadPool = std::make_unique<AThreadPool>();
+		int numGroups = mBatchGroups.size();
+		int numTasks = std::min(numGroups, 4 * mIKThreadPool->getNumThreads());
+		if (numTasks <= 1)
+		{
+			solveRange(0, numGroups);
+			return;
+		}
+		for (int task = 0; task < numTasks; task++)
+		{
+			int begin = numGroups * task / numTasks;
+			int end = numGroups * (task + 1) / numTasks;
+			mIKThreadPool->run([&solveRange, begin, end] { solveRange(begin, end); });
+		}
+		mIKThreadPool->wait();
+	}
+
+	// Root translation followed by the local rotation (w x y z) of every joint
+	static void WritePose(const ASkeleton* skeleton, float* pose)
+	{
+		vec3 root = skeleton->getRootNode() ? skeleton->getRootNode()->getLocalTranslation() : vec3(0, 0, 0);
+		pose[0] = root[0]; pose[1] = root[1]; pose[2] = root[2];
+		float* rotations = pose + 3;
+		for (unsigned int i = 0; i < skeleton->getNumJoints(); i++)
+		{
+			quat q = skeleton->getJointByID(i)->getLocalRotation().ToQuaternion();
+			rotations[4 * i] = q.W();
+			rotations[4 * i + 1] = q.X();
+			rotations[4 * i + 2] = q.Y();
+			rotations[4 * i + 3] = q.Z();
+		}
+	}
+
 	void SetLeftHandID(int id, int jointID)
 	{
 		mActorPool[id]->getIKController()->mLhandID = jointID;
@@ -198,6 +435,41 @@ public:
 	}
 
 
+	void SetIKInstrumentation(int id, bool enabled)
+	{
+		mActorPool[id]->getIKController()->setInstrumentation(enabled);
+	}
+
+	void ResetIKStats(int id)
+	{
+		mActorPool[id]->getIKController()->resetStats();
+	}
+
+	void GetIKStats(int id, int ikType, IKStatsData* data)
+	{
+		if (ikType < 0 || ikType >= IKController::NumIKTypes)
+		{
+			*data = IKStatsData();	// no stats for an unknown solver
+			return;
+		}
+		const IKController::SolverStats& stats = mActorPool[id]->getIKController()->getStats(static_cast<IKController::IKType>(ikType));
+		data->numSolves = stats.numSolves;
+		for (int i = 0; i < IKController::NUM_EXIT_REASONS; i++) data->numExits[i] = stats.numExits[i];
+		data->numIterations = (int)stats.numIterations;
+		data->totalTimeMs = (float)stats.totalTimeMs;
+		data->maxTimeMs = (float)stats.maxTimeMs;
+		for (int i = 0; i < IKController::NumHistogramBins; i++)
+		{
+			data->timeHistogram[i] = stats.timeHistogram[i];
+			data->iterationHistogram[i] = stats.iterationHistogram[i];
+		}
+		data->lastEndJointId = stats.last.endJointID;
+		data->lastIterations = stats.last.iterations;
+		data->lastError = (float)stats.last.error;
+		data->lastExitReason = stats.last.reason;
+		data->lastTimeMs = (float)stats.last.timeMs;
+	}
+
 	void UpdateGuideJoint(int id, vec3 targetPos)
 	{
 		mActorPool[id]->updateGuideJoint(targetPos);
@@ -230,6 +502,26 @@ extern "C"
 		mFKIKPluginManager.RemoveActor(id);
 	}
 
+	// Build a retarget map from the skeleton of the source actor (e.g. a BVH clip) to the target actor (e.g. a rig)
+	// using their current poses as bind poses. Return the ID of the map, -1 if an actor is unknown or no joint
+	// names match
+	EXPORT_API int CreateRetargetMap(int sourceId, int targetId)
+	{
+		return mFKIKPluginManager.CreateRetargetMap(sourceId, targetId);
+	}
+
+	EXPORT_API void RemoveRetargetMap(int mapId)
+	{
+		mFKIKPluginManager.RemoveRetargetMap(mapId);
+	}
+
+	// Sample the BVH clip of the source actor at t and pose the target actor with it. Unknown maps, and maps
+	// whose actors were removed, are ignored
+	EXPORT_API void RetargetBVHPose(int mapId, float t)
+	{
+		mFKIKPluginManager.RetargetBVHPose(mapId, t);
+	}
+
 	// Return the ID of the joint
 	EXPORT_API int CreateJoint(int id, char* name, bool isRoot)
 	{
@@ -322,6 +614,43 @@ extern "C"
 		mFKIKPluginManager.SolveLimbIK(id, jointID, vec3(pos[0], pos[1], pos[2]));
 	}
 
+	// Solves the IK targets of many actors on worker threads, one actor per thread at a time; the records of one actor
+	// are solved in order (see IKController::solveBatch). ikType is an IKController::IKType.
+	// When poses holds at least poseBufferSize >= the returned number of floats, it receives for every actor of the
+	// batch, by increasing actor ID, the root translation followed by the local rotation (w x y z) of each joint.
+	// Return the number of floats the poses of the batch take, 0 without solving anything for an unknown ikType
+	EXPORT_API int SolveIKBatch(IKBatchRecord* records, int numRecords, int ikType, float* poses, int poseBufferSize)
+	{
+		return mFKIKPluginManager.SolveIKBatch(records, numRecords, ikType, poses, poseBufferSize);
+	}
+
+	// Terrain heights on a regular grid for SolveFootIKBatch: heights[z * numX + x] is the height at
+	// (originX + x * cellSize, originZ + z * cellSize). Return the ID of the heightfield, -1 if the grid is invalid
+	EXPORT_API int CreateHeightField(int numX, int numZ, float originX, float originZ, float cellSize, float* heights)
+	{
+		return mFKIKPluginManager.CreateHeightField(numX, numZ, originX, originZ, cellSize, heights);
+	}
+
+	EXPORT_API void RemoveHeightField(int terrainId)
+	{
+		mFKIKPluginManager.RemoveHeightField(terrainId);
+	}
+
+	// Replace all numX * numZ heights of the heightfield
+	EXPORT_API void SetHeightFieldHeights(int terrainId, float* heights)
+	{
+		mFKIKPluginManager.SetHeightFieldHeights(terrainId, heights);
+	}
+
+	// Foot IK on the heightfield for many actors on worker threads: the root of each actor is lowered to the lower
+	// foot, the legs are bent to keep the feet at their clip height above the ground and, with rotateFeet, the feet
+	// are tilted onto the ground normal. Poses are written as by SolveIKBatch.
+	// Return the number of floats the poses of the batch take
+	EXPORT_API int SolveFootIKBatch(int terrainId, int* actorIds, int numActors, bool rotateFeet, float* poses, int poseBufferSize)
+	{
+		return mFKIKPluginManager.SolveFootIKBatch(terrainId, actorIds, numActors, rotateFeet, poses, poseBufferSize);
+	}
+
 	EXPORT_API void SetLeftHandID(int id, int jointID)
 	{
 		mFKIKPluginManager.SetLeftHandID(id, jointID);
@@ -359,6 +688,23 @@ extern "C"
 			vec3(leftNormal[0], leftNormal[1], leftNormal[2]), vec3(rightNormal[0], rightNormal[1], rightNormal[2]));
 	}
 
+	// Per-solve statistics of the actor's IK solvers; off by default, and only a flag test per solve while off
+	EXPORT_API void SetIKInstrumentation(int id, bool enabled)
+	{
+		mFKIKPluginManager.SetIKInstrumentation(id, enabled);
+	}
+
+	EXPORT_API void ResetIKStats(int id)
+	{
+		mFKIKPluginManager.ResetIKStats(id);
+	}
+
+	// ikType is an IKController::IKType; the stats are all zero for any other value
+	EXPORT_API void GetIKStats(int id, int ikType, IKStatsData* data)
+	{
+		mFKIKPluginManager.GetIKStats(id, ikType, data);
+	}
+
 	EXPORT_API void UpdateGuideJointByTarget(int id, float targetPos[], float* newPos, float* newQuat)
 	{
 		mFKIKPluginManager.UpdateGuideJoint(id, vec3(targetPos[0], targetPos[1], targetPos[2]));
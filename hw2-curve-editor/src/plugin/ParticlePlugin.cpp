@@ -1,7 +1,10 @@
 #include "Plugin.h"
 #include "aParticleSystem.h"
+#include "aThreadPool.h"
+#include "aSimClock.h"
 #include <vector>
 #include <unordered_map>
+#include <memory>
 
 inline vec3 floatArrayToVec3(float v[3])
 {
@@ -41,11 +44,15 @@ public:
 
 	//std::vector<AParticleSystem> mParticleSystemPool;
 	std::unordered_map<int, AParticleSystem> mParticleSystemPool;
+	std::unordered_map<int, ASimClock> mClockPool;  // fixed step of each particle system
 	int mCurrentIndex = 0;
+	std::unique_ptr<AThreadPool> mThreadPool;  // shared by the multithreaded systems, created by the first one
 
 	int createParticleSystem()
 	{
 		mParticleSystemPool.insert({ mCurrentIndex, AParticleSystem() });
+		mParticleSystemPool[mCurrentIndex].setSeed(0, mCurrentIndex);  // every system draws its own stream
+		mClockPool.insert({ mCurrentIndex, ASimClock() });
 		mCurrentIndex++;
 		return mCurrentIndex - 1;
 	}
@@ -53,6 +60,7 @@ public:
 	void removeParticleSystem(int id)
 	{
 		mParticleSystemPool.erase(id);
+		mClockPool.erase(id);
 	}
 
 	int getParticleNum(int id)
@@ -65,9 +73,21 @@ public:
 		return mParticleSystemPool[id].mMaxParticles;
 	}
 
+	// runs the fixed steps that fit in deltaT; the rest is interpolated over by writeParticleData
 	void updateParticleSystem(int id, float deltaT)
 	{
-		mParticleSystemPool[id].update(deltaT);
+		ASimClock& clock = mClockPool[id];
+		int numSteps = clock.advance(deltaT);
+		for (int step = 0; step < numSteps; step++)
+		{
+			mParticleSystemPool[id].update(clock.getStep());
+		}
+	}
+
+	void setParticleSystemTimeStep(int id, float step, int maxSubsteps)
+	{
+		mClockPool[id].setStep(step);
+		mClockPool[id].setMaxSubsteps(maxSubsteps);
 	}
 
 	void setParticleSystemParameters(int id, ParticleSystemParameter parm)
@@ -88,6 +108,22 @@ public:
 		particles.mVelocityJitter = AJitter(parm.velocityJitter[0], parm.velocityJitter[1]);
 	}
 
+	void setParticleSystemSeed(int id, unsigned int seed)
+	{
+		mParticleSystemPool[id].setSeed(seed, id);
+	}
+
+	void setParticleSystemIntegrator(int id, int integratorType)
+	{
+		mParticleSystemPool[id].mIntegratorType = integratorType;
+	}
+
+	void setParticleSystemMultithreaded(int id, bool enabled)
+	{
+		if (enabled && !mThreadPool) mThreadPool = std::make_unique<AThreadPool>();
+		mParticleSystemPool[id].mThreadPool = enabled ? mThreadPool.get() : NULL;
+	}
+
 	bool isAlive(int id)
 	{
 		return mParticleSystemPool[id].isAlive();
@@ -95,34 +131,32 @@ public:
 
 	void writeParticleData(ParticleData* particleDataArray, int id, int size)
 	{
-		AParticleSystem& particles = mParticleSystemPool[id];
-		assert(size <= particles.getParticleNum());
+		const AParticleArray& particles = mParticleSystemPool[id].getParticles();
+		assert(size <= particles.size());
+		const float* timeToLive = particles.getChannel(AParticleArray::TIME_TO_LIVE);
+		const float* lifeSpan = particles.getChannel(AParticleArray::LIFE_SPAN);
+		float blend = mClockPool[id].getAlpha();
 		for (int i = 0; i < size; ++i)
 		{
-			AParticle* particle = particles.getParticle(i);
 			ParticleData& data = particleDataArray[i];
-			bool isAlive = particle->isAlive();
+			bool isAlive = timeToLive[i] > 0.0f;
 			data.isAlive = isAlive;
 			if (!isAlive) { continue; }
 			// ramp the color and fade out the particle as its life runs out 
-			double u = particle->getTimeToLive() / particle->m_lifeSpan;			
-			double scale = particle->mStartScale * u + particle->mEndScale * (1 - u);
-			double alpha = particle->mStartAlpha * u + particle->mEndAlpha * (1 - u);
-			vec3 color = particle->mStartColor * u + particle->mEndColor * (1 - u);
-			vec3 pos = particle->m_Pos;
-
-			data.position[0] = pos[0];
-			data.position[1] = pos[1];
-			data.position[2] = pos[2];
-			data.color[0] = color[0];
-			data.color[1] = color[1];
-			data.color[2] = color[2];
-			data.scale = scale;
-			data.alpha = alpha;
+			float u = timeToLive[i] / lifeSpan[i];
+			float v = 1 - u;
+			vec3 position = particles.getInterpolatedPosition(i, blend);
+			data.position[0] = (float)position[0];
+			data.position[1] = (float)position[1];
+			data.position[2] = (float)position[2];
+			data.color[0] = particles.get(AParticleArray::START_R, i) * u + particles.get(AParticleArray::END_R, i) * v;
+			data.color[1] = particles.get(AParticleArray::START_G, i) * u + particles.get(AParticleArray::END_G, i) * v;
+			data.color[2] = particles.get(AParticleArray::START_B, i) * u + particles.get(AParticleArray::END_B, i) * v;
+			data.scale = particles.get(AParticleArray::START_SCALE, i) * u + particles.get(AParticleArray::END_SCALE, i) * v;
+			data.alpha = particles.get(AParticleArray::START_ALPHA, i) * u + particles.get(AParticleArray::END_ALPHA, i) * v;
 		}
 	}
 
-
 };
 
 extern "C"
@@ -159,18 +193,42 @@ extern "C"
 		mParticlePluginManager.writeParticleData(particleDataArray, id, size);
 	}
 
-	// Update the states of the particles by deltaT
+	// Advance the particles by deltaT in fixed steps; GetParticleData interpolates between the two latest steps
 	EXPORT_API void UpdateParticleSystem(int id, float deltaT)
 	{
 		mParticlePluginManager.updateParticleSystem(id, deltaT);
 	}
 
+	// Set the fixed simulation step (1/60 s by default) and the max number of steps run per update (4 by default)
+	EXPORT_API void SetParticleSystemTimeStep(int id, float step, int maxSubsteps)
+	{
+		mParticlePluginManager.setParticleSystemTimeStep(id, step, maxSubsteps);
+	}
+
 	// Set parameters
 	EXPORT_API void SetParticleSystemParameters(int id, ParticleSystemParameter parm)
 	{
 		mParticlePluginManager.setParticleSystemParameters(id, parm);
 	}
 
+	// Seed the random jitter of the particle system; the same seed replays the same particles after a reset
+	EXPORT_API void SetParticleSystemSeed(int id, unsigned int seed)
+	{
+		mParticlePluginManager.setParticleSystemSeed(id, seed);
+	}
+
+	// Set the integrator, 0 for Euler, 1 for RK2, 2 for Adams-Bashforth, 3 for RK4, 4 for adaptive RK45
+	EXPORT_API void SetParticleSystemIntegrator(int id, int integratorType)
+	{
+		mParticlePluginManager.setParticleSystemIntegrator(id, integratorType);
+	}
+
+	// Spread the particle updates over worker threads; the results are the same as on one thread
+	EXPORT_API void SetParticleSystemMultithreaded(int id, bool enabled)
+	{
+		mParticlePluginManager.setParticleSystemMultithreaded(id, enabled);
+	}
+
 	// Check if the particle system is alive
 	EXPORT_API bool IsAlive(int id)
 	{
@@ -135,6 +135,17 @@ bool FBXModel::loadBVHMotion(const std::string & filename, bool updateShaderBind
 		throw std::runtime_error("failed to open the bvh file.");
 		return false;
 	}
+	return bindMotion(updateShaderBindMats);
+}
+
+bool FBXModel::loadBVHClip(const AMotionClip& clip)
+{
+	if (!mBVHController->loadClip(clip)) { return false; }
+	return bindMotion(false);
+}
+
+bool FBXModel::bindMotion(bool updateShaderBindMats)
+{
 	if (!constructSkeleton()) { return false; }
 	mBVHController->update(0);
 	// Set shader bind matrices
@@ -387,6 +398,23 @@ void FBXModel::updateT(float t)
 	mBVHController->update(t, false);
 }
 
+void FBXModel::updateDeltaT(float deltaT, AAnimationLOD& lod, const vec3& viewerPos)
+{
+	mTime += deltaT;
+	float duration = mBVHController->getDuration();
+	if (mTime >= duration)
+	{
+		mTime = 0;
+	}
+	mActor.updateLOD(mTime, viewerPos, lod);
+}
+
+void FBXModel::updateT(float t, AAnimationLOD& lod, AAnimationLOD::State& state, double distance)
+{
+	const APose& pose = lod.samplePose(state, *mBVHController, t, distance);
+	mBVHController->applyPose(pose, false);
+}
+
 void FBXModel::computeIK(int type, IKTarget & target)
 {
 	IKController::IKType ikType = static_cast<IKController::IKType>(type);
@@ -400,6 +428,9 @@ void FBXModel::computeIK(int type, IKTarget & target)
 	case IKController::PSEDUOINV:
 		mIKController->IKSolver_PseudoInv(target.jointID, target.target);
 		break;
+	case IKController::FABRIK:
+		mIKController->IKSolver_FABRIK(target.jointID, target.target);
+		break;
 	case IKController::LIMB:
 	default:
 		mIKController->IKSolver_Limb(target.jointID, target.target);
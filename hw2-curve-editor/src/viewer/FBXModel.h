@@ -9,6 +9,7 @@
 #include "shader.h"
 #include "aActor.h"
 #include "aBVHController.h"
+#include "aMotionLibrary.h"
 #include "drawable.h"
 #include "utils.h"
 
@@ -38,6 +39,8 @@ public:
 
 	bool loadFBX(const std::string& filename);
 	bool loadBVHMotion(const std::string& filename, bool updateShaderBindMats = false);
+	// Plays a clip of a motion library, e.g. one that finished loading in the background
+	bool loadBVHClip(const AMotionClip& clip);
 	bool loadShaders();
 
 	void drawModel(const glm::mat4& projView, const glm::mat4& model,
@@ -51,6 +54,10 @@ public:
 
 	void updateDeltaT(float deltaT);	// Update the model by a timestep
 	void updateT(float t);	// Update the model to time t;
+	// Same as above with the animation level of detail picked from the distance to the viewer
+	void updateDeltaT(float deltaT, AAnimationLOD& lod, const vec3& viewerPos);
+	// For a model shared by several characters: each character keeps its own LOD state
+	void updateT(float t, AAnimationLOD& lod, AAnimationLOD::State& state, double distance);
 
 	void computeIK(int type, IKTarget& ikTarget);
 
@@ -84,6 +91,8 @@ private:
 
 	// Construct the skeleton map and the IK skeleton
 	bool constructSkeleton();
+	// Called after a BVH motion is loaded: maps the skeleton to the FBX joints and moves the IK targets
+	bool bindMotion(bool updateShaderBindMats);
 
 	// Find 4 limb joints and the hips joint
 	void setLimbJoints(AJoint* joint);
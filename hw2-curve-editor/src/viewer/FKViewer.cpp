@@ -1,5 +1,7 @@
 #include "FKViewer.h"
 #include <filesystem>
+#include <algorithm>
+#include <cfloat>
 
 FKViewer::FKViewer(const std::string & name) :
 	Viewer(name)
@@ -20,6 +22,8 @@ FKViewer::FKViewer(const std::string & name) :
 			mBVHFileStems.push_back(entry.path().stem().generic_string());
 		}
 	}
+	// Load every clip in the background, the selected one first
+	mMotionLibrary.load(mBVHFilePaths, mCurrentBVHFileIndex);
 	mPickedTarget = nullptr;
 }
 
@@ -51,15 +55,34 @@ void FKViewer::createGUIWindow()
 		{
 			loadBVHFile(mCurrentBVHFileIndex);
 		}
+		if (mMotionLibrary.isLoading())
+		{
+			ImGui::ProgressBar(mMotionLibrary.getProgress());
+			ImGui::Text("Loaded %d/%d clips", mMotionLibrary.getNumFinished(), mMotionLibrary.getNumClips());
+		}
+		if (mPendingBVHFileIndex >= 0)
+		{
+			ImGui::Text("Waiting for %s...", mBVHFileStems[mPendingBVHFileIndex].c_str());
+		}
 		if (!mLoaded)
 		{
 			ImGui::Text("Loading failed!");
 			ImGui::Text("FBX joints names and BVH joints names are not the same!");
 		}
+		ImGui::Separator();
+		bool lodEnabled = mLOD.isEnabled();
+		if (ImGui::Checkbox("Animation LOD", &lodEnabled)) { mLOD.setEnabled(lodEnabled); }
+		const char* lodNames[] = { "Near", "Mid", "Far" };
+		for (int i = 0; i < AAnimationLOD::NUM_LODS; ++i)
+		{
+			const AAnimationLOD::Counters& counters = mLOD.getCounters(static_cast<AAnimationLOD::Level>(i));
+			ImGui::Text("%s: %d actors, %d samples, %d interpolated, %.3f ms", lodNames[i],
+				counters.numActors, counters.numSamples, counters.numInterpolated, counters.updateTimeMs);
+		}
 	}
 	else if (mFKIKMode == 1)	// IK
 	{
-		const char* IKSolvers[] = { "Limb-based", "CCD", "Pseudo Inverse" };
+		const char* IKSolvers[] = { "Limb-based", "CCD", "Pseudo Inverse", "FABRIK" };
 		ImGui::Combo("IK Solver", &mIKType, IKSolvers, IM_ARRAYSIZE(IKSolvers));
 
 		for (auto& target : mFBXModel.mIKTargets)
@@ -69,6 +92,35 @@ void FKViewer::createGUIWindow()
 				mFBXModel.computeIK(mIKType, target);
 			}
 		}
+
+		ImGui::Separator();
+		bool instrumented = mFBXModel.mIKController->isInstrumented();
+		if (ImGui::Checkbox("Solver instrumentation", &instrumented)) { mFBXModel.mIKController->setInstrumentation(instrumented); }
+		if (instrumented)
+		{
+			ImGui::SameLine();
+			if (ImGui::Button("Reset")) { mFBXModel.mIKController->resetStats(); }
+			const IKController::SolverStats& stats = mFBXModel.mIKController->getStats((IKController::IKType)mIKType);
+			int numSolves = std::max(stats.numSolves, 1);
+			ImGui::Text("%s: %d solves, %.1f iterations, %.3f ms avg, %.3f ms max", IKSolvers[mIKType],
+				stats.numSolves, (double)stats.numIterations / numSolves, stats.totalTimeMs / numSolves, stats.maxTimeMs);
+			for (int i = 0; i < IKController::NUM_EXIT_REASONS; ++i)
+			{
+				ImGui::Text("  %s: %d", IKController::GetExitReasonName((IKController::ExitReason)i), stats.numExits[i]);
+			}
+			ImGui::Text("Last solve: joint %d, %d iterations, error %.3f, %s, %.3f ms", stats.last.endJointID, stats.last.iterations,
+				stats.last.error, IKController::GetExitReasonName(stats.last.reason), stats.last.timeMs);
+
+			// bin 0 is under 1 us / no iteration, bin i covers [2^(i-1), 2^i)
+			float timeBins[IKController::NumHistogramBins], iterationBins[IKController::NumHistogramBins];
+			for (int i = 0; i < IKController::NumHistogramBins; ++i)
+			{
+				timeBins[i] = (float)stats.timeHistogram[i];
+				iterationBins[i] = (float)stats.iterationHistogram[i];
+			}
+			ImGui::PlotHistogram("Time (log2 us)", timeBins, IKController::NumHistogramBins, 0, NULL, 0.0f, FLT_MAX, ImVec2(0, 60));
+			ImGui::PlotHistogram("Iterations (log2)", iterationBins, IKController::NumHistogramBins, 0, NULL, 0.0f, FLT_MAX, ImVec2(0, 60));
+		}
 	}
 	ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 	ImGui::End();
@@ -78,6 +130,12 @@ void FKViewer::createGUIWindow()
 void FKViewer::drawScene()
 {
 	glEnable(GL_DEPTH_TEST);
+
+	// Start the selected clip as soon as the library has loaded it
+	if (mPendingBVHFileIndex >= 0 && mMotionLibrary.getClipState(mPendingBVHFileIndex) != AMotionLibrary::CLIP_QUEUED)
+	{
+		loadBVHFile(mPendingBVHFileIndex);
+	}
 	
 	glm::mat4 model = glm::mat4(1.0f);
 	glm::mat4 projView = mCamera.getProjView();
@@ -85,7 +143,9 @@ void FKViewer::drawScene()
 	if (mFKIKMode == 0)
 	{
 		float currentTime = glfwGetTime();
-		mFBXModel.updateDeltaT((currentTime - mLastTime) * mTimeScale);
+		glm::vec3 eye = mCamera.getEye();
+		mLOD.beginFrame();
+		mFBXModel.updateDeltaT((currentTime - mLastTime) * mTimeScale, mLOD, vec3(eye.x, eye.y, eye.z));
 		mLastTime = currentTime;	
 	}
 	mShowSkeleton?
@@ -165,7 +225,19 @@ void FKViewer::cursorPosCallback(GLFWwindow * window, double xpos, double ypos)
 
 void FKViewer::loadBVHFile(int index)
 {
-	mLoaded = mFBXModel.loadBVHMotion(mBVHFilePaths[index], false);
+	mPendingBVHFileIndex = -1;
+	switch (mMotionLibrary.getClipState(index))
+	{
+	case AMotionLibrary::CLIP_LOADED:
+		mLoaded = mFBXModel.loadBVHClip(*mMotionLibrary.getClip(index));
+		break;
+	case AMotionLibrary::CLIP_QUEUED:
+		mPendingBVHFileIndex = index;	// Keep playing the current clip until this one is loaded
+		break;
+	default:
+		mLoaded = false;
+		break;
+	}
 }
 
 void FKViewer::reset()
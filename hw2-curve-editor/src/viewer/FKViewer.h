@@ -16,8 +16,11 @@ public:
 
 private:
 	FBXModel mFBXModel;
+	AAnimationLOD mLOD;
+	AMotionLibrary mMotionLibrary;	// All clips of the motion directory, loaded in parallel
 
 	int mCurrentBVHFileIndex = 2;	// Default "Beta.bvh"
+	int mPendingBVHFileIndex = -1;	// Selected clip that is still loading
 	float mTimeScale = 1.0f;
 	float mTime = 0;
 	float mLastTime = 0;	// last gflw time
@@ -26,7 +29,7 @@ private:
 	std::vector<std::string> mBVHFileStems;		// Filenames that show in the list box
 	
 	int mFKIKMode = 0;	// 0 for FK, 1 for IK
-	int mIKType = 0;	// 0 for Limb, 1 for CCD, 2 for Pseudo Inverse
+	int mIKType = 0;	// 0 for Limb, 1 for CCD, 2 for Pseudo Inverse, 3 for FABRIK
 	bool mLoaded = true;
 	bool mShowSkeleton = false;
 
@@ -56,6 +56,8 @@ void BehaviorViewer::drawScene()
 		updateActors(deltaT);
 	}
 
+	glm::vec3 eye = mCamera.getEye();
+	mLOD.beginFrame();
 	for (int i = 0; i < mActorNum; ++i)
 	{
 		auto& actor = mActors[i];
@@ -68,7 +70,8 @@ void BehaviorViewer::drawScene()
 		}
 		else
 		{
-			mFBXModel.updateT(mActorTimes[i]);
+			double distance = (actor.getBehaviorController()->getPosition() - vec3(eye.x, eye.y, eye.z)).Length();
+			mFBXModel.updateT(mActorTimes[i], mLOD, actor.getLODState(), distance);
 			mFBXModel.drawModel(projView, model, mLightPos, glm::vec3(0.2, 0.9, 1.0));
 		}
 	}
@@ -107,7 +110,7 @@ void BehaviorViewer::createGUIWindow()
 		mReset = false;
 	}
 
-	if (ImGui::SliderInt("Actor Number", &mActorNum, 1, 5)) { reset(); }
+	if (ImGui::SliderInt("Actor Number", &mActorNum, 1, 50)) { reset(); }
 	ImGui::Text("Gains");
 	double sMin = 0, sMax = 2000;
 	ImGui::SliderScalar("Max Speed", ImGuiDataType_::ImGuiDataType_Double, &BehaviorController::gMaxSpeed,
@@ -132,6 +135,25 @@ void BehaviorViewer::createGUIWindow()
 	ImGui::SliderScalar("Kavoid", ImGuiDataType_::ImGuiDataType_Double, &BehaviorController::KAvoid,
 		&sMin, &sMax, "%.3lf");
 
+	ImGui::Separator();
+	bool lodEnabled = mLOD.isEnabled();
+	if (ImGui::Checkbox("Animation LOD", &lodEnabled)) { mLOD.setEnabled(lodEnabled); }
+	double lodDistanceMin = 0, lodDistanceMax = 5000;
+	ImGui::SliderScalar("Near Distance", ImGuiDataType_::ImGuiDataType_Double, &mLOD.getSettings(AAnimationLOD::LOD_NEAR).maxDistance,
+		&lodDistanceMin, &lodDistanceMax, "%.1lf");
+	ImGui::SliderScalar("Mid Distance", ImGuiDataType_::ImGuiDataType_Double, &mLOD.getSettings(AAnimationLOD::LOD_MID).maxDistance,
+		&lodDistanceMin, &lodDistanceMax, "%.1lf");
+	const char* lodNames[] = { "Near", "Mid", "Far" };
+	for (int i = 0; i < AAnimationLOD::NUM_LODS; ++i)
+	{
+		AAnimationLOD::Settings& settings = mLOD.getSettings(static_cast<AAnimationLOD::Level>(i));
+		const AAnimationLOD::Counters& counters = mLOD.getCounters(static_cast<AAnimationLOD::Level>(i));
+		ImGui::PushID(i);
+		ImGui::SliderInt(lodNames[i], &settings.updateInterval, 1, 8);
+		ImGui::PopID();
+		ImGui::Text("%d actors, %d samples, %d interpolated, %.3f ms", counters.numActors, counters.numSamples,
+			counters.numInterpolated, counters.updateTimeMs);
+	}
 	ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 	ImGui::End();
 }
@@ -220,6 +242,7 @@ void BehaviorViewer::reset()
 	// set up behavior controllers
 	for (int i = 0; i < mActorNum; i++)
 	{
+		mActors[i].getLODState().slot = i;	// stagger reduced-rate pose updates across actors
 		BehaviorController* behavior = mActors[i].getBehaviorController();
 		behavior->setTarget(mBehaviorTarget);
 		behavior->createBehaviors(mActors, mObstacles);
@@ -29,6 +29,7 @@ private:
 	void drawPlane(const glm::mat4& projView, const glm::mat4& model);
 
 	FBXModel mFBXModel;
+	AAnimationLOD mLOD;
 
 	std::unique_ptr<ObjModel> mObstacleModel;
 	std::unique_ptr<ObjModel> mConeModel;
@@ -2,6 +2,7 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm.hpp>
+#include <vector>
 
 class Drawable
 {
@@ -63,4 +64,53 @@ public:
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(0);
 	}
-};
\ No newline at end of file
+};
+
+// Per-instance data of the instance shader, in the vertex attributes 2 to 4
+struct InstanceData
+{
+	glm::vec4 posScale;	// world position, uniform scale
+	glm::vec4 color;	// rgb, alpha
+	glm::vec4 rotation;	// unit quaternion (x, y, z, w)
+};
+
+// Instance data uploaded once per frame and drawn with one instanced draw per mesh
+class InstanceBuffer
+{
+public:
+	InstanceBuffer() : capacity(0), count(0)
+	{
+		glGenBuffers(1, &VBO);
+	}
+
+	~InstanceBuffer()
+	{
+		glDeleteBuffers(1, &VBO);
+	}
+
+	void upload(const std::vector<InstanceData>& instances)
+	{
+		count = (int)instances.size();
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		if (count > capacity) capacity = count + count / 2;
+		// fresh storage every frame, so the upload does not wait for the draws of the last frame
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+		if (count > 0) glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), instances.data());
+	}
+
+	// Points the instance attributes of the bound vertex array at the buffer
+	void bindAttributes() const
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		for (int i = 0; i < 3; i++)
+		{
+			glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(i * sizeof(glm::vec4)));
+			glVertexAttribDivisor(2 + i, 1);
+			glEnableVertexAttribArray(2 + i);
+		}
+	}
+
+	GLuint VBO;
+	int capacity;	// instances the buffer storage holds
+	int count;	// instances uploaded last
+};
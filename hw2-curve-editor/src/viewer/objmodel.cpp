@@ -111,3 +111,16 @@ void ObjModel::drawObj()
 	}
 	glDisable(GL_CULL_FACE);
 }
+
+void ObjModel::drawObjInstanced(const InstanceBuffer& instances)
+{
+	if (instances.count == 0) return;
+	glEnable(GL_CULL_FACE);
+	for (const auto& drawable : mDrawables)
+	{
+		glBindVertexArray(drawable->VAO);
+		instances.bindAttributes();
+		glDrawArraysInstanced(GL_TRIANGLES, 0, drawable->elementCount, instances.count);
+	}
+	glDisable(GL_CULL_FACE);
+}
@@ -18,6 +18,9 @@ public:
 
 	void drawObj();
 
+	// Draws every shape once per instance of instances, with the instance shader
+	void drawObjInstanced(const InstanceBuffer& instances);
+
 private:
 	std::vector<tinyobj::shape_t> shapes; 
 	std::vector<tinyobj::material_t> materials;
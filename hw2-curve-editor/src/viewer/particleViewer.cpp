@@ -1,5 +1,6 @@
 #include "particleViewer.h"
 #include "utils.h"
+#include <gtc/quaternion.hpp>
 
 ParticleViewer::ParticleViewer(const std::string& name) :
 	Viewer(name)
@@ -11,6 +12,10 @@ ParticleViewer::ParticleViewer(const std::string& name) :
 	mParticleModel->loadObj("../obj/cube.obj");
 	mRocketModel->loadObj("../obj/cone.obj");
 	mParticleModelSphere->loadObj("../obj/sphere.obj");
+	mInstanceShader = std::make_unique<Shader>("../shader/instance.vert.glsl", "../shader/instance.frag.glsl");
+	mParticleInstances = std::make_unique<InstanceBuffer>();
+	mObstacleInstances = std::make_unique<InstanceBuffer>();
+	mRocketInstances = std::make_unique<InstanceBuffer>();
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 }
@@ -23,15 +28,15 @@ void ParticleViewer::drawScene()
 {
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
-	float deltaT = 1.0 / ImGui::GetIO().Framerate;
-	
-	
+	int numSteps = mClock.advance(ImGui::GetIO().DeltaTime);
+	float deltaT = (float)mClock.getStep();
+
 	glm::mat4 projView = mCamera.getProjView();
 	
 	drawGridGround(projView);
 	if (mDemo == 0)
 	{
-		mParticles.update(deltaT);
+		for (int step = 0; step < numSteps; step++) mParticles.update(deltaT);
 		drawParticles(projView);
 	}
 	else if (mDemo == 1)
@@ -52,7 +57,11 @@ void ParticleViewer::drawScene()
 			extForceMode = extForceMode | DRAG_ACTIVE;
 		if (mRandomActive)
 			extForceMode = extForceMode | RANDOM_ACTIVE;
-		mFireworks.update(deltaT, extForceMode);
+		if (mForceFieldsActive)
+			extForceMode = extForceMode | FORCEFIELDS_ACTIVE;
+		if (mInteractionsActive)
+			extForceMode = extForceMode | INTERACTIONS_ACTIVE;
+		for (int step = 0; step < numSteps; step++) mFireworks.update(deltaT, extForceMode);
 		drawFireworks(projView);
 	}
 	glDisable(GL_DEPTH_TEST);
@@ -67,6 +76,26 @@ void ParticleViewer::createGUIWindow()
 
 	ImGui::RadioButton("Cube", &mParticleModelType, 0); ImGui::SameLine();
 	ImGui::RadioButton("Sphere", &mParticleModelType, 1);
+	ImGui::Checkbox("Instanced rendering", &mInstanced);
+
+	const char* integrators[] = { "Euler", "RK2", "Adams-Bashforth", "RK4", "RK45 (adaptive)" };
+	int& integratorType = mDemo == 0 ? mParticles.mIntegratorType : mFireworks.m_integratorType;
+	ImGui::Combo("Integrator", &integratorType, integrators, IM_ARRAYSIZE(integrators));
+	if (ImGui::Checkbox("Multithreaded", &mMultithreaded))
+	{
+		if (mMultithreaded && !mThreadPool) mThreadPool = std::make_unique<AThreadPool>();
+		mParticles.mThreadPool = mMultithreaded ? mThreadPool.get() : NULL;
+		mFireworks.m_threadPool = mMultithreaded ? mThreadPool.get() : NULL;
+	}
+	if (ImGui::SliderFloat("Sim rate (Hz)", &mSimRate, 10.0f, 240.0f, "%.0f"))
+	{
+		mClock.setStep(1.0 / mSimRate);
+	}
+	if (ImGui::SliderInt("Max substeps", &mMaxSubsteps, 1, 16))
+	{
+		mClock.setMaxSubsteps(mMaxSubsteps);
+	}
+	ImGui::Text("Dropped steps: %d", mClock.getNumDroppedSteps());
 
 	if (mDemo == 0)
 	{
@@ -138,6 +167,53 @@ void ParticleViewer::createGUIWindow()
 
 		ImGui::Checkbox("Active Drag", &mDragActive);
 		ImGui::Checkbox("Random Force", &mRandomActive);
+		ImGui::Separator();
+
+		// fields placed at random over the launch area
+		ImGui::Checkbox("Force Fields", &mForceFieldsActive);
+		AForceFieldSet& fields = mFireworks.m_forceFields;
+		vec3 center{ Random::GetRandom(-200, 200), Random::GetRandom(50, 400), Random::GetRandom(-200, 200) };
+		if (ImGui::Button("Add Attractor"))
+		{
+			fields.add(new APointField(center, 2.0e4f, 150.0f, 5.0f));
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Add Vortex"))
+		{
+			fields.add(new AVortexField(center, vec3(0, 1, 0), 200.0f, 120.0f));
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Add Wind Volume"))
+		{
+			vec3 halfSize(100, 100, 100);
+			fields.add(new AWindField(vec3(0, 0, Random::GetRandom(-500, 500)), center - halfSize, center + halfSize));
+		}
+		if (ImGui::Button("Add Curl Noise"))
+		{
+			fields.add(new ACurlNoiseField(30.0f, 0.02f, 2, center));
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Clear Fields"))
+		{
+			fields.clear();
+		}
+		ImGui::Text("%d fields", fields.size());
+		ImGui::Separator();
+
+		ImGui::Checkbox("Spark Interactions", &mInteractionsActive);
+		float interactionMin = 1.0f, interactionMax = 20.0f;
+		ImGui::SliderFloat("Interaction Radius", &mFireworks.m_sparkInteraction.mRadius, interactionMin, interactionMax);
+		AObstacleSet& obstacles = mFireworks.m_obstacles;
+		if (ImGui::Button("Add Sphere Obstacle"))
+		{
+			obstacles.add(new ASphereObstacle(center, Random::GetRandom(20, 80)));
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Clear Obstacles"))
+		{
+			obstacles.clear();
+		}
+		ImGui::Text("%d obstacles", obstacles.size());
 
 	}
 	ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
@@ -158,73 +234,133 @@ void ParticleViewer::keyCallback(GLFWwindow * window, int key, int scancode, int
 	}
 }
 
-void ParticleViewer::drawParticles(const glm::mat4& projView)
+// minimal rotation taking the +Y axis of a mesh to dir, as a quaternion (x, y, z, w)
+static glm::vec4 rotationFromUp(const vec3& dir)
+{
+	double length = dir.Length();
+	if (length < 1.0e-9) return glm::vec4(0, 0, 0, 1);
+	vec3 to = dir / length;
+	if (to[1] < -1.0 + 1.0e-9) return glm::vec4(1, 0, 0, 0);	// half turn about X
+	// normalized (cross(up, to), 1 + dot(up, to))
+	double w = 1.0 + to[1];
+	double norm = sqrt(to[2] * to[2] + to[0] * to[0] + w * w);
+	return glm::vec4((float)(to[2] / norm), 0.0f, (float)(-to[0] / norm), (float)(w / norm));
+}
+
+void ParticleViewer::drawInstances(ObjModel& model, InstanceBuffer& buffer, const std::vector<InstanceData>& instances,
+	const glm::mat4& projView)
 {
+	if (mInstanced)
+	{
+		mInstanceShader->use();
+		mInstanceShader->setMat4("uProjView", projView);
+		mInstanceShader->setVec3("uLightPos", mLightPos);
+		buffer.upload(instances);
+		model.drawObjInstanced(buffer);
+		return;
+	}
+
+	// one draw per instance with the model shader, to compare against
 	mModelShader->use();
 	mModelShader->setMat4("uProjView", projView);
 	mModelShader->setVec3("uLightPos", mLightPos);
-	for (int i = 0; i < mParticles.getParticleNum(); ++i)
+	for (const InstanceData& instance : instances)
+	{
+		const glm::vec4& q = instance.rotation;
+		float scale = instance.posScale.w;
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(instance.posScale))
+			* glm::mat4_cast(glm::quat(q.w, q.x, q.y, q.z)) * glm::scale(glm::mat4(1.0f), glm::vec3(scale, scale, scale));
+
+		mModelShader->setMat4("uModel", transform);
+		mModelShader->setMat3("uModelInvTr", glm::mat3(glm::transpose(glm::inverse(transform))));
+		mModelShader->setVec3("color", glm::vec3(instance.color));
+		mModelShader->setFloat("uAlpha", instance.color.a);
+		model.drawObj();
+	}
+}
+
+void ParticleViewer::drawParticles(const glm::mat4& projView)
+{
+	const AParticleArray& particles = mParticles.getParticles();
+	float blend = mClock.getAlpha();
+	mInstances.clear();
+	for (int i = 0; i < particles.size(); ++i)
 	{
-		AParticle* particle = mParticles.getParticle(i);
-		if (particle->isAlive())
+		if (particles.isAlive(i))
 		{
 			// ramp the color and fade out the particle as its life runs out 
-			float u = particle->getTimeToLive() / particle->m_lifeSpan;
-			float scale = particle->mStartScale * u + particle->mEndScale * (1 - u);
-			float alpha = particle->mStartAlpha * u + particle->mEndAlpha * (1 - u);
-			vec3 color = particle->mStartColor * u + particle->mEndColor * (1 - u);
-			vec3 pos = particle->m_Pos;
-			glm::mat4 model = glm::mat4(1.0f);
-			model = glm::scale(model, glm::vec3(5, 5, 5));
-			model = glm::translate(model, glm::vec3(pos[0], pos[1], pos[2]));
-			model = glm::scale(model, glm::vec3(scale, scale, scale));
-			
-			mModelShader->setMat4("uModel", model);
-			mModelShader->setMat3("uModelInvTr", glm::mat3(glm::transpose(glm::inverse(model))));
-			mModelShader->setVec3("color", glm::vec3(color[0], color[1], color[2]));
-			mModelShader->setFloat("uAlpha", alpha);
-			mParticleModelType == 0? mParticleModel->drawObj() : mParticleModelSphere->drawObj();
+			float u = particles.get(AParticleArray::TIME_TO_LIVE, i) / particles.get(AParticleArray::LIFE_SPAN, i);
+			float scale = particles.get(AParticleArray::START_SCALE, i) * u + particles.get(AParticleArray::END_SCALE, i) * (1 - u);
+			float alpha = particles.get(AParticleArray::START_ALPHA, i) * u + particles.get(AParticleArray::END_ALPHA, i) * (1 - u);
+			vec3 color = particles.getStartColor(i) * u + particles.getEndColor(i) * (1 - u);
+			vec3 pos = particles.getInterpolatedPosition(i, blend);
+
+			// the whole particle system is drawn 5 times larger
+			InstanceData instance;
+			instance.posScale = glm::vec4(5 * pos[0], 5 * pos[1], 5 * pos[2], 5 * scale);
+			instance.color = glm::vec4(color[0], color[1], color[2], alpha);
+			instance.rotation = glm::vec4(0, 0, 0, 1);
+			mInstances.push_back(instance);
 		}
 	}
+	drawInstances(mParticleModelType == 0 ? *mParticleModel : *mParticleModelSphere, *mParticleInstances, mInstances, projView);
 }
 
 void ParticleViewer::drawFireworks(const glm::mat4 & projView)
 {
 	float fadeTime = 3.0f;
-	mModelShader->use();
-	mModelShader->setMat4("uProjView", projView);
-	mModelShader->setVec3("uLightPos", mLightPos);
-	for (auto* spark : mFireworks.sparks)
+	const AParticleArray& sparks = mFireworks.sparks;
+	float blend = mClock.getAlpha();
+	mInstances.clear();
+	for (int i = 0; i < sparks.size(); ++i)
 	{
-		if (!spark->m_alive) { continue; }
-		vec3 pos = spark->m_Pos;
-		
-		glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(pos[0], pos[1], pos[2]))
-			* glm::scale(glm::mat4(1.0), glm::vec3(2, 2, 2));
-
-		mModelShader->setMat4("uModel", model);
-		mModelShader->setMat3("uModelInvTr", glm::mat3(glm::transpose(glm::inverse(model))));
-		mModelShader->setVec3("color", glm::vec3(spark->m_color[0], spark->m_color[1], spark->m_color[2]));
+		if (!sparks.isAlive(i)) { continue; }
+		vec3 pos = sparks.getInterpolatedPosition(i, blend);
+		vec3 sparkColor = sparks.getStartColor(i);
 		float alpha = 1.0;
-		if (spark->m_state[10] < fadeTime)
+		float timeToLive = sparks.get(AParticleArray::TIME_TO_LIVE, i);
+		if (timeToLive < fadeTime)
 		{
-			alpha = spark->m_state[10] / 10.0f;
+			alpha = timeToLive / 10.0f;
 		}
-		mModelShader->setFloat("uAlpha", alpha);
-		mParticleModel->drawObj();
+
+		InstanceData instance;
+		instance.posScale = glm::vec4(pos[0], pos[1], pos[2], 2);
+		instance.color = glm::vec4(sparkColor[0], sparkColor[1], sparkColor[2], alpha);
+		instance.rotation = glm::vec4(0, 0, 0, 1);
+		mInstances.push_back(instance);
 	}
-	for (auto* rocket : mFireworks.rockets)
+	drawInstances(*mParticleModel, *mParticleInstances, mInstances, projView);
+
+	const AObstacleSet& obstacles = mFireworks.m_obstacles;
+	mInstances.clear();
+	for (int i = 0; i < obstacles.size(); ++i)
+	{
+		const ASphereObstacle* sphere = dynamic_cast<const ASphereObstacle*>(obstacles.get(i));
+		if (!sphere) { continue; }
+		vec3 center = sphere->getCenter();
+
+		InstanceData instance;
+		instance.posScale = glm::vec4(center[0], center[1], center[2], sphere->getRadius());
+		instance.color = glm::vec4(0.4f, 0.4f, 0.45f, 1.0f);
+		instance.rotation = glm::vec4(0, 0, 0, 1);
+		mInstances.push_back(instance);
+	}
+	drawInstances(*mParticleModelSphere, *mObstacleInstances, mInstances, projView);
+
+	const AParticleArray& rockets = mFireworks.rockets;
+	mInstances.clear();
+	for (int i = 0; i < rockets.size(); ++i)
 	{
-		if (rocket->m_explosionCount >= 0) { continue; }
-		vec3 pos = rocket->m_Pos;
-		mat3 rot = mat3::FromToRotation(vec3(0, 1, 0), vec3(rocket->m_Vel[0], rocket->m_Vel[1], rocket->m_Vel[2]).Normalize());;
-		glm::mat4 t = toGLMmat4(rot, pos);
-		glm::mat4 model = t * glm::scale(glm::mat4(1.0), glm::vec3(5, 5, 5));
-
-		mModelShader->setMat4("uModel", model);
-		mModelShader->setMat3("uModelInvTr", glm::mat3(glm::transpose(glm::inverse(model))));
-		mModelShader->setVec3("color", glm::vec3(rocket->m_color[0], rocket->m_color[1], rocket->m_color[2]));
-		mModelShader->setFloat("uAlpha", 1.0f);
-		mRocketModel->drawObj();
+		if (rockets.getTags()[i] >= 0) { continue; }
+		vec3 pos = rockets.getInterpolatedPosition(i, blend);
+		vec3 rocketColor = rockets.getStartColor(i);
+
+		InstanceData instance;
+		instance.posScale = glm::vec4(pos[0], pos[1], pos[2], 5);
+		instance.color = glm::vec4(rocketColor[0], rocketColor[1], rocketColor[2], 1.0f);
+		instance.rotation = rotationFromUp(rockets.getVelocity(i));
+		mInstances.push_back(instance);
 	}
+	drawInstances(*mRocketModel, *mRocketInstances, mInstances, projView);
 }
@@ -2,6 +2,8 @@
 #include "viewer.h"
 #include "aParticleSystem.h"
 #include "aFireworks.h"
+#include "aThreadPool.h"
+#include "aSimClock.h"
 #include "objmodel.h"
 
 class ParticleViewer : public Viewer
@@ -21,11 +23,27 @@ private:
 
 	AParticleSystem mParticles;
 	AFireworks mFireworks;
+	std::unique_ptr<AThreadPool> mThreadPool;	// created when multithreading is turned on
+	bool mMultithreaded = false;
+	ASimClock mClock;	// fixed simulation step; the particles are drawn between the two latest steps
+	float mSimRate = 60.0f;
+	int mMaxSubsteps = 4;
 
 	std::unique_ptr<ObjModel> mParticleModel;
 	std::unique_ptr<ObjModel> mParticleModelSphere;
 	std::unique_ptr<ObjModel> mRocketModel;
 
+	// The particles of every mesh are gathered into mInstances and uploaded to the buffer of the mesh, then
+	// drawn in one instanced draw, or one draw per particle when mInstanced is off
+	bool mInstanced = true;
+	std::unique_ptr<Shader> mInstanceShader;
+	std::vector<InstanceData> mInstances;
+	std::unique_ptr<InstanceBuffer> mParticleInstances;
+	std::unique_ptr<InstanceBuffer> mObstacleInstances;
+	std::unique_ptr<InstanceBuffer> mRocketInstances;
+
+	void drawInstances(ObjModel& model, InstanceBuffer& buffer, const std::vector<InstanceData>& instances,
+		const glm::mat4& projView);
 	void drawParticles(const glm::mat4& projView);
 	void drawFireworks(const glm::mat4& projView);
 
@@ -37,5 +55,7 @@ private:
 	bool mRandomActive = false;
 	bool mExtSparkForcesActive = false;
 	bool mExtRocketForcesActive = false;
+	bool mForceFieldsActive = false;
+	bool mInteractionsActive = false;
 	int mExtForceMode = 0;
 };
\ No newline at end of file
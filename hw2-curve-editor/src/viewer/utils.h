@@ -2,7 +2,7 @@
 #include <glm.hpp>
 #include "aVector.h"
 #include "aRotation.h"
-#include <random>
+#include "aRandom.h"
 
 
 glm::mat4 toGLMmat4(const mat3& rot, const vec3& tran);
@@ -11,15 +11,17 @@ glm::vec3 toGLMvec3(const vec3& tran);
 class Random
 {
 public:
-	// Return a random float [min. max]
+	// Return a random float [min. max)
 	static float GetRandom(float min, float max)
 	{
-		static std::default_random_engine pseudo_random_generator;
-		static std::uniform_real_distribution<float> float_distribution;
+		return GetGenerator().nextFloat(min, max);
+	}
 
-		
-		float_distribution = std::uniform_real_distribution<float>(min, max);
-		return float_distribution(pseudo_random_generator);
+	// The generator behind GetRandom, for the viewers on the main thread; seed it to replay a scene
+	static ARandom& GetGenerator()
+	{
+		static ARandom generator;
+		return generator;
 	}
 
 	Random(Random const&) = delete;